@@ -6213,6 +6213,7 @@ void C_BaseAnimating::UpdateModelScale()
 void C_BaseAnimating::RefreshCollisionBounds( void )
 {
 	CollisionProp()->RefreshScaledCollisionBounds();
+	MarkRenderBoundsDirty();
 }
 
 //-----------------------------------------------------------------------------
@@ -1793,6 +1793,7 @@ void C_BaseEntity::SetModelPointer( const model_t *pModel )
 		DestroyModelInstance();
 		model = pModel;
 		OnNewModel();
+		MarkRenderBoundsDirty();
 
 		UpdateVisibility();
 	}
@@ -4548,6 +4549,19 @@ void C_BaseEntity::MarkRenderHandleDirty( )
 }
 
 
+//-----------------------------------------------------------------------------
+// Mark the cached render bounds as dirty without reinserting into the leaves
+//-----------------------------------------------------------------------------
+void C_BaseEntity::MarkRenderBoundsDirty( )
+{
+	ClientRenderHandle_t handle = GetRenderHandle();
+	if ( handle != INVALID_CLIENT_RENDER_HANDLE )
+	{
+		ClientLeafSystem()->RenderableBoundsChanged( handle );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -1397,6 +1397,7 @@ public:
 
 	// Dirty bits
 	void							MarkRenderHandleDirty();
+	void							MarkRenderBoundsDirty();
 
 	// used by SourceTV since move-parents may be missing when child spawns.
 	void							HierarchyUpdateMoveParent();
@@ -93,6 +93,7 @@ public:
 	virtual void	Update(float fTimeDelta);
 	virtual void	RenderParticles( CParticleRenderIterator *pIterator );
 	virtual void	SimulateParticles( CParticleSimulateIterator *pIterator );
+	virtual bool	IsSimulationThreadSafe() const { return true; }
 	virtual void	NotifyRemove();
 	virtual void	GetParticlePosition( Particle *pParticle, Vector& worldpos );
 	virtual void	ClientThink();
@@ -79,6 +79,8 @@ public:
 		return new CSmokeParticle( pDebugName );
 	}
 
+	virtual bool IsSimulationThreadSafe() const { return true; }
+
 	//Alpha
 	virtual float UpdateAlpha( const SimpleParticle *pParticle )
 	{
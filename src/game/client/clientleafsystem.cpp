@@ -14,6 +14,7 @@
 #include "model_types.h"
 #include "ivrenderview.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
 #include "bsptreedata.h"
 #include "detailobjectsystem.h"
 #include "engine/IStaticPropMgr.h"
@@ -23,6 +24,7 @@
 #include "datacache/imdlcache.h"
 #include "view.h"
 #include "viewrender.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -33,6 +35,9 @@ static ConVar cl_drawleaf("cl_drawleaf", "-1", FCVAR_CHEAT );
 static ConVar r_PortalTestEnts( "r_PortalTestEnts", "1", FCVAR_CHEAT, "Clip entities against portal frustums." );
 static ConVar r_portalsopenall( "r_portalsopenall", "0", FCVAR_CHEAT, "Open all portals" );
 static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0"  );
+static ConVar cl_threaded_build_renderables( "cl_threaded_build_renderables", "0", 0, "Cull the renderables in the visible leaves on worker threads when building render lists." );
+static ConVar cl_leafsystem_cached_bounds( "cl_leafsystem_cached_bounds", "1", 0, "Cull renderables against cached world-space bounds, testing them against the view frustum four at a time." );
+static ConVar cl_leafsystem_stats( "cl_leafsystem_stats", "0", FCVAR_CHEAT, "Show per-frame BuildRenderablesList statistics (leaves visited, renderables tested, time)." );
 
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CClientRenderablesList, 1, CUtlMemoryPool::GROW_SLOW );
@@ -107,11 +112,13 @@ public:
 	virtual void DrawDetailObjectsInLeaf( int leaf, int frameNumber, int& nFirstDetailObject, int& nDetailObjectCount );
 	virtual bool ShouldDrawDetailObjectsInLeaf( int leaf, int frameNumber );
 	virtual void RenderableChanged( ClientRenderHandle_t handle );
+	virtual void RenderableBoundsChanged( ClientRenderHandle_t handle );
 	virtual void SetRenderGroup( ClientRenderHandle_t handle, RenderGroup_t group );
 	virtual void ComputeTranslucentRenderLeaf( int count, const LeafIndex_t *pLeafList, const LeafFogVolume_t *pLeafFogVolumeList, int frameNumber, int viewID );
 	virtual void CollateViewModelRenderables( CUtlVector< IClientRenderable * >& opaque, CUtlVector< IClientRenderable * >& translucent );
 	virtual void BuildRenderablesList( const SetupRenderInfo_t &info );
 			void CollateRenderablesInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info );
+			void GatherRenderablesInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info );
 	virtual void DrawStaticProps( bool enable );
 	virtual void DrawSmallEntities( bool enable );
 	virtual void EnableAlternateSorting( ClientRenderHandle_t handle, bool bEnable );
@@ -154,7 +161,8 @@ private:
 	// Adds a renderable to the list of renderables
 	void AddRenderableToLeaf( int leaf, ClientRenderHandle_t handle );
 
-	void SortEntities(  const Vector &vecRenderOrigin, const Vector &vecRenderForward, CClientRenderablesList::CEntry *pEntities, int nEntities );
+	static void SortEntitiesByDist( CClientRenderablesList::CEntry *pEntities, float *pDists, int nEntities );
+	static float ComputeSortDist( IClientRenderable *pRenderable, const Vector &vecRenderOrigin, const Vector &vecRenderForward );
 
 	// Returns -1 if the renderable spans more than one area. If it's totally in one area, then this returns the leaf.
 	short GetRenderableArea( ClientRenderHandle_t handle );
@@ -163,6 +171,10 @@ private:
 	void InsertIntoTree( ClientRenderHandle_t &handle );
 	void RemoveFromTree( ClientRenderHandle_t handle );
 
+	// Cached bounds
+	void CacheRenderableBounds( ClientRenderHandle_t handle, const Vector &absMins, const Vector &absMaxs );
+	bool GetCachedRenderableBounds( ClientRenderHandle_t handle, Vector &absMins, Vector &absMaxs ) const;
+
 	// Returns if it's a view model render group
 	inline bool IsViewModelRenderGroup( RenderGroup_t group ) const;
 
@@ -238,6 +250,7 @@ private:
 		RENDER_FLAGS_STUDIO_MODEL	= 0x08,
 		RENDER_FLAGS_HASCHANGED		= 0x10,
 		RENDER_FLAGS_ALTERNATE_SORTING = 0x20,
+		RENDER_FLAGS_BOUNDS_CACHED	= 0x40,	// m_RenderableAbsMins/Maxs are valid
 	};
 
 	// All the information associated with a particular handle
@@ -292,6 +305,37 @@ private:
 		ClientRenderHandle_t handle;
 	};
 
+	// A renderable which passed the per-leaf dedup test in BuildRenderablesList
+	// and still needs to be culled. Culling fills in m_nRenderGroup.
+	struct CollateCandidate_t
+	{
+		ClientRenderHandle_t	m_Handle;
+		unsigned short			m_nWorldListLeafIndex;
+		unsigned char			m_nRenderGroup;		// RENDER_GROUP_COUNT if culled
+		bool					m_bTwoPass;
+		bool					m_bOutsideFrustum;	// Cached bounds are outside the view frustum
+		bool					m_bInsideFrustum;	// Cached bounds touch the view frustum
+		float					m_flSortDist;		// Only valid for translucent renderables
+	};
+
+	void FrustumCullCollateCandidates( const VPlane *pFrustum );
+	static void CullCollateCandidate( CollateCandidate_t &candidate );
+
+	// Scratch state for BuildRenderablesList. Candidates are stored in leaf order,
+	// so merging them back into the render list is deterministic no matter how
+	// the culling was split across threads.
+	CUtlVector< CollateCandidate_t >	m_CollateCandidates;
+	CUtlVector< int >					m_CollateLeafCandidateStart;
+	const SetupRenderInfo_t				*m_pCollateInfo;
+	bool								m_bCollatePortalTestEnts;
+	bool								m_bCollateCachedBounds;
+
+	// Per-frame BuildRenderablesList statistics
+	int		m_nStatsFrame;
+	int		m_nStatsLeavesVisited;
+	int		m_nStatsRenderablesTested;
+	float	m_flStatsTimeMS;
+
 	// Stores data associated with each leaf.
 	CUtlVector< ClientLeaf_t >	m_Leaf;
 
@@ -310,6 +354,12 @@ private:
 	// Maintains a list of all shadows cast on a particular renderable
 	CBidirectionalSet< ClientRenderHandle_t, ClientLeafShadowHandle_t, unsigned short, unsigned int >	m_ShadowsOnRenderable;
 
+	// World-space bounds of each renderable, indexed by handle, as of the last time
+	// it was placed in the leaves. Kept out of RenderableInfo_t so culling walks
+	// two tightly packed arrays instead of calling back into every renderable.
+	CUtlVector< Vector >	m_RenderableAbsMins;
+	CUtlVector< Vector >	m_RenderableAbsMaxs;
+
 	// Dirty list of renderables
 	CUtlVector< ClientRenderHandle_t >	m_DirtyRenderables;
 
@@ -438,6 +488,14 @@ void CalcRenderableWorldSpaceAABB_Fast( IClientRenderable *pRenderable, Vector &
 //-----------------------------------------------------------------------------
 CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps(true), m_DrawSmallObjects(true)
 {
+	m_pCollateInfo = NULL;
+	m_bCollatePortalTestEnts = false;
+	m_bCollateCachedBounds = false;
+	m_nStatsFrame = -1;
+	m_nStatsLeavesVisited = 0;
+	m_nStatsRenderablesTested = 0;
+	m_flStatsTimeMS = 0.0f;
+
 	// Set up the bi-directional lists...
 	m_RenderablesInLeaf.Init( FirstRenderableInLeaf, FirstLeafInRenderable );
 	m_ShadowsInLeaf.Init( FirstShadowInLeaf, FirstLeafInShadow ); 
@@ -500,6 +558,8 @@ void CClientLeafSystem::LevelShutdownPostEntity()
 {
 	m_ViewModels.Purge();
 	m_Renderables.Purge();
+	m_RenderableAbsMins.Purge();
+	m_RenderableAbsMaxs.Purge();
 	m_RenderablesInLeaf.Purge();
 	m_Shadows.Purge();
 
@@ -631,6 +691,15 @@ void CClientLeafSystem::NewRenderable( IClientRenderable* pRenderable, RenderGro
 	info.m_RenderGroup = (unsigned char)type;
 	info.m_EnumCount = 0;
 	info.m_RenderLeaf = m_RenderablesInLeaf.InvalidIndex();
+
+	// Make room for the cached bounds; they get filled in when it's placed in the leaves.
+	int nBoundsCount = m_Renderables.MaxElementIndex();
+	if ( m_RenderableAbsMins.Count() < nBoundsCount )
+	{
+		m_RenderableAbsMins.SetCount( nBoundsCount );
+		m_RenderableAbsMaxs.SetCount( nBoundsCount );
+	}
+
 	if ( IsViewModelRenderGroup( (RenderGroup_t)info.m_RenderGroup ) )
 	{
 		AddToViewModelList( handle );
@@ -1194,6 +1263,39 @@ void CClientLeafSystem::AddRenderableToLeaves( ClientRenderHandle_t handle, int
 		AddRenderableToLeaf( pLeaves[j], handle ); 
 	}
 	m_Renderables[handle].m_Area = GetRenderableArea( handle );
+
+	// The leaves were computed for us (static props), so fetch the bounds once here.
+	Vector absMins, absMaxs;
+	CalcRenderableWorldSpaceAABB_Fast( m_Renderables[handle].m_pRenderable, absMins, absMaxs );
+	CacheRenderableBounds( handle, absMins, absMaxs );
+}
+
+
+//-----------------------------------------------------------------------------
+// Cached world-space bounds. Moving a renderable goes through RenderableChanged;
+// animating models whose render bounds follow the sequence, cycle or model scale
+// call RenderableBoundsChanged. Either one drops the cached bounds, and they're
+// fetched again the next time the renderable is inserted or culled.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CacheRenderableBounds( ClientRenderHandle_t handle, const Vector &absMins, const Vector &absMaxs )
+{
+	RenderableInfo_t &info = m_Renderables[handle];
+	if ( ( info.m_Flags & ( RENDER_FLAGS_STATIC_PROP | RENDER_FLAGS_BRUSH_MODEL | RENDER_FLAGS_STUDIO_MODEL ) ) == 0 )
+		return;
+
+	m_RenderableAbsMins[handle] = absMins;
+	m_RenderableAbsMaxs[handle] = absMaxs;
+	info.m_Flags |= RENDER_FLAGS_BOUNDS_CACHED;
+}
+
+bool CClientLeafSystem::GetCachedRenderableBounds( ClientRenderHandle_t handle, Vector &absMins, Vector &absMaxs ) const
+{
+	if ( ( m_Renderables[handle].m_Flags & RENDER_FLAGS_BOUNDS_CACHED ) == 0 )
+		return false;
+
+	absMins = m_RenderableAbsMins[handle];
+	absMaxs = m_RenderableAbsMaxs[handle];
+	return true;
 }
 
 
@@ -1234,6 +1336,7 @@ void CClientLeafSystem::InsertIntoTree( ClientRenderHandle_t &handle )
 	
 	CalcRenderableWorldSpaceAABB_Fast( pRenderable, absMins, absMaxs );
 	Assert( absMins.IsValid() && absMaxs.IsValid() );
+	CacheRenderableBounds( handle, absMins, absMaxs );
 
 	ISpatialQuery* pQuery = engine->GetBSPTreeQuery();
 	pQuery->EnumerateLeavesInBox( absMins, absMaxs, this, (intp)&list );
@@ -1250,6 +1353,7 @@ void CClientLeafSystem::InsertIntoTree( ClientRenderHandle_t &handle )
 void CClientLeafSystem::RemoveFromTree( ClientRenderHandle_t handle )
 {
 	m_RenderablesInLeaf.RemoveElement( handle );
+	m_Renderables[handle].m_Flags &= ~RENDER_FLAGS_BOUNDS_CACHED;
 
 	// Remove all shadows cast onto the object
 	m_ShadowsOnRenderable.RemoveBucket( handle );
@@ -1278,6 +1382,9 @@ void CClientLeafSystem::RenderableChanged( ClientRenderHandle_t handle )
 	if ( !m_Renderables.IsValidIndex( handle ) )
 		return;
 
+	// The cached bounds are stale until it's reinserted in PreRender.
+	m_Renderables[handle].m_Flags &= ~RENDER_FLAGS_BOUNDS_CACHED;
+
 	if ( (m_Renderables[handle].m_Flags & RENDER_FLAGS_HASCHANGED ) == 0 )
 	{
 		m_Renderables[handle].m_Flags |= RENDER_FLAGS_HASCHANGED;
@@ -1293,6 +1400,18 @@ void CClientLeafSystem::RenderableChanged( ClientRenderHandle_t handle )
 }
 
 
+//-----------------------------------------------------------------------------
+// Call this when the renderable's bounds change but it didn't move
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::RenderableBoundsChanged( ClientRenderHandle_t handle )
+{
+	if ( !m_Renderables.IsValidIndex( handle ) )
+		return;
+
+	m_Renderables[handle].m_Flags &= ~RENDER_FLAGS_BOUNDS_CACHED;
+}
+
+
 //-----------------------------------------------------------------------------
 // Returns if it's a view model render group
 //-----------------------------------------------------------------------------
@@ -1571,15 +1690,15 @@ static RenderGroup_t DetectBucketedRenderGroup( RenderGroup_t group, float fDime
 	return bucketedGroup;
 }
 
-void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafIndex,	const SetupRenderInfo_t &info )
+//-----------------------------------------------------------------------------
+// Pass 1 of BuildRenderablesList: walk the renderables in a leaf and record the ones
+// this leaf is responsible for. This only touches leaf system data (no virtual calls),
+// and it's where renderables spanning several leaves get deduplicated, so it's serial.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::GatherRenderablesInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info )
 {
-	bool portalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
-	
-	// Place a fake entity for static/opaque ents in this leaf
-	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_STATIC, NULL );
-	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+	m_CollateLeafCandidateStart.AddToTail( m_CollateCandidates.Count() );
 
-	// Collate everything.
 	unsigned int idx = m_RenderablesInLeaf.FirstElement(leaf);
 	for ( ;idx != m_RenderablesInLeaf.InvalidIndex(); idx = m_RenderablesInLeaf.NextElement(idx) )
 	{
@@ -1621,96 +1740,244 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 				continue;
 		}
 
-		unsigned char nAlpha = 255;
-		if ( info.m_bDrawTranslucentObjects ) 
+		Assert( (worldListLeafIndex >= 0) && (worldListLeafIndex <= 65535) );
+		int i = m_CollateCandidates.AddToTail();
+		CollateCandidate_t &candidate = m_CollateCandidates[i];
+		candidate.m_Handle = handle;
+		candidate.m_nWorldListLeafIndex = (unsigned short)worldListLeafIndex;
+		candidate.m_nRenderGroup = RENDER_GROUP_COUNT;
+		candidate.m_bTwoPass = false;
+		candidate.m_bOutsideFrustum = false;
+		candidate.m_bInsideFrustum = false;
+		candidate.m_flSortDist = 0.0f;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Pass 2a of BuildRenderablesList: test the candidates whose bounds are cached
+// against the view frustum, four boxes at a time. This reads nothing but the
+// packed bounds arrays. Whatever it can't decide is left to CullCollateCandidate.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::FrustumCullCollateCandidates( const VPlane *pFrustum )
+{
+	VPROF( "CClientLeafSystem::FrustumCullCollateCandidates" );
+
+	int nCandidates = m_CollateCandidates.Count();
+	int nBatchCount = 0;
+	int iBatch[4];
+	for ( int i = 0; i <= nCandidates; ++i )
+	{
+		if ( i < nCandidates )
 		{
-			// Prevent culling if the renderable is invisible
-			// NOTE: OPAQUE objects can have alpha == 0. 
-			// They are made to be opaque because they don't have to be sorted.
-			nAlpha = renderable.m_pRenderable->GetFxBlend();
-			if ( nAlpha == 0 )
+			if ( ( m_Renderables[ m_CollateCandidates[i].m_Handle ].m_Flags & RENDER_FLAGS_BOUNDS_CACHED ) == 0 )
 				continue;
+
+			iBatch[nBatchCount++] = i;
+			if ( nBatchCount < 4 )
+				continue;
+		}
+		else if ( nBatchCount == 0 )
+		{
+			break;
 		}
 
-		Vector absMins, absMaxs;
-		CalcRenderableWorldSpaceAABB( renderable.m_pRenderable, absMins, absMaxs );
-		// If the renderable is inside an area, cull it using the frustum for that area.
-		if ( portalTestEnts && renderable.m_Area != -1 )
+		// Pad a partial batch out with copies of its first box
+		for ( int j = nBatchCount; j < 4; ++j )
 		{
-			VPROF( "r_PortalTestEnts" );
-			if ( !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area ) )
-				continue;
+			iBatch[j] = iBatch[0];
 		}
-		else
+
+		ClientRenderHandle_t h0 = m_CollateCandidates[iBatch[0]].m_Handle;
+		ClientRenderHandle_t h1 = m_CollateCandidates[iBatch[1]].m_Handle;
+		ClientRenderHandle_t h2 = m_CollateCandidates[iBatch[2]].m_Handle;
+		ClientRenderHandle_t h3 = m_CollateCandidates[iBatch[3]].m_Handle;
+
+		FourVectors mins, maxs;
+		mins.LoadAndSwizzle( m_RenderableAbsMins[h0], m_RenderableAbsMins[h1], m_RenderableAbsMins[h2], m_RenderableAbsMins[h3] );
+		maxs.LoadAndSwizzle( m_RenderableAbsMaxs[h0], m_RenderableAbsMaxs[h1], m_RenderableAbsMaxs[h2], m_RenderableAbsMaxs[h3] );
+
+		// A box is outside if the corner furthest along a plane's normal is still behind it
+		fltx4 fl4Outside = Four_Zeros;
+		for ( int p = 0; p < FRUSTUM_NUMPLANES; ++p )
 		{
-			// cull with main frustum
-			if ( engine->CullBox( absMins, absMaxs ) )
-				continue;
+			const Vector &normal = pFrustum[p].m_Normal;
+			fltx4 fl4Dist = MulSIMD( ( normal.x >= 0.0f ) ? maxs.x : mins.x, ReplicateX4( normal.x ) );
+			fl4Dist = MaddSIMD( ( normal.y >= 0.0f ) ? maxs.y : mins.y, ReplicateX4( normal.y ), fl4Dist );
+			fl4Dist = MaddSIMD( ( normal.z >= 0.0f ) ? maxs.z : mins.z, ReplicateX4( normal.z ), fl4Dist );
+			fl4Outside = OrSIMD( fl4Outside, CmpLtSIMD( fl4Dist, ReplicateX4( pFrustum[p].m_Dist ) ) );
 		}
 
-		// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
-		if ( renderable.m_Flags & RENDER_FLAGS_STUDIO_MODEL )
+		int nOutsideMask = TestSignSIMD( fl4Outside );
+		for ( int j = 0; j < nBatchCount; ++j )
 		{
-			// test to see if this renderable is occluded by the engine's occlusion system
-			if ( engine->IsOccluded( absMins, absMaxs ) )
-				continue;
+			CollateCandidate_t &candidate = m_CollateCandidates[iBatch[j]];
+			candidate.m_bOutsideFrustum = ( nOutsideMask & ( 1 << j ) ) != 0;
+			candidate.m_bInsideFrustum = !candidate.m_bOutsideFrustum;
 		}
 
-#ifdef INVASION_CLIENT_DLL
-		if (info.m_flRenderDistSq != 0.0f)
+		nBatchCount = 0;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Pass 2b of BuildRenderablesList: cull a single candidate and decide which group
+// it goes in. Each call only writes to its own candidate, so this can run on any thread.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CullCollateCandidate( CollateCandidate_t &candidate )
+{
+	if ( candidate.m_bOutsideFrustum )
+		return;
+
+	const SetupRenderInfo_t &info = *s_ClientLeafSystem.m_pCollateInfo;
+	RenderableInfo_t& renderable = s_ClientLeafSystem.m_Renderables[candidate.m_Handle];
+
+	unsigned char nAlpha = 255;
+	if ( info.m_bDrawTranslucentObjects ) 
+	{
+		// Prevent culling if the renderable is invisible
+		// NOTE: OPAQUE objects can have alpha == 0. 
+		// They are made to be opaque because they don't have to be sorted.
+		nAlpha = renderable.m_pRenderable->GetFxBlend();
+		if ( nAlpha == 0 )
+			return;
+	}
+
+	Vector absMins, absMaxs;
+	if ( !s_ClientLeafSystem.m_bCollateCachedBounds || !s_ClientLeafSystem.GetCachedRenderableBounds( candidate.m_Handle, absMins, absMaxs ) )
+	{
+		CalcRenderableWorldSpaceAABB( renderable.m_pRenderable, absMins, absMaxs );
+
+		// A renderable is a candidate at most once per list, so this only writes its own slot.
+		if ( s_ClientLeafSystem.m_bCollateCachedBounds )
 		{
-			Vector mins, maxs;
-			renderable.m_pRenderable->GetRenderBounds( mins, maxs );
+			s_ClientLeafSystem.CacheRenderableBounds( candidate.m_Handle, absMins, absMaxs );
+		}
+	}
 
-			if ((maxs.z - mins.z) < 100)
-			{
-				Vector vCenter;
-				VectorLerp( mins, maxs, 0.5f, vCenter );
-				vCenter += renderable.m_pRenderable->GetRenderOrigin();
+	// If the renderable is inside an area, cull it using the frustum for that area.
+	if ( s_ClientLeafSystem.m_bCollatePortalTestEnts && renderable.m_Area != -1 )
+	{
+		VPROF( "r_PortalTestEnts" );
+		if ( !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area ) )
+			return;
+	}
+	else if ( !candidate.m_bInsideFrustum )
+	{
+		// cull with main frustum
+		if ( engine->CullBox( absMins, absMaxs ) )
+			return;
+	}
 
-				float flDistSq = info.m_vecRenderOrigin.DistToSqr( vCenter );
-				if (info.m_flRenderDistSq <= flDistSq)
-					continue;
-			}
+	// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
+	if ( renderable.m_Flags & RENDER_FLAGS_STUDIO_MODEL )
+	{
+		// test to see if this renderable is occluded by the engine's occlusion system
+		if ( engine->IsOccluded( absMins, absMaxs ) )
+			return;
+	}
+
+#ifdef INVASION_CLIENT_DLL
+	if (info.m_flRenderDistSq != 0.0f)
+	{
+		Vector mins, maxs;
+		renderable.m_pRenderable->GetRenderBounds( mins, maxs );
+
+		if ((maxs.z - mins.z) < 100)
+		{
+			Vector vCenter;
+			VectorLerp( mins, maxs, 0.5f, vCenter );
+			vCenter += renderable.m_pRenderable->GetRenderOrigin();
+
+			float flDistSq = info.m_vecRenderOrigin.DistToSqr( vCenter );
+			if (info.m_flRenderDistSq <= flDistSq)
+				return;
 		}
+	}
 #endif
 
-		if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+	if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+	{
+		RenderGroup_t group = (RenderGroup_t)renderable.m_RenderGroup;
+
+		// Determine object group offset
+		if ( RENDER_GROUP_CFG_NUM_OPAQUE_ENT_BUCKETS > 1 &&
+			 group >= RENDER_GROUP_OPAQUE_STATIC &&
+			 group <= RENDER_GROUP_OPAQUE_ENTITY )
 		{
-			RenderGroup_t group = (RenderGroup_t)renderable.m_RenderGroup;
+			Vector dims;
+			VectorSubtract( absMaxs, absMins, dims );
 
-			// Determine object group offset
-			if ( RENDER_GROUP_CFG_NUM_OPAQUE_ENT_BUCKETS > 1 &&
-				 group >= RENDER_GROUP_OPAQUE_STATIC &&
-				 group <= RENDER_GROUP_OPAQUE_ENTITY )
-			{
-				Vector dims;
-				VectorSubtract( absMaxs, absMins, dims );
+			float const fDimension = MAX( MAX( fabs(dims.x), fabs(dims.y) ), fabs(dims.z) );
+			group = DetectBucketedRenderGroup( group, fDimension );
+			
+			Assert( group >= RENDER_GROUP_OPAQUE_STATIC_HUGE && group <= RENDER_GROUP_OPAQUE_ENTITY );
+		}
 
-				float const fDimension = MAX( MAX( fabs(dims.x), fabs(dims.y) ), fabs(dims.z) );
-				group = DetectBucketedRenderGroup( group, fDimension );
-				
-				Assert( group >= RENDER_GROUP_OPAQUE_STATIC_HUGE && group <= RENDER_GROUP_OPAQUE_ENTITY );
-			}
+		candidate.m_nRenderGroup = (unsigned char)group;
+	}
+	else
+	{
+		candidate.m_nRenderGroup = RENDER_GROUP_TRANSLUCENT_ENTITY;
+		candidate.m_bTwoPass = ((renderable.m_Flags & RENDER_FLAGS_TWOPASS) != 0) && ( nAlpha == 255 );	// Two pass?
+
+		// Compute the sort key here too, so sorting doesn't have to go back to the renderable.
+		if ( info.m_bDrawTranslucentObjects )
+		{
+			candidate.m_flSortDist = ComputeSortDist( renderable.m_pRenderable, info.m_vecRenderOrigin, info.m_vecRenderForward );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Pass 3 of BuildRenderablesList: add the surviving candidates and detail objects
+// of a leaf to the render list, in the same order the serial walk used to.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafIndex,	const SetupRenderInfo_t &info )
+{
+	CClientRenderablesList &renderList = *info.m_pRenderList;
+	int &nTranslucentEntries = renderList.m_RenderGroupCounts[RENDER_GROUP_TRANSLUCENT_ENTITY];
+	int nFirstTranslucent = nTranslucentEntries;
+	float dists[CClientRenderablesList::MAX_GROUP_ENTITIES];
+
+	// Place a fake entity for static/opaque ents in this leaf
+	AddRenderableToRenderList( renderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_STATIC, NULL );
+	AddRenderableToRenderList( renderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, NULL );
 
-			AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-				worldListLeafIndex, group, handle);
+	int nFirst = m_CollateLeafCandidateStart[worldListLeafIndex];
+	int nEnd = ( worldListLeafIndex + 1 < m_CollateLeafCandidateStart.Count() ) ? m_CollateLeafCandidateStart[worldListLeafIndex + 1] : m_CollateCandidates.Count();
+	for ( int i = nFirst; i < nEnd; ++i )
+	{
+		const CollateCandidate_t &candidate = m_CollateCandidates[i];
+		if ( candidate.m_nRenderGroup == RENDER_GROUP_COUNT )
+			continue;
+
+		IClientRenderable *pRenderable = m_Renderables[candidate.m_Handle].m_pRenderable;
+		if( candidate.m_nRenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+		{
+			AddRenderableToRenderList( renderList, pRenderable, 
+				worldListLeafIndex, (RenderGroup_t)candidate.m_nRenderGroup, candidate.m_Handle );
 		}
 		else
 		{
-			bool bTwoPass = ((renderable.m_Flags & RENDER_FLAGS_TWOPASS) != 0) && ( nAlpha == 255 );	// Two pass?
-
 			// Add to appropriate list if drawing translucent objects (shadow depth mapping will skip this)
 			if ( info.m_bDrawTranslucentObjects ) 
 			{
-				AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-					worldListLeafIndex, (RenderGroup_t)renderable.m_RenderGroup, handle, bTwoPass );
+				int nCount = nTranslucentEntries;
+				AddRenderableToRenderList( renderList, pRenderable, 
+					worldListLeafIndex, RENDER_GROUP_TRANSLUCENT_ENTITY, candidate.m_Handle, candidate.m_bTwoPass );
+				if ( nTranslucentEntries != nCount )
+				{
+					dists[nCount - nFirstTranslucent] = candidate.m_flSortDist;
+				}
 			}
 			
-			if ( bTwoPass )	// Also add to opaque list if it's a two-pass model... 
+			if ( candidate.m_bTwoPass )	// Also add to opaque list if it's a two-pass model... 
 			{
-				AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-					worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, handle, bTwoPass );
+				AddRenderableToRenderList( renderList, pRenderable, 
+					worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, candidate.m_Handle, candidate.m_bTwoPass );
 			}
 		}
 	}
@@ -1719,7 +1986,7 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 	// These don't have render handles!
 	if ( info.m_bDrawDetailObjects && ShouldDrawDetailObjectsInLeaf( leaf, info.m_nDetailBuildFrame ) )
 	{
-		idx = m_Leaf[leaf].m_FirstDetailProp;
+		int idx = m_Leaf[leaf].m_FirstDetailProp;
 		int count = m_Leaf[leaf].m_DetailPropCount;
 		while( --count >= 0 )
 		{
@@ -1735,64 +2002,75 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 						// Lots of the detail entities are invisible so avoid sorting them and all that.
 						if( pRenderable->GetFxBlend() > 0 )
 						{
-							AddRenderableToRenderList( *info.m_pRenderList, pRenderable, 
+							int nCount = nTranslucentEntries;
+							AddRenderableToRenderList( renderList, pRenderable, 
 								worldListLeafIndex, RENDER_GROUP_TRANSLUCENT_ENTITY, DETAIL_PROP_RENDER_HANDLE );
+							if ( nTranslucentEntries != nCount )
+							{
+								dists[nCount - nFirstTranslucent] = ComputeSortDist( pRenderable, info.m_vecRenderOrigin, info.m_vecRenderForward );
+							}
 						}
 					}
 				}
 				else
 				{
-					AddRenderableToRenderList( *info.m_pRenderList, pRenderable, 
+					AddRenderableToRenderList( renderList, pRenderable, 
 						worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, DETAIL_PROP_RENDER_HANDLE );
 				}
 			}
 			++idx;
 		}
 	}
+
+	int nNewTranslucent = nTranslucentEntries - nFirstTranslucent;
+	if( (nNewTranslucent != 0 ) && info.m_bDrawTranslucentObjects )
+	{
+		// Sort the new translucent entities.
+		SortEntitiesByDist( &renderList.m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY][nFirstTranslucent], dists, nNewTranslucent );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Distance along the view direction used to sort translucent renderables
+//-----------------------------------------------------------------------------
+float CClientLeafSystem::ComputeSortDist( IClientRenderable *pRenderable, const Vector &vecRenderOrigin, const Vector &vecRenderForward )
+{
+	// Compute the center of the object (needed for translucent brush models)
+	Vector boxcenter;
+	Vector mins,maxs;
+	pRenderable->GetRenderBounds( mins, maxs );
+	VectorAdd( mins, maxs, boxcenter );
+	VectorMA( pRenderable->GetRenderOrigin(), 0.5f, boxcenter, boxcenter );
+
+	// Compute distance...
+	Vector delta;
+	VectorSubtract( boxcenter, vecRenderOrigin, delta );
+	return DotProduct( delta, vecRenderForward );
 }
 
 
 //-----------------------------------------------------------------------------
 // Sort entities in a back-to-front ordering
 //-----------------------------------------------------------------------------
-void CClientLeafSystem::SortEntities( const Vector &vecRenderOrigin, const Vector &vecRenderForward, CClientRenderablesList::CEntry *pEntities, int nEntities )
+void CClientLeafSystem::SortEntitiesByDist( CClientRenderablesList::CEntry *pEntities, float *pDists, int nEntities )
 {
 	// Don't sort if we only have 1 entity
 	if ( nEntities <= 1 )
 		return;
 
-	float dists[CClientRenderablesList::MAX_GROUP_ENTITIES];
-
-	// First get a distance for each entity.
-	int i;
-	for( i=0; i < nEntities; i++ )
-	{
-		IClientRenderable *pRenderable = pEntities[i].m_pRenderable;
-
-		// Compute the center of the object (needed for translucent brush models)
-		Vector boxcenter;
-		Vector mins,maxs;
-		pRenderable->GetRenderBounds( mins, maxs );
-		VectorAdd( mins, maxs, boxcenter );
-		VectorMA( pRenderable->GetRenderOrigin(), 0.5f, boxcenter, boxcenter );
-
-		// Compute distance...
-		Vector delta;
-		VectorSubtract( boxcenter, vecRenderOrigin, delta );
-		dists[i] = DotProduct( delta, vecRenderForward );
-	}
-
 	// H-sort.
+	int i;
 	int stepSize = 4;
 	while( stepSize )
 	{
 		int end = nEntities - stepSize;
 		for( i=0; i < end; i += stepSize )
 		{
-			if( dists[i] > dists[i+stepSize] )
+			if( pDists[i] > pDists[i+stepSize] )
 			{
 				::V_swap( pEntities[i], pEntities[i+stepSize] );
-				::V_swap( dists[i], dists[i+stepSize] );
+				::V_swap( pDists[i], pDists[i+stepSize] );
 
 				if( i == 0 )
 				{
@@ -1813,24 +2091,70 @@ void CClientLeafSystem::SortEntities( const Vector &vecRenderOrigin, const Vecto
 void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 {
 	VPROF_BUDGET( "BuildRenderablesList", "BuildRenderablesList" );
+	CFastTimer timer;
+	timer.Start();
+
 	int leafCount = info.m_pWorldListInfo->m_LeafCount;
-	const Vector &vecRenderOrigin = info.m_vecRenderOrigin;
-	const Vector &vecRenderForward = info.m_vecRenderForward;
-	CClientRenderablesList::CEntry *pTranslucentEntries = info.m_pRenderList->m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY];
-	int &nTranslucentEntries = info.m_pRenderList->m_RenderGroupCounts[RENDER_GROUP_TRANSLUCENT_ENTITY];
 
+	m_pCollateInfo = &info;
+	m_bCollatePortalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
+	m_bCollateCachedBounds = cl_leafsystem_cached_bounds.GetBool();
+	m_CollateCandidates.RemoveAll();
+	m_CollateLeafCandidateStart.RemoveAll();
+	m_CollateLeafCandidateStart.EnsureCapacity( leafCount );
+
+	// Find the renderables each leaf is responsible for...
 	for( int i = 0; i < leafCount; i++ )
 	{
-		int nTranslucent = nTranslucentEntries;
+		GatherRenderablesInLeaf( info.m_pWorldListInfo->m_pLeafList[i], i, info );
+	}
+
+	// ...cull them...
+	int nCandidates = m_CollateCandidates.Count();
+	if ( m_bCollateCachedBounds )
+	{
+		FrustumCullCollateCandidates( view->GetFrustum() );
+	}
+
+	if ( cl_threaded_build_renderables.GetBool() && nCandidates > 1 )
+	{
+		ParallelProcess( "CClientLeafSystem::BuildRenderablesList", m_CollateCandidates.Base(), nCandidates, &CClientLeafSystem::CullCollateCandidate, &::FrameLock, &::FrameUnlock );
+	}
+	else
+	{
+		for( int i = 0; i < nCandidates; i++ )
+		{
+			CullCollateCandidate( m_CollateCandidates[i] );
+		}
+	}
 
-		// Add renderables from this leaf...
+	// ...and add what's left to the render list in leaf order.
+	for( int i = 0; i < leafCount; i++ )
+	{
 		CollateRenderablesInLeaf( info.m_pWorldListInfo->m_pLeafList[i], i, info );
+	}
 
-		int nNewTranslucent = nTranslucentEntries - nTranslucent;
-		if( (nNewTranslucent != 0 ) && info.m_bDrawTranslucentObjects )
+	m_pCollateInfo = NULL;
+
+	timer.End();
+
+	VPROF_INCREMENT_COUNTER( "BuildRenderablesList leaves", leafCount );
+	VPROF_INCREMENT_COUNTER( "BuildRenderablesList renderables tested", nCandidates );
+
+	if ( m_nStatsFrame != gpGlobals->framecount )
+	{
+		if ( cl_leafsystem_stats.GetBool() )
 		{
-			// Sort the new translucent entities.
-			SortEntities( vecRenderOrigin, vecRenderForward, &pTranslucentEntries[nTranslucent], nNewTranslucent );
+			engine->Con_NPrintf( 12, "BuildRenderablesList: %d leaves, %d renderables tested, %.3f ms%s", 
+				m_nStatsLeavesVisited, m_nStatsRenderablesTested, m_flStatsTimeMS, cl_threaded_build_renderables.GetBool() ? " (threaded)" : "" );
 		}
+
+		m_nStatsFrame = gpGlobals->framecount;
+		m_nStatsLeavesVisited = 0;
+		m_nStatsRenderablesTested = 0;
+		m_flStatsTimeMS = 0.0f;
 	}
+	m_nStatsLeavesVisited += leafCount;
+	m_nStatsRenderablesTested += nCandidates;
+	m_flStatsTimeMS += timer.GetDuration().GetMillisecondsF();
 }
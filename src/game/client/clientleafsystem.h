@@ -159,6 +159,9 @@ public:
 	// Call this when a renderable origin/angles/bbox parameters has changed
 	virtual void RenderableChanged( ClientRenderHandle_t handle ) = 0;
 
+	// Call this when a renderable's render bounds changed without it moving (animation, model scale)
+	virtual void RenderableBoundsChanged( ClientRenderHandle_t handle ) = 0;
+
 	// Set a render group
 	virtual void SetRenderGroup( ClientRenderHandle_t handle, RenderGroup_t group ) = 0;
 
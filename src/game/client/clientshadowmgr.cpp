@@ -81,6 +81,7 @@
 #include "toolframework_client.h"
 #include "bonetoworldarray.h"
 #include "cmodel.h"
+#include "view.h"
 
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -683,6 +684,14 @@ void CTextureAllocator::GetTextureRect(TextureHandle_t handle, int& x, int& y, i
 
 static ConVar r_shadows( "r_shadows", "1" ); // hook into engine's cvars..
 static ConVar r_shadowmaxrendered("r_shadowmaxrendered", "32");
+static ConVar r_shadow_update_scheduler( "r_shadow_update_scheduler", "1", 0, "Update the projections and textures of distant, small or slow shadow casters at a reduced rate" );
+static ConVar r_shadow_update_near_dist( "r_shadow_update_near_dist", "512", 0, "Shadow casters closer than this re-project every frame" );
+static ConVar r_shadow_update_far_dist( "r_shadow_update_far_dist", "1536", 0, "Shadow casters farther than this re-project at the lowest rate" );
+static ConVar r_shadow_update_max_interval( "r_shadow_update_max_interval", "4", 0, "Most frames a dirty shadow may wait for a projection or texture update" );
+static ConVar r_shadow_update_fullrate_area( "r_shadow_update_fullrate_area", "4096", 0, "Shadows covering at least this many screen pixels re-render their texture every frame" );
+static ConVar r_shadow_projection_budget( "r_shadow_projection_budget", "64", 0, "Max shadow projection recomputes per frame (0 = no limit)" );
+static ConVar r_shadow_texture_budget( "r_shadow_texture_budget", "16", 0, "Max render-to-texture shadow re-renders per frame (0 = no limit)" );
+static ConVar r_shadow_update_stats( "r_shadow_update_stats", "0", 0, "Show per-frame shadow projection and texture update counters" );
 static ConVar r_shadows_gamecontrol( "r_shadows_gamecontrol", "-1", FCVAR_CHEAT );	 // hook into engine's cvars..
 
 //-----------------------------------------------------------------------------
@@ -816,6 +825,8 @@ private:
 		TextureHandle_t			m_ShadowTexture;
 		CTextureReference		m_ShadowDepthTexture;
 		int						m_nRenderFrame;
+		int						m_nLastProjectionFrame;
+		int						m_nLastTextureFrame;
 		EHANDLE					m_hTargetEntity;
 	};
 
@@ -845,6 +856,12 @@ private:
 	// Update a shadow
 	void UpdateProjectedTextureInternal( ClientShadowHandle_t handle, bool force );
 
+	// Re-projects the dirty shadows, near and fast movers first, within r_shadow_projection_budget
+	void UpdateDirtyShadowsScheduled();
+
+	// Should a dirty render-to-texture shadow keep its old texture this frame?
+	bool ShouldDeferShadowTexture( const ClientShadow_t &shadow, float flArea ) const;
+
 	// Compute the shadow origin and attenuation start distance
 	float ComputeLocalShadowOrigin( IClientRenderable* pRenderable, 
 		const Vector& mins, const Vector& maxs, const Vector& localShadowDir, float backupFactor, Vector& origin );
@@ -963,6 +980,12 @@ private:
 	CUtlRBTree< ClientShadowHandle_t, unsigned short >	m_DirtyShadows;
 	CUtlVector< ClientShadowHandle_t > m_TransparentShadows;
 
+	// Per-frame shadow update counters, shown by r_shadow_update_stats
+	int m_nStatsProjectionsUpdated;
+	int m_nStatsProjectionsDeferred;
+	int m_nStatsTexturesRendered;
+	int m_nStatsTexturesDeferred;
+
 	// These members maintain current state of depth texturing (size and global active state)
 	// If either changes in a frame, PreRender() will catch it and do the appropriate allocation, deallocation or reallocation
 	bool m_bDepthTextureActive;
@@ -1172,6 +1195,10 @@ CClientShadowMgr::CClientShadowMgr() :
 {
 	m_nDepthTextureResolution = r_flashlightdepthres.GetInt();
 	m_bThreaded = false;
+	m_nStatsProjectionsUpdated = 0;
+	m_nStatsProjectionsDeferred = 0;
+	m_nStatsTexturesRendered = 0;
+	m_nStatsTexturesDeferred = 0;
 }
 
 
@@ -1822,6 +1849,8 @@ ClientShadowHandle_t CClientShadowMgr::CreateProjectedTexture( ClientEntityHandl
 	shadow.m_ClientLeafShadowHandle = ClientLeafSystem()->AddShadow( h, flags );
 	shadow.m_Flags = flags;
 	shadow.m_nRenderFrame = -1;
+	shadow.m_nLastProjectionFrame = -1;
+	shadow.m_nLastTextureFrame = -1;
 	shadow.m_LastOrigin.Init( FLT_MAX, FLT_MAX, FLT_MAX );
 	shadow.m_LastAngles.Init( FLT_MAX, FLT_MAX, FLT_MAX );
 	Assert( ( ( shadow.m_Flags & SHADOW_FLAGS_FLASHLIGHT ) == 0 ) != 
@@ -2939,21 +2968,39 @@ void CClientShadowMgr::PreRender()
 		return;
 	}
 
+	if ( r_shadow_update_stats.GetBool() )
+	{
+		engine->Con_NPrintf( 13, "Shadows: %d projections (%d deferred), %d textures (%d deferred)%s",
+			m_nStatsProjectionsUpdated, m_nStatsProjectionsDeferred, m_nStatsTexturesRendered, m_nStatsTexturesDeferred,
+			r_shadow_update_scheduler.GetBool() ? "" : " (scheduler off)" );
+	}
+	m_nStatsProjectionsUpdated = 0;
+	m_nStatsProjectionsDeferred = 0;
+	m_nStatsTexturesRendered = 0;
+	m_nStatsTexturesDeferred = 0;
+
 	m_bUpdatingDirtyShadows = true;
 
-	unsigned short i = m_DirtyShadows.FirstInorder();
-	while ( i != m_DirtyShadows.InvalidIndex() )
+	if ( r_shadow_update_scheduler.GetBool() )
 	{
-		ClientShadowHandle_t& handle = m_DirtyShadows[ i ];
-		Assert( m_Shadows.IsValidIndex( handle ) );
-		UpdateProjectedTextureInternal( handle, false );
-		i = m_DirtyShadows.NextInorder(i);
+		UpdateDirtyShadowsScheduled();
+	}
+	else
+	{
+		unsigned short i = m_DirtyShadows.FirstInorder();
+		while ( i != m_DirtyShadows.InvalidIndex() )
+		{
+			ClientShadowHandle_t& handle = m_DirtyShadows[ i ];
+			Assert( m_Shadows.IsValidIndex( handle ) );
+			UpdateProjectedTextureInternal( handle, false );
+			i = m_DirtyShadows.NextInorder(i);
+		}
+		m_DirtyShadows.RemoveAll();
 	}
-	m_DirtyShadows.RemoveAll();
 
 	// Transparent shadows must remain dirty, since they were not re-projected
 	int nCount = m_TransparentShadows.Count();
-	for ( i = 0; i < nCount; ++i )
+	for ( int i = 0; i < nCount; ++i )
 	{
 		m_DirtyShadows.Insert( m_TransparentShadows[i] );
 	}
@@ -2963,6 +3010,117 @@ void CClientShadowMgr::PreRender()
 }
 
 
+//-----------------------------------------------------------------------------
+// Shadow update scheduling. Casters near the view re-project every frame; the
+// interval grows with distance up to r_shadow_update_max_interval, and casters
+// that moved far relative to their distance drop back a band.
+//-----------------------------------------------------------------------------
+struct ShadowUpdateCandidate_t
+{
+	ClientShadowHandle_t	m_hShadow;
+	int						m_nOverdue;		// frames past its interval, negative if not yet due
+	float					m_flDistSqr;
+};
+
+static int __cdecl ShadowUpdateCandidateSortFunc( const ShadowUpdateCandidate_t *pLeft, const ShadowUpdateCandidate_t *pRight )
+{
+	if ( pLeft->m_nOverdue != pRight->m_nOverdue )
+		return ( pLeft->m_nOverdue > pRight->m_nOverdue ) ? -1 : 1;
+	if ( pLeft->m_flDistSqr != pRight->m_flDistSqr )
+		return ( pLeft->m_flDistSqr < pRight->m_flDistSqr ) ? -1 : 1;
+	return 0;
+}
+
+static int ComputeShadowProjectionInterval( float flDistSqr, float flMoveSqr )
+{
+	int nMaxInterval = MAX( r_shadow_update_max_interval.GetInt(), 1 );
+	float flNearDist = r_shadow_update_near_dist.GetFloat();
+	float flFarDist = MAX( r_shadow_update_far_dist.GetFloat(), flNearDist + 1.0f );
+	if ( flDistSqr <= flNearDist * flNearDist )
+		return 1;
+
+	int nInterval = nMaxInterval;
+	if ( flDistSqr < flFarDist * flFarDist )
+	{
+		float t = ( FastSqrt( flDistSqr ) - flNearDist ) / ( flFarDist - flNearDist );
+		nInterval = 1 + (int)( t * ( nMaxInterval - 1 ) + 0.5f );
+	}
+
+	// Moved more than 1/50th of its distance: the lag would be visible
+	if ( flMoveSqr * 2500.0f > flDistSqr )
+	{
+		nInterval = MAX( nInterval / 2, 1 );
+	}
+	return nInterval;
+}
+
+void CClientShadowMgr::UpdateDirtyShadowsScheduled()
+{
+	VPROF_BUDGET( "CClientShadowMgr::UpdateDirtyShadowsScheduled", VPROF_BUDGETGROUP_SHADOW_RENDERING );
+
+	CUtlVectorFixedGrowable< ShadowUpdateCandidate_t, 256 > candidates;
+	CUtlVectorFixedGrowable< ClientShadowHandle_t, 256 > deferred;
+
+	const Vector &vecViewOrigin = MainViewOrigin();
+	int nFrame = gpGlobals->framecount;
+
+	// Flashlights, forced and first-time updates always go through right away
+	unsigned short i = m_DirtyShadows.FirstInorder();
+	while ( i != m_DirtyShadows.InvalidIndex() )
+	{
+		ClientShadowHandle_t handle = m_DirtyShadows[ i ];
+		i = m_DirtyShadows.NextInorder( i );
+		Assert( m_Shadows.IsValidIndex( handle ) );
+
+		ClientShadow_t &shadow = m_Shadows[handle];
+		IClientRenderable *pRenderable = ( shadow.m_Flags & SHADOW_FLAGS_FLASHLIGHT ) ? NULL : ClientEntityList().GetClientRenderableFromHandle( shadow.m_Entity );
+		if ( !pRenderable || ( shadow.m_nLastProjectionFrame < 0 ) || ( shadow.m_LastAngles.x == FLT_MAX ) )
+		{
+			UpdateProjectedTextureInternal( handle, false );
+			continue;
+		}
+
+		int j = candidates.AddToTail();
+		ShadowUpdateCandidate_t &candidate = candidates[j];
+		candidate.m_hShadow = handle;
+		candidate.m_flDistSqr = vecViewOrigin.DistToSqr( pRenderable->GetRenderOrigin() );
+		float flMoveSqr = shadow.m_LastOrigin.DistToSqr( pRenderable->GetRenderOrigin() );
+		candidate.m_nOverdue = ( nFrame - shadow.m_nLastProjectionFrame ) - ComputeShadowProjectionInterval( candidate.m_flDistSqr, flMoveSqr );
+	}
+
+	candidates.Sort( ShadowUpdateCandidateSortFunc );
+
+	int nBudget = r_shadow_projection_budget.GetInt();
+	int nMaxInterval = MAX( r_shadow_update_max_interval.GetInt(), 1 );
+	int nCount = candidates.Count();
+	for ( int j = 0; j < nCount; ++j )
+	{
+		const ShadowUpdateCandidate_t &candidate = candidates[j];
+		bool bStarved = ( nFrame - m_Shadows[candidate.m_hShadow].m_nLastProjectionFrame ) >= nMaxInterval;
+		bool bOverBudget = ( nBudget > 0 ) && ( m_nStatsProjectionsUpdated >= nBudget );
+		if ( ( candidate.m_nOverdue < 0 ) || ( bOverBudget && !bStarved ) )
+		{
+			deferred.AddToTail( candidate.m_hShadow );
+			continue;
+		}
+		UpdateProjectedTextureInternal( candidate.m_hShadow, false );
+	}
+
+	// Deferred shadows stay dirty; their renderables are still marked dirty too,
+	// so nothing else will re-add them in the meantime
+	m_DirtyShadows.RemoveAll();
+	nCount = deferred.Count();
+	for ( int j = 0; j < nCount; ++j )
+	{
+		if ( m_Shadows.IsValidIndex( deferred[j] ) )
+		{
+			m_DirtyShadows.Insert( deferred[j] );
+		}
+	}
+	m_nStatsProjectionsDeferred += nCount;
+}
+
+
 //-----------------------------------------------------------------------------
 // Gets the entity whose shadow this shadow will render into
 //-----------------------------------------------------------------------------
@@ -3177,6 +3335,8 @@ void CClientShadowMgr::UpdateShadow( ClientShadowHandle_t handle, bool force )
 void CClientShadowMgr::UpdateProjectedTextureInternal( ClientShadowHandle_t handle, bool force )
 {
 	ClientShadow_t& shadow = m_Shadows[handle];
+	shadow.m_nLastProjectionFrame = gpGlobals->framecount;
+	++m_nStatsProjectionsUpdated;
 
 	if( shadow.m_Flags & SHADOW_FLAGS_FLASHLIGHT )
 	{
@@ -3731,6 +3891,34 @@ bool CClientShadowMgr::BuildSetupListForRenderToTextureShadow( unsigned short cl
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Render-to-texture shadows at least r_shadow_update_fullrate_area pixels big
+// redraw every frame; smaller ones redraw at a rate proportional to their
+// area. Past r_shadow_texture_budget redraws, only starved shadows get through.
+//-----------------------------------------------------------------------------
+bool CClientShadowMgr::ShouldDeferShadowTexture( const ClientShadow_t &shadow, float flArea ) const
+{
+	if ( !r_shadow_update_scheduler.GetBool() || ( shadow.m_nLastTextureFrame < 0 ) )
+		return false;
+
+	int nMaxInterval = MAX( r_shadow_update_max_interval.GetInt(), 1 );
+	int nFramesSinceUpdate = gpGlobals->framecount - shadow.m_nLastTextureFrame;
+	if ( nFramesSinceUpdate >= nMaxInterval )
+		return false;
+
+	int nBudget = r_shadow_texture_budget.GetInt();
+	if ( ( nBudget > 0 ) && ( m_nStatsTexturesRendered >= nBudget ) )
+		return true;
+
+	float flFullRateArea = r_shadow_update_fullrate_area.GetFloat();
+	if ( flArea >= flFullRateArea )
+		return false;
+
+	int nInterval = ( flArea > 0.0f ) ? (int)ceil( flFullRateArea / flArea ) : nMaxInterval;
+	return nFramesSinceUpdate < MIN( nInterval, nMaxInterval );
+}
+
+
 //-----------------------------------------------------------------------------
 // This gets called with every shadow that potentially will need to re-render
 //-----------------------------------------------------------------------------
@@ -3749,7 +3937,25 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 	// Mark texture as being used...
 	bool bDirtyTexture = (shadow.m_Flags & SHADOW_FLAGS_TEXTURE_DIRTY) != 0;
 	bool bDrewTexture = false;
-	bool bNeedsRedraw = ( !m_bThreaded && m_ShadowAllocator.UseTexture( shadow.m_ShadowTexture, bDirtyTexture, flArea ) );
+
+	// Small or low priority shadows keep their old texture for a few frames, as long as
+	// the allocator lets them keep their fragment. Either way the texture is only
+	// marked as used once per frame.
+	bool bNeedsRedraw;
+	if ( bDirtyTexture && !bPreviouslyUsingLODShadow && !m_bThreaded &&
+		m_ShadowAllocator.HasValidTexture( shadow.m_ShadowTexture ) && ShouldDeferShadowTexture( shadow, flArea ) )
+	{
+		bNeedsRedraw = m_ShadowAllocator.UseTexture( shadow.m_ShadowTexture, false, flArea );
+		if ( !bNeedsRedraw )
+		{
+			++m_nStatsTexturesDeferred;
+			return false;
+		}
+	}
+	else
+	{
+		bNeedsRedraw = ( !m_bThreaded && m_ShadowAllocator.UseTexture( shadow.m_ShadowTexture, bDirtyTexture, flArea ) );
+	}
 
 	if ( !m_ShadowAllocator.HasValidTexture( shadow.m_ShadowTexture ) )
 	{
@@ -3775,6 +3981,9 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 		pRenderContext->MatrixMode( MATERIAL_VIEW );
 		pRenderContext->LoadMatrix( shadowmgr->GetInfo( shadow.m_ShadowHandle ).m_WorldToShadow );
    
+		shadow.m_nLastTextureFrame = gpGlobals->framecount;
+		++m_nStatsTexturesRendered;
+
 		if ( DrawShadowHierarchy( pRenderable, shadow ) )
 		{
 			bDrewTexture = true;
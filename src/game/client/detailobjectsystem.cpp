@@ -339,10 +339,28 @@ class CFastDetailLeafSpriteList : public CClientLeafSubSystemData
 	int m_nNumPendingSprites;
 	int m_nStartSpriteIndex;
 
+	// persistent geometry for cl_detail_static_buffers, built the first time the leaf is drawn
+	IMesh *m_pStaticMesh;
+	bool m_bStaticMeshBuilt;
+	Vector m_vecStaticMins;
+	Vector m_vecStaticMaxs;
+
 	CFastDetailLeafSpriteList( void )
 	{
 		m_nNumPendingSprites = 0;
 		m_nStartSpriteIndex = 0;
+		m_pStaticMesh = NULL;
+		m_bStaticMeshBuilt = false;
+	}
+
+	~CFastDetailLeafSpriteList( void )
+	{
+		if ( m_pStaticMesh )
+		{
+			CMatRenderContextPtr pRenderContext( materials );
+			pRenderContext->DestroyStaticMesh( m_pStaticMesh );
+			m_pStaticMesh = NULL;
+		}
 	}
 
 };
@@ -436,6 +454,8 @@ private:
 							   Vector const &viewUp );
 
 	void RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList );
+	void BuildStaticSpriteMesh( CFastDetailLeafSpriteList *pData );
+	bool DrawStaticSpriteMesh( CFastDetailLeafSpriteList *pData, const Vector &viewOrigin, IMaterial *pMaterial );
 
 	void UnserializeFastSprite( FastSpriteX4_t *pSpritex4, int nSubField, DetailObjectLump_t const &lump, bool bFlipped, Vector const &posOffset );
 
@@ -1669,6 +1689,7 @@ ConVar cl_detail_multiplier( "cl_detail_multiplier", "1", FCVAR_CHEAT, "extra de
 #define SPRITE_MULTIPLIER  ( cl_detail_multiplier.GetInt() )
 
 ConVar cl_fastdetailsprites( "cl_fastdetailsprites", "1", FCVAR_CHEAT, "whether to use new detail sprite system");
+ConVar cl_detail_static_buffers( "cl_detail_static_buffers", "0", 0, "Draw fully faded-in leaves of fast detail sprites from per-leaf static meshes instead of rebuilding them every frame" );
 
 static bool DetailObjectIsFastSprite( DetailObjectLump_t const & lump )
 {
@@ -2279,6 +2300,130 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 }
 
 
+//-----------------------------------------------------------------------------
+// Uploads all fast sprites of a leaf into a static mesh, once. Sprites can't
+// face the camera without rebuilding them, so each one is stored as a pair of
+// crossed quads with a fixed, position-seeded yaw (the same shape that
+// DETAIL_PROP_TYPE_SHAPE_CROSS uses), at full alpha.
+//-----------------------------------------------------------------------------
+#define MAX_STATIC_DETAIL_SPRITES_PER_LEAF ( 65535 / 8 )
+
+void CDetailObjectSystem::BuildStaticSpriteMesh( CFastDetailLeafSpriteList *pData )
+{
+	VPROF_BUDGET( "CDetailObjectSystem::BuildStaticSpriteMesh", VPROF_BUDGETGROUP_DETAILPROP_RENDERING );
+
+	pData->m_bStaticMeshBuilt = true;
+	pData->m_pStaticMesh = NULL;
+
+	int nSprites = pData->m_nNumSprites;
+	if ( ( nSprites == 0 ) || ( nSprites > MAX_STATIC_DETAIL_SPRITES_PER_LEAF ) )
+		return;
+
+	IMaterial *pMaterial = m_DetailSpriteMaterial;
+	if ( !pMaterial )
+		return;
+
+	CMatRenderContextPtr pRenderContext( materials );
+	VertexFormat_t fmt = VERTEX_POSITION | VERTEX_COLOR | VERTEX_TEXCOORD_SIZE( 0, 2 );
+	IMesh *pMesh = pRenderContext->CreateStaticMesh( fmt, TEXTURE_GROUP_STATIC_VERTEX_BUFFER_OTHER, pMaterial );
+	if ( !pMesh )
+		return;
+
+	ClearBounds( pData->m_vecStaticMins, pData->m_vecStaticMaxs );
+
+	CMeshBuilder meshBuilder;
+	meshBuilder.Begin( pMesh, MATERIAL_QUADS, nSprites * 2 );
+
+	for ( int i = 0; i < nSprites; ++i )
+	{
+		FastSpriteX4_t const *pSpritex4 = pData->m_pSprites + ( i >> 2 );
+		int nSubField = i & 3;
+
+		Vector vecPos( pSpritex4->m_Pos.X( nSubField ), pSpritex4->m_Pos.Y( nSubField ), pSpritex4->m_Pos.Z( nSubField ) );
+		float flHalfWidth = SubFloat( pSpritex4->m_HalfWidth, nSubField );
+		float flHeight = SubFloat( pSpritex4->m_Height, nSubField );
+		DetailPropSpriteDict_t *pDict = pSpritex4->m_pSpriteDefs[nSubField];
+
+		uint8 color[4];
+		color[0] = pSpritex4->m_RGBColor[nSubField][0];
+		color[1] = pSpritex4->m_RGBColor[nSubField][1];
+		color[2] = pSpritex4->m_RGBColor[nSubField][2];
+		color[3] = 255;
+
+		float s, c;
+		SinCos( vecPos.x * 0.37f + vecPos.y * 0.71f, &s, &c );
+		Vector vecDy( 0, 0, flHeight );
+
+		for ( int nQuad = 0; nQuad < 2; ++nQuad )
+		{
+			Vector vecDx = ( nQuad == 0 ) ? Vector( c, s, 0 ) : Vector( -s, c, 0 );
+			vecDx *= flHalfWidth;
+
+			Vector vecPos0 = vecPos + vecDx;
+			meshBuilder.Position3fv( vecPos0.Base() );
+			meshBuilder.Color4ubv( color );
+			meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexLR.y );
+			meshBuilder.AdvanceVertex();
+			AddPointToBounds( vecPos0, pData->m_vecStaticMins, pData->m_vecStaticMaxs );
+
+			vecPos0 -= vecDy;
+			meshBuilder.Position3fv( vecPos0.Base() );
+			meshBuilder.Color4ubv( color );
+			meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexUL.y );
+			meshBuilder.AdvanceVertex();
+			AddPointToBounds( vecPos0, pData->m_vecStaticMins, pData->m_vecStaticMaxs );
+
+			vecPos0 -= 2.0f * vecDx;
+			meshBuilder.Position3fv( vecPos0.Base() );
+			meshBuilder.Color4ubv( color );
+			meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexUL.y );
+			meshBuilder.AdvanceVertex();
+			AddPointToBounds( vecPos0, pData->m_vecStaticMins, pData->m_vecStaticMaxs );
+
+			vecPos0 += vecDy;
+			meshBuilder.Position3fv( vecPos0.Base() );
+			meshBuilder.Color4ubv( color );
+			meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexLR.y );
+			meshBuilder.AdvanceVertex();
+			AddPointToBounds( vecPos0, pData->m_vecStaticMins, pData->m_vecStaticMaxs );
+		}
+	}
+
+	meshBuilder.End();
+	pData->m_pStaticMesh = pMesh;
+}
+
+
+//-----------------------------------------------------------------------------
+// Draws a leaf from its static mesh if every sprite in it is fully faded in.
+// Leaves that straddle the fade band return false and take the sorted path.
+//-----------------------------------------------------------------------------
+bool CDetailObjectSystem::DrawStaticSpriteMesh( CFastDetailLeafSpriteList *pData, const Vector &viewOrigin, IMaterial *pMaterial )
+{
+	if ( !pData->m_bStaticMeshBuilt )
+	{
+		BuildStaticSpriteMesh( pData );
+	}
+	if ( !pData->m_pStaticMesh )
+		return false;
+
+	// Farthest point of the leaf's sprite bounds from the view
+	float flMaxSqDist = 0.0f;
+	for ( int i = 0; i < 3; ++i )
+	{
+		float flDist = MAX( fabs( viewOrigin[i] - pData->m_vecStaticMins[i] ), fabs( viewOrigin[i] - pData->m_vecStaticMaxs[i] ) );
+		flMaxSqDist += flDist * flDist;
+	}
+	if ( flMaxSqDist > m_flCurFadeSqDist )
+		return false;
+
+	CMatRenderContextPtr pRenderContext( materials );
+	pRenderContext->Bind( pMaterial );
+	pData->m_pStaticMesh->Draw();
+	return true;
+}
+
+
 void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList )
 {
 	// Here, we must draw all detail objects back-to-front
@@ -2305,6 +2450,31 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 		pMaterial = m_DetailWireframeMaterial;
 	}
 
+	// Leaves that are entirely inside the fade start distance are drawn straight
+	// from their static meshes; only the remaining ones get built out and sorted
+	if ( cl_detail_static_buffers.GetBool() )
+	{
+		LeafIndex_t *pDynamicLeafList = (LeafIndex_t *)stackalloc( nLeafCount * sizeof( LeafIndex_t ) );
+		int nDynamicLeafCount = 0;
+		for ( int i = 0; i < nLeafCount; ++i )
+		{
+			CFastDetailLeafSpriteList *pData = reinterpret_cast<CFastDetailLeafSpriteList *> (
+				ClientLeafSystem()->GetSubSystemDataInLeaf( pLeafList[i], CLSUBSYSTEM_DETAILOBJECTS ) );
+			if ( pData && DrawStaticSpriteMesh( pData, viewOrigin, pMaterial ) )
+				continue;
+			pDynamicLeafList[nDynamicLeafCount++] = pLeafList[i];
+		}
+
+		nLeafCount = nDynamicLeafCount;
+		pLeafList = pDynamicLeafList;
+		nQuadCount = CountFastSpritesInLeafList( nLeafCount, pLeafList, &nMaxInLeaf );
+		if ( nQuadCount == 0 )
+		{
+			pRenderContext->PopMatrix();
+			return;
+		}
+	}
+
 	CMeshBuilder meshBuilder;
 	IMesh *pMesh = pRenderContext->GetDynamicMesh( true, NULL, NULL, pMaterial );
 
@@ -2529,6 +2699,29 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 	if ( m_nSortedFastLeaf != nLeaf )
 	{
 		m_nSortedFastLeaf = nLeaf;
+
+		if ( cl_detail_static_buffers.GetBool() && r_DrawDetailProps.GetInt() )
+		{
+			CMatRenderContextPtr pRenderContext( materials );
+			pRenderContext->MatrixMode( MATERIAL_MODEL );
+			pRenderContext->PushMatrix();
+			pRenderContext->LoadIdentity();
+
+			IMaterial *pMaterial = m_DetailSpriteMaterial;
+			if ( ShouldDrawInWireFrameMode() || r_DrawDetailProps.GetInt() == 2 )
+			{
+				pMaterial = m_DetailWireframeMaterial;
+			}
+			bool bDrawn = DrawStaticSpriteMesh( pData, viewOrigin, pMaterial );
+			pRenderContext->PopMatrix();
+
+			if ( bDrawn )
+			{
+				pData->m_nNumPendingSprites = 0;
+				return;
+			}
+		}
+
 		pData->m_nNumPendingSprites = BuildOutSortedSprites( pData, viewOrigin, viewForward, viewRight, viewUp );
 		pData->m_nStartSpriteIndex = 0;
 	}
@@ -0,0 +1,139 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Measures KeyValues text parse throughput over the game's scripts
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "KeyValues.h"
+#include "filesystem.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+struct KeyValuesBenchmarkFile_t
+{
+	char m_szName[MAX_PATH];
+	CUtlBuffer m_Buffer;
+};
+
+static const char *s_pBenchmarkWildcards[] =
+{
+	"scripts/*.txt",
+	"resource/*.res",
+	"resource/ui/*.res",
+	"materials/*.vmt",
+};
+
+static void AddBenchmarkFiles( const char *pWildcard, CUtlVector< KeyValuesBenchmarkFile_t * > &files )
+{
+	char szDir[MAX_PATH];
+	Q_ExtractFilePath( pWildcard, szDir, sizeof( szDir ) );
+
+	FileFindHandle_t hFind;
+	for ( const char *pFileName = g_pFullFileSystem->FindFirstEx( pWildcard, "GAME", &hFind ); pFileName; pFileName = g_pFullFileSystem->FindNext( hFind ) )
+	{
+		if ( g_pFullFileSystem->FindIsDirectory( hFind ) )
+			continue;
+
+		KeyValuesBenchmarkFile_t *pFile = new KeyValuesBenchmarkFile_t;
+		Q_snprintf( pFile->m_szName, sizeof( pFile->m_szName ), "%s%s", szDir, pFileName );
+		if ( !g_pFullFileSystem->ReadFile( pFile->m_szName, "GAME", pFile->m_Buffer ) )
+		{
+			delete pFile;
+			continue;
+		}
+		pFile->m_Buffer.PutChar( 0 );
+		files.AddToTail( pFile );
+	}
+	g_pFullFileSystem->FindClose( hFind );
+}
+
+static void ParseBenchmarkFile( KeyValuesBenchmarkFile_t *&pFile )
+{
+	KeyValues *pKV = new KeyValues( "benchmark" );
+	pKV->LoadFromBuffer( pFile->m_szName, (const char *)pFile->m_Buffer.Base() );
+	pKV->deleteThis();
+}
+
+static void ParseBenchmarkFileArena( KeyValuesBenchmarkFile_t *&pFile )
+{
+	CKeyValuesArena arena;
+	CKeyValuesArena::CScope scope( arena );
+	KeyValues *pKV = new KeyValues( "benchmark" );
+	pKV->LoadFromBuffer( pFile->m_szName, (const char *)pFile->m_Buffer.Base() );
+}
+
+static void ReportBenchmarkPass( const char *pPassName, CFastTimer &timer, int nBytes, int nIterations )
+{
+	float flMS = timer.GetDuration().GetMillisecondsF();
+	float flMBPerSec = ( flMS > 0.0f ) ? ( (float)nBytes * nIterations / ( 1024.0f * 1024.0f ) ) / ( flMS / 1000.0f ) : 0.0f;
+	Msg( "  %-24s %9.2f ms  %7.2f MB/s\n", pPassName, flMS, flMBPerSec );
+}
+
+//-----------------------------------------------------------------------------
+// kv_parse_benchmark [iterations] [wildcard]
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( kv_parse_benchmark, "Times KeyValues parsing of the game's script files: serial, serial with an arena, and threaded", FCVAR_CHEAT )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 1;
+
+	CUtlVector< KeyValuesBenchmarkFile_t * > files;
+	if ( args.ArgC() > 2 )
+	{
+		AddBenchmarkFiles( args[2], files );
+	}
+	else
+	{
+		for ( int i = 0; i < ARRAYSIZE( s_pBenchmarkWildcards ); ++i )
+		{
+			AddBenchmarkFiles( s_pBenchmarkWildcards[i], files );
+		}
+	}
+
+	int nBytes = 0;
+	for ( int i = 0; i < files.Count(); ++i )
+	{
+		nBytes += files[i]->m_Buffer.TellPut();
+	}
+	Msg( "kv_parse_benchmark: %d files, %d bytes, %d iteration(s)\n", files.Count(), nBytes, nIterations );
+	if ( !files.Count() )
+		return;
+
+	CFastTimer timer;
+
+	timer.Start();
+	for ( int n = 0; n < nIterations; ++n )
+	{
+		for ( int i = 0; i < files.Count(); ++i )
+		{
+			ParseBenchmarkFile( files[i] );
+		}
+	}
+	timer.End();
+	ReportBenchmarkPass( "serial", timer, nBytes, nIterations );
+
+	timer.Start();
+	for ( int n = 0; n < nIterations; ++n )
+	{
+		for ( int i = 0; i < files.Count(); ++i )
+		{
+			ParseBenchmarkFileArena( files[i] );
+		}
+	}
+	timer.End();
+	ReportBenchmarkPass( "serial, arena", timer, nBytes, nIterations );
+
+	timer.Start();
+	for ( int n = 0; n < nIterations; ++n )
+	{
+		ParallelProcess( "kv_parse_benchmark", files.Base(), files.Count(), &ParseBenchmarkFileArena );
+	}
+	timer.End();
+	ReportBenchmarkPass( "threaded, arena", timer, nBytes, nIterations );
+
+	files.PurgeAndDeleteElements();
+}
@@ -651,6 +651,23 @@ void CParticleEffectBinding::GrowBBoxFromParticlePositions( CEffectMaterial *pMa
 }
 
 
+bool CParticleEffectBinding::ShouldFullBBoxUpdate()
+{
+	// slow the expensive update operation for particle systems that use auto-update-bbox
+	// auto update the bbox after N frames then randomly 1/N or after 2*N frames 
+	++m_UpdateBBoxCounter;
+	if ( ( m_UpdateBBoxCounter >= BBOX_UPDATE_EVERY_N && random->RandomInt( 0, BBOX_UPDATE_EVERY_N ) == 0 ) ||
+		 ( m_UpdateBBoxCounter >= 2*BBOX_UPDATE_EVERY_N ) )
+	{
+		// reset watchdog
+		m_UpdateBBoxCounter = 0;
+		return true;
+	}
+
+	return false;
+}
+
+
 //-----------------------------------------------------------------------------
 // Simulate particles
 //-----------------------------------------------------------------------------
@@ -659,6 +676,17 @@ void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
 	if ( !m_pSim->ShouldSimulate() )
 		return;
 
+	bool bFullBBoxUpdate = !GetFlag( FLAGS_NEW_PARTICLE_SYSTEM ) && ShouldFullBBoxUpdate();
+	SimulateParticles( flTimeDelta, bFullBBoxUpdate );
+}
+
+//-----------------------------------------------------------------------------
+// Simulate particles with the bbox decision already made. This touches nothing
+// outside of the binding and its particles, so it may run on a job thread.
+//-----------------------------------------------------------------------------
+void CParticleEffectBinding::SimulateParticles( float flTimeDelta, bool bFullBBoxUpdate )
+{
+
 	if ( GetFlag( FLAGS_NEW_PARTICLE_SYSTEM ) )
 	{
 		CParticleSimulateIterator simulateIterator;
@@ -672,19 +700,6 @@ void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
 		Vector bbMin(0,0,0), bbMax(0,0,0);
 		bool bboxSet = false;
 
-		// slow the expensive update operation for particle systems that use auto-update-bbox
-		// auto update the bbox after N frames then randomly 1/N or after 2*N frames 
-		bool bFullBBoxUpdate = false;
-		++m_UpdateBBoxCounter;
-		if ( ( m_UpdateBBoxCounter >= BBOX_UPDATE_EVERY_N && random->RandomInt( 0, BBOX_UPDATE_EVERY_N ) == 0 ) ||
-			 ( m_UpdateBBoxCounter >= 2*BBOX_UPDATE_EVERY_N ) )
-		{
-			bFullBBoxUpdate = true;
-
-			// reset watchdog
-			m_UpdateBBoxCounter = 0;
-		}
-
 		if ( bFullBBoxUpdate )
 		{
 			BBoxCalcStart( bbMin, bbMax );
@@ -873,55 +888,63 @@ void CParticleEffectBinding::RenderEnd( VMatrix &tempModel, VMatrix &tempView )
 
 void CParticleEffectBinding::DoBucketSort( CEffectMaterial *pMaterial, float *zCoords, int nZCoords, float minZ, float maxZ )
 {
-	// Do an O(N) bucket sort. This helps the sort when there are lots of particles.
+	// Do an O(N) counting sort into NUM_BUCKETS depth buckets. The first nZCoords particles
+	// in the list are the ones that were rendered; they get relinked in ascending sort key order
+	// (stable within a bucket) and any particles past that stay where they are.
 	#define NUM_BUCKETS	32
-	Particle buckets[NUM_BUCKETS];
-	for( int iBucket=0; iBucket < NUM_BUCKETS; iBucket++ )
-	{
-		buckets[iBucket].m_pPrev = buckets[iBucket].m_pNext = &buckets[iBucket];
-	}
-	
-	// Sort into buckets.
-	int iCurParticle = 0;
-	Particle *pNext, *pCur;
-	for( pCur=pMaterial->m_Particles.m_pNext; pCur != &pMaterial->m_Particles; pCur=pNext )
-	{
-		pNext = pCur->m_pNext;
-		if( iCurParticle >= nZCoords )
-			break;
+	Assert( nZCoords <= MAX_TOTAL_PARTICLES );
 
-		// Remove it..
-		UnlinkParticle( pCur );
+	unsigned char iParticleBucket[MAX_TOTAL_PARTICLES];
+	Particle *pSorted[MAX_TOTAL_PARTICLES];
+	int nBucketStart[NUM_BUCKETS];
+	memset( nBucketStart, 0, sizeof( nBucketStart ) );
 
-		// Add it to the appropriate bucket.
-		float flPercent;
-		if (maxZ == minZ)
-			flPercent = 0;
-		else
-			flPercent = (zCoords[iCurParticle] - minZ) / (maxZ - minZ);
+	float flInvRange = ( maxZ == minZ ) ? 0.0f : ( NUM_BUCKETS - 0.0001f ) / ( maxZ - minZ );
+
+	// Count the particles going into each bucket.
+	int nParticles = 0;
+	Particle *pCur;
+	for( pCur=pMaterial->m_Particles.m_pNext; pCur != &pMaterial->m_Particles && nParticles < nZCoords; pCur=pCur->m_pNext )
+	{
+		int iBucket = (int)( ( zCoords[nParticles] - minZ ) * flInvRange );
+		Assert( iBucket >= 0 && iBucket < NUM_BUCKETS );
+		iBucket = clamp( iBucket, 0, NUM_BUCKETS - 1 );
 
-		int iAddBucket = (int)( flPercent * (NUM_BUCKETS - 0.0001f) );
-		iAddBucket = NUM_BUCKETS - iAddBucket - 1;
-		Assert( iAddBucket >= 0 && iAddBucket < NUM_BUCKETS );
+		iParticleBucket[nParticles] = (unsigned char)iBucket;
+		++nBucketStart[iBucket];
+		++nParticles;
+	}
 
-		InsertParticleAfter( pCur, &buckets[iAddBucket] );
+	if ( nParticles == 0 )
+		return;
 
-		++iCurParticle;
+	// Turn the counts into start offsets.
+	int nOffset = 0;
+	for( int iBucket=0; iBucket < NUM_BUCKETS; iBucket++ )
+	{
+		int nCount = nBucketStart[iBucket];
+		nBucketStart[iBucket] = nOffset;
+		nOffset += nCount;
 	}
 
-	// Put the buckets back into the main list.
-	for( int iReAddBucket=0; iReAddBucket < NUM_BUCKETS; iReAddBucket++ )
+	// Scatter the particles into their sorted slots.
+	Particle *pRemainder = pMaterial->m_Particles.m_pNext;
+	for( int i=0; i < nParticles; i++ )
 	{
-		Particle *pListHead = &buckets[iReAddBucket];
-		for( pCur=pListHead->m_pNext; pCur != pListHead; pCur=pNext )
-		{
-			pNext = pCur->m_pNext;
-			InsertParticleAfter( pCur, &pMaterial->m_Particles );
-			--iCurParticle;
-		}
+		pSorted[ nBucketStart[ iParticleBucket[i] ]++ ] = pRemainder;
+		pRemainder = pRemainder->m_pNext;
 	}
 
-	Assert(iCurParticle==0);
+	// Relink the sorted run in front of whatever particles weren't sorted.
+	Particle *pPrev = &pMaterial->m_Particles;
+	for( int i=0; i < nParticles; i++ )
+	{
+		pPrev->m_pNext = pSorted[i];
+		pSorted[i]->m_pPrev = pPrev;
+		pPrev = pSorted[i];
+	}
+	pPrev->m_pNext = pRemainder;
+	pRemainder->m_pPrev = pPrev;
 }
 
 
@@ -1038,7 +1061,8 @@ CEffectMaterial* CParticleEffectBinding::GetEffectMaterial( CParticleSubTexture
 //-----------------------------------------------------------------------------
 // CParticleMgr
 //-----------------------------------------------------------------------------
-CParticleMgr::CParticleMgr()
+CParticleMgr::CParticleMgr() :
+	m_ParticlePool( PARTICLE_SIZE, MAX_TOTAL_PARTICLES, CUtlMemoryPool::GROW_NONE, "CParticleMgr particles", 16 )
 {
 	m_nToolParticleEffectId = 0;
 	m_bUpdatingEffects = false;
@@ -1172,11 +1196,10 @@ void CParticleMgr::LevelInit()
 
 Particle *CParticleMgr::AllocParticle( int size )
 {
-	// Enforce max particle limit.
-	if ( m_nCurrentParticlesAllocated >= MAX_TOTAL_PARTICLES )
-		return NULL;
-		
-	Particle *pRet = (Particle *)malloc( size );
+	// The pool holds exactly MAX_TOTAL_PARTICLES blocks and doesn't grow,
+	// so it enforces the max particle limit for us.
+	Assert( size <= PARTICLE_SIZE );
+	Particle *pRet = (Particle *)m_ParticlePool.Alloc( size );
 	if ( pRet )
 		++m_nCurrentParticlesAllocated;
 
@@ -1186,10 +1209,11 @@ Particle *CParticleMgr::AllocParticle( int size )
 void CParticleMgr::FreeParticle( Particle *pParticle )
 {
 	Assert( m_nCurrentParticlesAllocated > 0 );
-	if ( pParticle )
-		--m_nCurrentParticlesAllocated;
-	
-	free( pParticle );
+	if ( !pParticle )
+		return;
+
+	--m_nCurrentParticlesAllocated;
+	m_ParticlePool.Free( pParticle );
 }
 
 
@@ -1935,6 +1959,22 @@ void CParticleMgr::UpdateNewEffects( float flTimeDelta )
 	}
 }
 
+static ConVar r_threaded_legacy_particles( "r_threaded_legacy_particles", "1", 0, "Simulate thread-safe legacy particle effects in parallel jobs." );
+
+struct LegacyParticleSimListEntry_t
+{
+	CParticleEffectBinding *m_pEffect;
+	bool m_bFullBBoxUpdate;
+};
+
+static float s_flThreadedLegacyTimeStep;
+
+static void ProcessLegacyEffect( LegacyParticleSimListEntry_t &entry )
+{
+	FPExceptionEnabler enableExceptions;
+	entry.m_pEffect->SimulateParticles( s_flThreadedLegacyTimeStep, entry.m_bFullBBoxUpdate );
+}
+
 void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 {
 	// These reflect the convars so we don't parse the strings every particle.
@@ -1947,6 +1987,11 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 	if( flTimeDelta > 0.1f )
 		flTimeDelta = 0.1f;
 
+	// Effects whose simulation is self-contained are deferred and simulated in parallel
+	// once every effect has had its (non-reentrant) Update.
+	bool bThreaded = r_threaded_legacy_particles.GetBool();
+	CUtlVector<LegacyParticleSimListEntry_t> effectsToSimulate;
+
 	FOR_EACH_LL( m_Effects, iEffect )
 	{
 		CParticleEffectBinding *pEffect = m_Effects[iEffect];
@@ -1975,14 +2020,47 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 		pEffect->m_pSim->Update( flTimeDelta );
 
 		if ( pEffect->GetFirstFrameFlag() )
+		{
 			pEffect->SetFirstFrameFlag( false );
+		}
+		else if ( bThreaded && pEffect->m_pSim->IsSimulationThreadSafe() &&
+			pEffect->m_pSim->ShouldSimulate() && !pEffect->GetFlag( CParticleEffectBinding::FLAGS_NEW_PARTICLE_SYSTEM ) )
+		{
+			LegacyParticleSimListEntry_t entry = { pEffect, pEffect->ShouldFullBBoxUpdate() };
+			effectsToSimulate.AddToTail( entry );
+			continue;
+		}
 		else
+		{
 			pEffect->SimulateParticles( flTimeDelta );
+		}
 
 		// Update its position in the leaf system if its bbox changed.
 		pEffect->DetectChanges();
 	}
 
+	int nCount = effectsToSimulate.Count();
+	if ( nCount )
+	{
+		VPROF_BUDGET( "CParticleMgr::UpdateAllEffects (threaded)", "Particle Simulation" );
+
+		s_flThreadedLegacyTimeStep = flTimeDelta;
+		if ( nCount == 1 )
+		{
+			ProcessLegacyEffect( effectsToSimulate[0] );
+		}
+		else
+		{
+			ParallelProcess( "CParticleMgr::UpdateAllEffects", effectsToSimulate.Base(), nCount, ProcessLegacyEffect );
+		}
+
+		// The leaf system isn't thread-safe, so bbox changes are pushed back on the main thread.
+		for( int i=0; i<nCount; i++ )
+		{
+			effectsToSimulate[i].m_pEffect->DetectChanges();
+		}
+	}
+
 	if ( g_bMeasureParticlePerformance )					// use fixed time step
 	{
 		for( float dt=0.0f; dt <= flTimeDelta ; dt+= 0.01f )
@@ -126,6 +126,7 @@ entities. Each one is useful under different conditions.
 #endif
 #include "tier1/utlintrusivelist.h"
 #include "tier1/utlstring.h"
+#include "tier1/mempool.h"
 
 
 //-----------------------------------------------------------------------------
@@ -303,6 +304,11 @@ public:
 	virtual const Vector *GetParticlePosition( Particle *pParticle ) { return &pParticle->m_Pos; }
 
 	virtual const char *GetEffectName() { return "???"; } 
+
+	// Return true if SimulateParticles only touches this effect's own state and particles
+	// (no entity, bone, trace or material lookups). Such effects are simulated in parallel
+	// jobs by CParticleMgr::UpdateAllEffects; everything else stays on the main thread.
+	virtual bool	IsSimulationThreadSafe() const { return false; }
 };
 
 #define REGISTER_EFFECT( effect )														\
@@ -353,6 +359,7 @@ public:
 
 	// Simulate all the particles.
 	void			SimulateParticles( float flTimeDelta );
+	void			SimulateParticles( float flTimeDelta, bool bFullBBoxUpdate );
 
 	// Use this to specify materials when adding particles. 
 	// Returns the index of the material it found or added.
@@ -486,6 +493,10 @@ private:
 
 	void			GrowBBoxFromParticlePositions( CEffectMaterial *pMaterial, bool &bboxSet, Vector &bbMin, Vector &bbMax );
 
+	// Advances the bbox watchdog and decides whether this simulation should do a full bbox update.
+	// Must be called from the main thread (it uses the shared random stream).
+	bool			ShouldFullBBoxUpdate();
+
 	void			RenderStart( VMatrix &mTempModel, VMatrix &mTempView );
 	void			RenderEnd( VMatrix &mModel, VMatrix &mView );
 
@@ -729,7 +740,11 @@ private:
 
 private:
 
-	int m_nCurrentParticlesAllocated;
+	CInterlockedInt m_nCurrentParticlesAllocated;
+
+	// All legacy particles come out of this one contiguous, fixed-size block so
+	// simulation and sorting walk a compact range of memory instead of the heap.
+	CMemoryPoolMT m_ParticlePool;
 
 	// Directional lighting info.
 	CParticleLightInfo m_DirectionalLight;
@@ -0,0 +1,164 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Measures symbol table insert and lookup throughput
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "utlsymbol.h"
+#include "tier1/utlsymbollarge.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// CUtlSymbolTable hands out 16-bit ids, so keep the name set inside its range
+#define SYMBOL_BENCHMARK_MAX_NAMES	60000
+
+//-----------------------------------------------------------------------------
+// The lookup scheme CUtlSymbolTable used before it was hash ordered: an RB
+// tree ordered by full string compares
+//-----------------------------------------------------------------------------
+static bool StringOrderedLessFunc( const char * const &lhs, const char * const &rhs )
+{
+	return V_stricmp( lhs, rhs ) < 0;
+}
+
+typedef CUtlRBTree< const char *, unsigned short > StringOrderedTree_t;
+
+static CUtlSymbolTableLargeMT_CI *s_pBenchmarkTableMT;
+
+static void AddBenchmarkSymbolMT( const char *&pName )
+{
+	s_pBenchmarkTableMT->AddString( pName );
+}
+
+static void FindBenchmarkSymbolMT( const char *&pName )
+{
+	s_pBenchmarkTableMT->Find( pName );
+}
+
+static void ReportBenchmarkPass( const char *pPassName, CFastTimer &timer, int nOperations )
+{
+	float flMS = timer.GetDuration().GetMillisecondsF();
+	float flNSPerOp = ( nOperations > 0 ) ? ( flMS * 1000000.0f ) / nOperations : 0.0f;
+	Msg( "  %-32s %9.2f ms  %7.1f ns/op\n", pPassName, flMS, flNSPerOp );
+}
+
+//-----------------------------------------------------------------------------
+// symboltable_benchmark [count] [iterations]
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( symboltable_benchmark, "Times symbol table adds and finds: string-ordered tree, CUtlSymbolTable, CUtlSymbolTableLarge and threaded CUtlSymbolTableLargeMT", FCVAR_CHEAT )
+{
+	int nCount = ( args.ArgC() > 1 ) ? clamp( atoi( args[1] ), 1, SYMBOL_BENCHMARK_MAX_NAMES ) : 20000;
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 10;
+
+	// Paths share long prefixes, like the model and sound names the game actually interns
+	CUtlVector< char * > names;
+	names.EnsureCapacity( nCount );
+	for ( int i = 0; i < nCount; ++i )
+	{
+		char szName[MAX_PATH];
+		Q_snprintf( szName, sizeof( szName ), "models/props_%02d/Prop_Benchmark_%05d.mdl", i % 37, i );
+		names.AddToTail( V_strdup( szName ) );
+	}
+	const char **ppNames = (const char **)names.Base();
+
+	Msg( "symboltable_benchmark: %d names, %d find iteration(s)\n", nCount, nIterations );
+
+	CFastTimer timer;
+	int nFinds = nCount * nIterations;
+
+	{
+		StringOrderedTree_t tree( 0, nCount, StringOrderedLessFunc );
+		timer.Start();
+		for ( int i = 0; i < nCount; ++i )
+		{
+			tree.Insert( ppNames[i] );
+		}
+		timer.End();
+		ReportBenchmarkPass( "string tree add", timer, nCount );
+
+		timer.Start();
+		for ( int n = 0; n < nIterations; ++n )
+		{
+			for ( int i = 0; i < nCount; ++i )
+			{
+				tree.Find( ppNames[i] );
+			}
+		}
+		timer.End();
+		ReportBenchmarkPass( "string tree find", timer, nFinds );
+	}
+
+	{
+		CUtlSymbolTable table( 0, nCount, true );
+		timer.Start();
+		for ( int i = 0; i < nCount; ++i )
+		{
+			table.AddString( ppNames[i] );
+		}
+		timer.End();
+		ReportBenchmarkPass( "CUtlSymbolTable add", timer, nCount );
+
+		timer.Start();
+		for ( int n = 0; n < nIterations; ++n )
+		{
+			for ( int i = 0; i < nCount; ++i )
+			{
+				table.Find( ppNames[i] );
+			}
+		}
+		timer.End();
+		ReportBenchmarkPass( "CUtlSymbolTable find", timer, nFinds );
+	}
+
+	{
+		CUtlSymbolTableLarge_CI table;
+		timer.Start();
+		for ( int i = 0; i < nCount; ++i )
+		{
+			table.AddString( ppNames[i] );
+		}
+		timer.End();
+		ReportBenchmarkPass( "CUtlSymbolTableLarge add", timer, nCount );
+
+		timer.Start();
+		for ( int n = 0; n < nIterations; ++n )
+		{
+			for ( int i = 0; i < nCount; ++i )
+			{
+				table.Find( ppNames[i] );
+			}
+		}
+		timer.End();
+		ReportBenchmarkPass( "CUtlSymbolTableLarge find", timer, nFinds );
+	}
+
+	{
+		CUtlSymbolTableLargeMT_CI table;
+		s_pBenchmarkTableMT = &table;
+
+		timer.Start();
+		ParallelProcess( "symboltable_benchmark", ppNames, nCount, &AddBenchmarkSymbolMT );
+		timer.End();
+		ReportBenchmarkPass( "CUtlSymbolTableLargeMT add, threaded", timer, nCount );
+
+		timer.Start();
+		for ( int n = 0; n < nIterations; ++n )
+		{
+			ParallelProcess( "symboltable_benchmark", ppNames, nCount, &FindBenchmarkSymbolMT );
+		}
+		timer.End();
+		ReportBenchmarkPass( "CUtlSymbolTableLargeMT find, threaded", timer, nFinds );
+
+		s_pBenchmarkTableMT = NULL;
+	}
+
+	for ( int i = 0; i < names.Count(); ++i )
+	{
+		delete [] names[i];
+	}
+}
@@ -96,6 +96,11 @@ int AI_CriteriaSet::GetCount() const
 // Output : int
 //-----------------------------------------------------------------------------
 int AI_CriteriaSet::FindCriterionIndex( const char *name ) const
+{
+	return FindCriterionIndex( CUtlSymbol( name ) );
+}
+
+int AI_CriteriaSet::FindCriterionIndex( CUtlSymbol name ) const
 {
 	CritEntry_t search;
 	search.criterianame = name;
@@ -32,6 +32,7 @@ public:
 
 	int GetCount() const;
 	int			FindCriterionIndex( const char *name ) const;
+	int			FindCriterionIndex( CUtlSymbol name ) const;	// avoids interning the name on every lookup
 
 	const char *GetName( int index ) const;
 	const char *GetValue( int index ) const;
@@ -29,6 +29,7 @@
 ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose matching output (1 for simple, 2 for rule scoring). If set to 3, it will only show response success/failure for npc_selected NPCs." );
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system.");
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
+ConVar rr_indexrules( "rr_indexrules", "1", FCVAR_NONE, "Only score the rules that can match the query's concept instead of every rule." );
 
 static CUtlSymbolTable g_RS;
 
@@ -59,6 +60,7 @@ public:
 		maxequals = false;
 		maxval = 0.0f;
 		minval = 0.0f;
+		tokenval = 0.0f;
 
 		token = UTL_INVAL_SYMBOL;
 		rawtoken = UTL_INVAL_SYMBOL;
@@ -110,6 +112,7 @@ public:
 
 	float	maxval;
 	float	minval;
+	float	tokenval;	// token parsed as a number, for numeric compares
 
 	bool	valid : 1;      //1
 	bool	isnumeric : 1;  //2
@@ -122,6 +125,7 @@ public:
 	void	SetToken( char const *s )
 	{
 		token = g_RS.AddString( s );
+		tokenval = (float)atof( s );
 	}
 
 	char const *GetToken()
@@ -403,6 +407,7 @@ struct Criteria
 			return *this;
 
 		name = CopyString( src.name );
+		namesymbol = src.namesymbol;
 		value = CopyString( src.value );
 		weight = src.weight;
 		required = src.required;
@@ -420,6 +425,7 @@ struct Criteria
 	Criteria(const Criteria& src )
 	{
 		name = CopyString( src.name );
+		namesymbol = src.namesymbol;
 		value = CopyString( src.value );
 		weight = src.weight;
 		required = src.required;
@@ -443,7 +449,15 @@ struct Criteria
 		return ( subcriteria.Count() > 0 ) ? true : false;
 	}
 
+	void SetName( const char *pszName )
+	{
+		delete[] name;
+		name = CopyString( pszName );
+		namesymbol = pszName;
+	}
+
 	char						*name;
+	CUtlSymbol					namesymbol;	// name interned for AI_CriteriaSet lookups
 	char						*value;
 	float16						weight;
 	bool						required;
@@ -683,6 +697,8 @@ public:
 	float		LookupEnumeration( const char *name, bool& found );
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
+	void		BuildRuleIndex();
+	const char	*GetRequiredConcept( Rule *rule );
 
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
@@ -710,6 +726,13 @@ public:
 	CUtlDict< Rule, short >	m_Rules;
 	CUtlDict< Enumeration, short > m_Enumerations;
 
+	// Rules bucketed by the value of their required "concept" criterion, rules without
+	// one are always scored. Both lists are in ascending rule order. Rebuilt whenever
+	// the rule count changes.
+	CUtlDict< CUtlVector< int > *, int >	m_RulesByConcept;
+	CUtlVector< int >	m_UnindexedRules;
+	int			m_nIndexedRuleCount;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
@@ -762,6 +785,7 @@ CResponseSystem::CResponseSystem()
 	m_bUnget = false;
 	m_bPrecache = true;
 	m_bCustomManagable = false;
+	m_nIndexedRuleCount = -1;
 }
 
 //-----------------------------------------------------------------------------
@@ -769,6 +793,7 @@ CResponseSystem::CResponseSystem()
 //-----------------------------------------------------------------------------
 CResponseSystem::~CResponseSystem()
 {
+	m_RulesByConcept.PurgeAndDeleteElements();
 }
 
 //-----------------------------------------------------------------------------
@@ -817,6 +842,10 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+
+	m_RulesByConcept.PurgeAndDeleteElements();
+	m_UnindexedRules.Purge();
+	m_nIndexedRuleCount = -1;
 }
 
 //-----------------------------------------------------------------------------
@@ -1047,7 +1076,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	{
 		if ( m.isnumeric )
 		{
-			if ( v == (float)atof( m.GetToken() ) )
+			if ( v == m.tokenval )
 				return false;
 		}
 		else
@@ -1066,7 +1095,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 		if ( !setValue || !setValue[0] )
 			return false;
 
-		return v == (float)atof( m.GetToken() );
+		return v == m.tokenval;
 	}
 
 	return !Q_stricmp( setValue, m.GetToken() ) ? true : false;
@@ -1133,7 +1162,7 @@ float CResponseSystem::LookForCriteria( const AI_CriteriaSet &criteriaSet, int i
 		return RecursiveLookForCriteria( criteriaSet, pCriteria );
 	}
 
-	int iIndex = criteriaSet.FindCriterionIndex( pCriteria->name );
+	int iIndex = criteriaSet.FindCriterionIndex( pCriteria->namesymbol );
 	if ( iIndex == -1 )
 		return 0.0f;
 
@@ -1164,7 +1193,7 @@ float CResponseSystem::ScoreCriteriaAgainstRuleCriteria( const AI_CriteriaSet& s
 
 	const char *actualValue = "";
 
-	int found = set.FindCriterionIndex( c->name );
+	int found = set.FindCriterionIndex( c->namesymbol );
 	if ( found != -1 )
 	{
 		actualValue = set.GetValue( found );
@@ -1687,10 +1716,44 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 	CUtlVector< int >	bestrules;
 	float bestscore = 0.001f;
 
-	int c = m_Rules.Count();
+	// Candidate rules, in rule order so ties come out the same as a full scan.
+	// Verbose and rr_debugrule output describe every rule, so they keep the full scan.
+	CUtlVector< int >	candidates;
+	bool bUseIndex = rr_indexrules.GetBool() && !verbose && !rr_debugrule.GetString()[0];
+	if ( bUseIndex )
+	{
+		if ( m_nIndexedRuleCount != m_Rules.Count() )
+		{
+			BuildRuleIndex();
+		}
+
+		static CUtlSymbol s_ConceptSymbol( "concept" );
+		int iConcept = set.FindCriterionIndex( s_ConceptSymbol );
+		int iBucket = m_RulesByConcept.Find( ( iConcept != -1 ) ? set.GetValue( iConcept ) : "" );
+
+		const CUtlVector< int > *pBucket = ( iBucket != m_RulesByConcept.InvalidIndex() ) ? m_RulesByConcept[ iBucket ] : NULL;
+		int nBucket = pBucket ? pBucket->Count() : 0;
+		candidates.EnsureCapacity( nBucket + m_UnindexedRules.Count() );
+
+		int b = 0, u = 0;
+		while ( b < nBucket || u < m_UnindexedRules.Count() )
+		{
+			if ( u >= m_UnindexedRules.Count() || ( b < nBucket && pBucket->Element( b ) < m_UnindexedRules[ u ] ) )
+			{
+				candidates.AddToTail( pBucket->Element( b++ ) );
+			}
+			else
+			{
+				candidates.AddToTail( m_UnindexedRules[ u++ ] );
+			}
+		}
+	}
+
+	int c = bUseIndex ? candidates.Count() : m_Rules.Count();
 	int i;
-	for ( i = 0; i < c; i++ )
+	for ( int n = 0; n < c; n++ )
 	{
+		i = bUseIndex ? candidates[ n ] : n;
 		float score = ScoreCriteriaAgainstRule( set, i, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
@@ -1723,6 +1786,61 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 	return bestrules[ idx ];
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the concept a rule can only match, or NULL. A required, plain
+//			string "concept" criterion excludes the rule for any other concept,
+//			so the rule never needs scoring against other concepts.
+//-----------------------------------------------------------------------------
+const char *CResponseSystem::GetRequiredConcept( Rule *rule )
+{
+	for ( int i = 0; i < rule->m_Criteria.Count(); i++ )
+	{
+		Criteria *c = &m_Criteria[ rule->m_Criteria[ i ] ];
+		if ( c->IsSubCriteriaType() || !c->required || !c->name || Q_stricmp( c->name, "concept" ) )
+			continue;
+
+		Matcher &m = c->matcher;
+		if ( !m.valid || m.isnumeric || m.notequal || m.usemin || m.usemax )
+			continue;
+
+		return m.GetToken();
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Buckets the rules by required concept for FindBestMatchingRule
+//-----------------------------------------------------------------------------
+void CResponseSystem::BuildRuleIndex()
+{
+	m_RulesByConcept.PurgeAndDeleteElements();
+	m_UnindexedRules.RemoveAll();
+
+	int c = m_Rules.Count();
+	for ( int i = 0; i < c; i++ )
+	{
+		const char *pszConcept = GetRequiredConcept( &m_Rules[ i ] );
+		if ( !pszConcept )
+		{
+			m_UnindexedRules.AddToTail( i );
+			continue;
+		}
+
+		int iBucket = m_RulesByConcept.Find( pszConcept );
+		if ( iBucket == m_RulesByConcept.InvalidIndex() )
+		{
+			iBucket = m_RulesByConcept.Insert( pszConcept, new CUtlVector< int > );
+		}
+		m_RulesByConcept[ iBucket ]->AddToTail( i );
+	}
+
+	m_nIndexedRuleCount = c;
+
+	DevMsg( 2, "CResponseSystem:  indexed %i rules under %i concepts, %i rules always scored\n",
+		c - m_UnindexedRules.Count(), m_RulesByConcept.Count(), m_UnindexedRules.Count() );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : set - 
@@ -2393,7 +2511,7 @@ int CResponseSystem::ParseOneCriterion( const char *criterionName )
 			ParseToken();
 			Q_strncpy( value, token, sizeof( value ) );
 
-			newCriterion.name = CopyString( key );
+			newCriterion.SetName( key );
 			newCriterion.value = CopyString( value );
 
 			gotbody = true;
@@ -2667,7 +2785,7 @@ void CResponseSystem::CopyCriteriaFrom( Rule *pSrcRule, Rule *pDstRule, CRespons
 			// Add the criteria.
 			Criteria dstCriteria;
 
-			dstCriteria.name = CopyString( pSrcCriteria->name );
+			dstCriteria.SetName( pSrcCriteria->name );
 			dstCriteria.value = CopyString( pSrcCriteria->value );
 			dstCriteria.weight = pSrcCriteria->weight;
 			dstCriteria.required = pSrcCriteria->required;
@@ -2687,7 +2805,7 @@ void CResponseSystem::CopyCriteriaFrom( Rule *pSrcRule, Rule *pDstRule, CRespons
 					// Add the criteria.
 					Criteria dstSubCriteria;
 
-					dstSubCriteria.name = CopyString( pSrcSubCriteria->name );
+					dstSubCriteria.SetName( pSrcSubCriteria->name );
 					dstSubCriteria.value = CopyString( pSrcSubCriteria->value );
 					dstSubCriteria.weight = pSrcSubCriteria->weight;
 					dstSubCriteria.required = pSrcSubCriteria->required;
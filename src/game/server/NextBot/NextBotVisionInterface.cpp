@@ -698,10 +698,14 @@ bool IVision::IsLineOfSightClear( const Vector &pos ) const
 	VPROF_BUDGET( "IVision::IsLineOfSightClear", "NextBot" );
 	VPROF_INCREMENT_COUNTER( "IVision::IsLineOfSightClear", 1 );
 
+	const Vector &eye = GetBot()->GetBodyInterface()->GetEyePosition();
+	if ( CBaseCombatCharacter::IsLineOfSightOccluded( eye, pos, MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE ) )
+		return false;
+
 	trace_t result;
 	NextBotVisionTraceFilter filter( GetBot()->GetEntity(), COLLISION_GROUP_NONE );
 	
-	UTIL_TraceLine( GetBot()->GetBodyInterface()->GetEyePosition(), pos, MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE, &filter, &result );
+	UTIL_TraceLine( eye, pos, MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE, &filter, &result );
 	
 	return ( result.fraction >= 1.0f && !result.startsolid );
 }
@@ -749,26 +753,32 @@ bool IVision::IsLineOfSightClearToEntity( const CBaseEntity *subject, Vector *vi
 	// TODO: Use plain-old traces until querycache/etc gets integrated
 	VPROF_BUDGET( "IVision::IsLineOfSightClearToEntity", "NextBot" );
 
-	trace_t result;
 	NextBotTraceFilterIgnoreActors filter( subject, COLLISION_GROUP_NONE );
 
-	UTIL_TraceLine( GetBot()->GetBodyInterface()->GetEyePosition(), subject->WorldSpaceCenter(), MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE, &filter, &result );
-	if ( result.DidHit() )
+	const Vector &eye = GetBot()->GetBodyInterface()->GetEyePosition();
+	const Vector spots[] = { subject->WorldSpaceCenter(), subject->EyePosition(), subject->GetAbsOrigin() };
+
+	// try each spot in turn, skipping the trace for any the world is already known to hide
+	bool isClear = false;
+	Vector endPos = eye;
+	for( int i=0; i<ARRAYSIZE( spots ) && !isClear; ++i )
 	{
-		UTIL_TraceLine( GetBot()->GetBodyInterface()->GetEyePosition(), subject->EyePosition(), MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE, &filter, &result );
+		if ( CBaseCombatCharacter::IsLineOfSightOccluded( eye, spots[i], MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE, &endPos ) )
+			continue;
 
-		if ( result.DidHit() )
-		{
-			UTIL_TraceLine( GetBot()->GetBodyInterface()->GetEyePosition(), subject->GetAbsOrigin(), MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE, &filter, &result );
-		}
+		trace_t result;
+		UTIL_TraceLine( eye, spots[i], MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE, &filter, &result );
+
+		endPos = result.endpos;
+		isClear = !result.DidHit();
 	}
 
 	if ( visibleSpot )
 	{
-		*visibleSpot = result.endpos;
+		*visibleSpot = endPos;
 	}
 
-	return ( result.fraction >= 1.0f && !result.startsolid );
+	return isClear;
 
 #endif
 }
@@ -9,12 +9,80 @@
 #include "ServerNetworkProperty.h"
 #include "tier0/dbg.h"
 #include "gameinterface.h"
+#include "tier1/utlhashtable.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 extern CTimedEventMgr g_NetworkPropertyEventMgr;
 
+bool g_bNetworkStateChangeStats = false;
+
+//-----------------------------------------------------------------------------
+// Per server class counts of state change marks. A full mark makes the engine
+// delta every send prop of the entity; a partial one only the props at the
+// recorded change offsets.
+//-----------------------------------------------------------------------------
+struct NetworkStateChangeStats_t
+{
+	int m_nFull;
+	int m_nPartial;
+};
+
+typedef CUtlHashtable< ServerClass *, NetworkStateChangeStats_t > NetworkStateChangeStatsTable_t;
+static NetworkStateChangeStatsTable_t s_NetworkStateChangeStats;
+
+static void NetworkStateChangeStatsChanged( IConVar *pConVar, const char *pOldValue, float flOldValue )
+{
+	ConVarRef var( pConVar );
+	g_bNetworkStateChangeStats = var.GetBool();
+	s_NetworkStateChangeStats.Purge();
+}
+
+ConVar sv_networkstate_change_stats( "sv_networkstate_change_stats", "0", 0, "Count full versus partial network state change marks per server class. See sv_networkstate_change_stats_dump.", NetworkStateChangeStatsChanged );
+
+static int NetworkStateChangeStatsSortFunc( const UtlHashHandle_t *pLeft, const UtlHashHandle_t *pRight )
+{
+	const NetworkStateChangeStats_t &left = s_NetworkStateChangeStats.Element( *pLeft );
+	const NetworkStateChangeStats_t &right = s_NetworkStateChangeStats.Element( *pRight );
+	return ( right.m_nFull + right.m_nPartial ) - ( left.m_nFull + left.m_nPartial );
+}
+
+CON_COMMAND( sv_networkstate_change_stats_dump, "Prints the per server class full/partial network state change marks counted since sv_networkstate_change_stats was enabled" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( !g_bNetworkStateChangeStats )
+	{
+		Msg( "sv_networkstate_change_stats is off\n" );
+		return;
+	}
+
+	CUtlVector< UtlHashHandle_t > handles;
+	handles.EnsureCapacity( s_NetworkStateChangeStats.Count() );
+	FOR_EACH_HASHTABLE( s_NetworkStateChangeStats, h )
+	{
+		handles.AddToTail( h );
+	}
+	handles.Sort( NetworkStateChangeStatsSortFunc );
+
+	int nTotalFull = 0, nTotalPartial = 0;
+	Msg( "%-40s %10s %10s %8s\n", "class", "full", "partial", "partial%" );
+	for ( int i = 0; i < handles.Count(); ++i )
+	{
+		const NetworkStateChangeStats_t &stats = s_NetworkStateChangeStats.Element( handles[i] );
+		int nTotal = stats.m_nFull + stats.m_nPartial;
+		Msg( "%-40s %10d %10d %7.1f%%\n", s_NetworkStateChangeStats.Key( handles[i] )->GetName(), stats.m_nFull, stats.m_nPartial, 
+			nTotal ? 100.0f * stats.m_nPartial / nTotal : 0.0f );
+		nTotalFull += stats.m_nFull;
+		nTotalPartial += stats.m_nPartial;
+	}
+
+	int nTotal = nTotalFull + nTotalPartial;
+	Msg( "%-40s %10d %10d %7.1f%%\n", "total", nTotalFull, nTotalPartial, nTotal ? 100.0f * nTotalPartial / nTotal : 0.0f );
+}
+
 
 //-----------------------------------------------------------------------------
 // Save/load
@@ -293,6 +361,35 @@ void CServerNetworkProperty::SetUpdateInterval( float val )
 }
 
 
+//-----------------------------------------------------------------------------
+// A mark is partial if the edict still carries a change offset list after it;
+// offset-less marks and offset lists that overflowed count as full
+//-----------------------------------------------------------------------------
+void CServerNetworkProperty::RecordNetworkStateChange()
+{
+	ServerClass *pServerClass = GetServerClass();
+	if ( !pServerClass )
+		return;
+
+	UtlHashHandle_t h = s_NetworkStateChangeStats.Find( pServerClass );
+	if ( h == s_NetworkStateChangeStats.InvalidHandle() )
+	{
+		NetworkStateChangeStats_t stats = { 0, 0 };
+		h = s_NetworkStateChangeStats.Insert( pServerClass, stats );
+	}
+
+	NetworkStateChangeStats_t &stats = s_NetworkStateChangeStats.Element( h );
+	if ( m_pPev->m_fStateFlags & FL_FULL_EDICT_CHANGED )
+	{
+		++stats.m_nFull;
+	}
+	else
+	{
+		++stats.m_nPartial;
+	}
+}
+
+
 void CServerNetworkProperty::FireEvent()
 {
 	// Our timer went off. If our state has changed in the background, then 
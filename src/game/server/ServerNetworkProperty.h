@@ -109,6 +109,9 @@ private:
 	// Marks the networkable that it will should transmit
 	void SetTransmit( CCheckTransmitInfo *pInfo );
 
+	// Counts a state change mark against our server class (sv_networkstate_change_stats)
+	void RecordNetworkStateChange();
+
 private:
 	CBaseEntity *m_pOuter;
 	// CBaseTransmitProxy *m_pTransmitProxy;
@@ -128,6 +131,10 @@ private:
 };
 
 
+// Set while sv_networkstate_change_stats is on
+extern bool g_bNetworkStateChangeStats;
+
+
 //-----------------------------------------------------------------------------
 // inline methods // TODOMO does inline work on virtual functions ?
 //-----------------------------------------------------------------------------
@@ -194,7 +201,11 @@ inline void CServerNetworkProperty::NetworkStateChanged()
 	else
 	{
 		if ( m_pPev )
+		{
 			m_pPev->StateChanged();
+			if ( g_bNetworkStateChangeStats )
+				RecordNetworkStateChange();
+		}
 	}
 }
 
@@ -210,7 +221,11 @@ inline void CServerNetworkProperty::NetworkStateChanged( unsigned short varOffse
 	else
 	{
 		if ( m_pPev )
+		{
 			m_pPev->StateChanged( varOffset );
+			if ( g_bNetworkStateChangeStats )
+				RecordNetworkStateChange();
+		}
 	}
 }
 
@@ -257,6 +257,7 @@ int CAI_Manager::NumAIs()
 void CAI_Manager::AddAI( CAI_BaseNPC *pAI )
 {
 	m_AIs.AddToTail( pAI );
+	g_AI_SensingGrid.Invalidate();
 }
 
 //-------------------------------------
@@ -266,7 +267,10 @@ void CAI_Manager::RemoveAI( CAI_BaseNPC *pAI )
 	int i = m_AIs.Find( pAI );
 
 	if ( i != -1 )
+	{
 		m_AIs.FastRemove( i );
+		g_AI_SensingGrid.Invalidate();
+	}
 }
 
 
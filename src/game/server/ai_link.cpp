@@ -13,6 +13,7 @@
 
 #include "cbase.h"
 #include "ai_link.h"
+#include "ai_network.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -36,6 +37,8 @@ int	CAI_Link::DestNodeID(int srcID)
 	}
 }
 
+DEFINE_FIXEDSIZE_ALLOCATOR( CAI_Link, 4 * MAX_NODES, CUtlMemoryPool::GROW_SLOW );
+
 //-----------------------------------------------------------------------------
 // Purpose: Constructor
 // Input  :
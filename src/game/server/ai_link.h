@@ -16,6 +16,7 @@
 #pragma once
 
 #include "ai_hull.h"	// For num hulls
+#include "mempool.h"
 
 struct edict_t;
 
@@ -60,6 +61,8 @@ public:
 private:
 	friend class CAI_Network;
 	CAI_Link(void);
+
+	DECLARE_FIXEDSIZE_ALLOCATOR( CAI_Link );
 };
 
 #endif // AI_LINK_H
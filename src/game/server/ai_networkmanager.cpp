@@ -25,12 +25,47 @@
 #include "ndebugoverlay.h"
 #include "ai_hint.h"
 #include "tier0/icommandline.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 // Increment this to force rebuilding of all networks
-#define	 AINET_VERSION_NUMBER	37
+#define	 AINET_VERSION_NUMBER	38
+
+//-----------------------------------------------------------------------------
+// .ain file layout.  A header, then flat arrays of fixed size records: nodes,
+// the WC id table, then links.  Every array starts 4-byte aligned, so a file
+// that has been read (or mapped) in one gulp is used in place.
+//-----------------------------------------------------------------------------
+
+struct AINetFileHeader_t
+{
+	int				version;
+	int				mapversion;
+	int				numNodes;
+	int				numLinks;
+};
+
+struct AINetFileNode_t
+{
+	float			origin[3];
+	float			yaw;
+	float			vOffset[NUM_HULLS];
+	unsigned short	nodeInfo;
+	short			zone;
+	byte			nodeType;
+	byte			pad[3];
+};
+
+struct AINetFileLink_t
+{
+	short			srcID;
+	short			destID;
+	byte			acceptedMoveTypes[NUM_HULLS];
+};
+
+COMPILE_TIME_ASSERT( sizeof( AINetFileNode_t ) % sizeof( int ) == 0 );
 
 //-----------------------------------------------------------------------------
 
@@ -254,39 +289,11 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 	Q_strncat( szNrpFilename, STRING( gpGlobals->mapname ), sizeof( szNrpFilename ), COPY_ALL_CHARACTERS );
 	Q_strncat( szNrpFilename, IsX360() ? ".360.ain" : ".ain", sizeof( szNrpFilename ), COPY_ALL_CHARACTERS  );
 
-	CUtlBuffer buf;
-
-	// ---------------------------
-	// Save the version number
-	// ---------------------------
-	buf.PutInt(AINET_VERSION_NUMBER);
-	buf.PutInt(gpGlobals->mapversion);
-
-	// -------------------------------
-	// Dump all the nodes to the file
-	// -------------------------------
-	buf.PutInt( m_pNetwork->m_iNumNodes);
-
 	int node;
 	int totalNumLinks = 0;
 	for ( node = 0; node < m_pNetwork->m_iNumNodes; node++)
 	{
 		CAI_Node *pNode = m_pNetwork->GetNode(node);
-		Assert( pNode->GetZone() != AI_NODE_ZONE_UNKNOWN );
-
-		buf.PutFloat( pNode->GetOrigin().x );
-		buf.PutFloat( pNode->GetOrigin().y );
-		buf.PutFloat( pNode->GetOrigin().z );
-		buf.PutFloat( pNode->GetYaw() );
-		buf.Put( pNode->m_flVOffset, sizeof( pNode->m_flVOffset ) );
-		buf.PutChar( pNode->GetType() );
-		if ( IsX360() )
-		{
-			buf.SeekPut( CUtlBuffer::SEEK_CURRENT, 3 );
-		}
-		buf.PutUnsignedShort( pNode->m_eNodeInfo );
-		buf.PutShort( pNode->GetZone() );
-
 		for (int link = 0; link < pNode->NumLinks(); link++)
 		{
 			// Only dump if link source
@@ -297,26 +304,38 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 		}
 	}
 
+	CUtlBuffer buf;
+	buf.EnsureCapacity( sizeof( AINetFileHeader_t ) + m_pNetwork->m_iNumNodes * ( sizeof( AINetFileNode_t ) + sizeof( int ) ) + totalNumLinks * sizeof( AINetFileLink_t ) );
+
+	// ---------------------------
+	// Save the version number
+	// ---------------------------
+	AINetFileHeader_t header;
+	header.version = AINET_VERSION_NUMBER;
+	header.mapversion = gpGlobals->mapversion;
+	header.numNodes = m_pNetwork->m_iNumNodes;
+	header.numLinks = totalNumLinks;
+	buf.Put( &header, sizeof( header ) );
+
 	// -------------------------------
-	// Dump all the links to the file
+	// Dump all the nodes to the file
 	// -------------------------------
-	buf.PutInt( totalNumLinks );
-
-	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
+	for ( node = 0; node < m_pNetwork->m_iNumNodes; node++)
 	{
 		CAI_Node *pNode = m_pNetwork->GetNode(node);
+		Assert( pNode->GetZone() != AI_NODE_ZONE_UNKNOWN );
 
-		for (int link = 0; link < pNode->NumLinks(); link++)
-		{
-			// Only dump if link source
-			CAI_Link *pLink = pNode->GetLinkByIndex(link);
-			if (node == pLink->m_iSrcID)
-			{
-				buf.PutShort( pLink->m_iSrcID );
-				buf.PutShort( pLink->m_iDestID );
-				buf.Put( pLink->m_iAcceptedMoveTypes, sizeof( pLink->m_iAcceptedMoveTypes) );
-			}
-		}
+		AINetFileNode_t fileNode;
+		memset( &fileNode, 0, sizeof( fileNode ) );
+		fileNode.origin[0] = pNode->GetOrigin().x;
+		fileNode.origin[1] = pNode->GetOrigin().y;
+		fileNode.origin[2] = pNode->GetOrigin().z;
+		fileNode.yaw = pNode->GetYaw();
+		V_memcpy( fileNode.vOffset, pNode->m_flVOffset, sizeof( fileNode.vOffset ) );
+		fileNode.nodeInfo = pNode->m_eNodeInfo;
+		fileNode.zone = pNode->GetZone();
+		fileNode.nodeType = pNode->GetType();
+		buf.Put( &fileNode, sizeof( fileNode ) );
 	}
 
 	// -------------------------------
@@ -344,6 +363,28 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 		buf.PutInt( GetEditOps()->m_pNodeIndexTable[node] );
 	}
 
+	// -------------------------------
+	// Dump all the links to the file
+	// -------------------------------
+	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
+	{
+		CAI_Node *pNode = m_pNetwork->GetNode(node);
+
+		for (int link = 0; link < pNode->NumLinks(); link++)
+		{
+			// Only dump if link source
+			CAI_Link *pLink = pNode->GetLinkByIndex(link);
+			if (node == pLink->m_iSrcID)
+			{
+				AINetFileLink_t fileLink;
+				fileLink.srcID = pLink->m_iSrcID;
+				fileLink.destID = pLink->m_iDestID;
+				V_memcpy( fileLink.acceptedMoveTypes, pLink->m_iAcceptedMoveTypes, sizeof( fileLink.acceptedMoveTypes ) );
+				buf.Put( &fileLink, sizeof( fileLink ) );
+			}
+		}
+	}
+
 	// -------------------------------
 	// Write the file out
 	// -------------------------------
@@ -539,27 +580,22 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	// ---------------------------
 	// Check the version number
 	// ---------------------------
-	if ( buf.GetChar() == 'V' && buf.GetChar() == 'e' && buf.GetChar() == 'r' )
+	if ( buf.TellPut() < (int)sizeof( AINetFileHeader_t ) )
 	{
 		DevMsg( "AI node graph %s is out of date\n", szNrpFilename );
 		return;
 	}
-	
-	DevMsg( "Passed first ver check\n" );
-
 
-	buf.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+	const AINetFileHeader_t *pHeader = (const AINetFileHeader_t *)buf.Base();
+	DevMsg( "Got version %d\n", pHeader->version );
 
-	int version = buf.GetInt();
-	DevMsg( "Got version %d\n", version );
-
-	if ( version != AINET_VERSION_NUMBER)
+	if ( pHeader->version != AINET_VERSION_NUMBER)
 	{
 		DevMsg( "AI node graph %s is out of date\n", szNrpFilename );
 		return;
 	}
 
-	int mapversion = buf.GetInt();
+	int mapversion = pHeader->mapversion;
 	DevMsg( "Map version %d\n", mapversion );
 
 	if ( mapversion != gpGlobals->mapversion && !g_ai_norebuildgraph.GetBool() )
@@ -591,16 +627,22 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	// ----------------------------------------
 	// Get the network size and allocate space
 	// ----------------------------------------
-	int numNodes = buf.GetInt();
+	int numNodes = pHeader->numNodes;
+	int totalNumLinks = pHeader->numLinks;
 
-	if ( numNodes > MAX_NODES || numNodes < 0 )
+	if ( numNodes > MAX_NODES || numNodes < 0 || totalNumLinks < 0 ||
+		 buf.TellPut() < (int)( sizeof( AINetFileHeader_t ) + numNodes * ( sizeof( AINetFileNode_t ) + sizeof( int ) ) + totalNumLinks * sizeof( AINetFileLink_t ) ) )
 	{
 		Error( "AI node graph %s is corrupt\n", szNrpFilename );
-		DevMsg( "%s", (const char *)buf.Base() );
-		DevMsg( "\n" );
 		Assert( 0 );
 		return;
 	}
+
+	// The records are used straight out of the file buffer
+	const AINetFileNode_t *pFileNodes = (const AINetFileNode_t *)( pHeader + 1 );
+	const int *pFileWCIds = (const int *)( pFileNodes + numNodes );
+	const AINetFileLink_t *pFileLinks = (const AINetFileLink_t *)( pFileWCIds + numNodes );
+	int nFileNodes = numNodes;
 	
 	DevMsg( "Finishing load\n" );
 
@@ -620,45 +662,44 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	// Load all the nodes to the file
 	// -------------------------------
 	int node;
-	for ( node = 0; node < numNodes; node++)
+	for ( node = 0; node < nFileNodes; node++)
 	{
-		Vector origin;
-		float yaw;
-		origin.x = buf.GetFloat();
-		origin.y = buf.GetFloat();
-		origin.z = buf.GetFloat();
-		yaw = buf.GetFloat();
+		const AINetFileNode_t &fileNode = pFileNodes[node];
 
-		CAI_Node *new_node = m_pNetwork->AddNode( origin, yaw );
+		CAI_Node *new_node = m_pNetwork->AddNode( Vector( fileNode.origin[0], fileNode.origin[1], fileNode.origin[2] ), fileNode.yaw );
 
-		buf.Get( new_node->m_flVOffset, sizeof(new_node->m_flVOffset) );
-		new_node->m_eNodeType = (NodeType_e)buf.GetChar();
-		if ( IsX360() )
-		{
-			buf.SeekGet( CUtlBuffer::SEEK_CURRENT, 3 );
-		}
-
-		new_node->m_eNodeInfo = buf.GetUnsignedShort();
-		new_node->m_zone = buf.GetShort();
+		V_memcpy( new_node->m_flVOffset, fileNode.vOffset, sizeof(new_node->m_flVOffset) );
+		new_node->m_eNodeType = (NodeType_e)fileNode.nodeType;
+		new_node->m_eNodeInfo = fileNode.nodeInfo;
+		new_node->m_zone = fileNode.zone;
 	}
 
 	// -------------------------------
 	// Load all the links to the fild
 	// -------------------------------
-	int totalNumLinks = buf.GetInt();
 
+	// Size each node's link list once, rather than growing it a link at a time
+	int linkCounts[MAX_NODES];
+	memset( linkCounts, 0, sizeof( linkCounts ) );
 	for (int link = 0; link < totalNumLinks; link++)
 	{
-		int srcID, destID;
-
-		srcID = buf.GetShort();
-		destID = buf.GetShort();
-
-		CAI_Link *pLink = m_pNetwork->CreateLink( srcID, destID );
+		if ( pFileLinks[link].srcID >= 0 && pFileLinks[link].srcID < nFileNodes )
+			linkCounts[pFileLinks[link].srcID]++;
+		if ( pFileLinks[link].destID >= 0 && pFileLinks[link].destID < nFileNodes )
+			linkCounts[pFileLinks[link].destID]++;
+	}
+	for ( node = 0; node < nFileNodes; node++)
+	{
+		m_pNetwork->GetNode(node)->m_Links.EnsureCapacity( MIN( linkCounts[node], AI_MAX_NODE_LINKS ) );
+	}
 
-		byte ignored[NUM_HULLS];
-		byte *pDest = ( pLink ) ? &pLink->m_iAcceptedMoveTypes[0] : &ignored[0];
-		buf.Get( pDest, sizeof(ignored) );
+	for (int link = 0; link < totalNumLinks; link++)
+	{
+		CAI_Link *pLink = m_pNetwork->CreateLink( pFileLinks[link].srcID, pFileLinks[link].destID );
+		if ( pLink )
+		{
+			V_memcpy( pLink->m_iAcceptedMoveTypes, pFileLinks[link].acceptedMoveTypes, sizeof( pLink->m_iAcceptedMoveTypes ) );
+		}
 	}
 
 	// -------------------------------
@@ -667,12 +708,7 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	delete [] GetEditOps()->m_pNodeIndexTable;
 	GetEditOps()->m_pNodeIndexTable	= new int[MAX( m_pNetwork->m_iNumNodes, 1 )];
 	memset( GetEditOps()->m_pNodeIndexTable, 0, sizeof( int ) *MAX( m_pNetwork->m_iNumNodes, 1 ) );
-
-	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
-	{
-		GetEditOps()->m_pNodeIndexTable[node] = buf.GetInt();
-	}
-
+	V_memcpy( GetEditOps()->m_pNodeIndexTable, pFileWCIds, sizeof( int ) * MIN( m_pNetwork->m_iNumNodes, nFileNodes ) );
 	
 #if 1
 	CUtlRBTree<int> usedIds;
@@ -2210,6 +2246,7 @@ void CAI_NetworkBuilder::Rebuild( CAI_Network *pNetwork )
 void CAI_NetworkBuilder::BeginBuild()
 {
 	m_pTestHull = CAI_TestHull::GetTestHull();
+	m_pBuildNetwork = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -2218,6 +2255,10 @@ void CAI_NetworkBuilder::EndBuild()
 {
 	m_NeighborsTable.SetSize(0);
 	m_DidSetNeighborsTable.Resize(0);
+	m_VisibilityTable.SetSize(0);
+	m_HullFitTested.Resize(0);
+	m_HullFits.Resize(0);
+	m_pBuildNetwork = NULL;
 	CAI_TestHull::ReturnTestHull();
 }
 
@@ -2263,6 +2304,16 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	timer.End();
 	DevMsg( "...done initializing node positions. %f seconds\n", timer.GetDuration().GetSeconds() );
 
+	// ---------------------------
+	// Trace node visibility
+	// ---------------------------
+	DevMsg( "Computing node visibility...\n" );
+	timer.Start();
+	RemoveDuplicateNodes( pNetwork );
+	ComputeVisibilityTable( pNetwork );
+	timer.End();
+	DevMsg( "...done computing node visibility. %f seconds\n", timer.GetDuration().GetSeconds() );
+
 	// ---------------------------
 	// Initialize node neighbors
 	// ---------------------------
@@ -2297,6 +2348,10 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	// ---------------------------
 	DevMsg( "Determining links...\n" );
 	timer.Start();
+	m_HullFitTested.Resize( nNodes * NUM_HULLS );
+	m_HullFitTested.ClearAll();
+	m_HullFits.Resize( nNodes * NUM_HULLS );
+	m_HullFits.ClearAll();
 	for (i = 0; i < nNodes; i++)
 	{	
 		// Make sure all the links are clear
@@ -2643,17 +2698,17 @@ void CAI_NetworkBuilder::InitVisibility(CAI_Network *pNetwork, CAI_Node *pNode)
 			continue;
 		}
 		
-		// Remove duplicate nodes unless a climb node as they move
-		if (testNode->GetOrigin() == pNode->GetOrigin() && testNode->GetType() != NODE_CLIMB)
+		// If a deleted node we don't care about it
+		if (testNode->GetType() == NODE_DELETED)
 		{
-			testNode->SetType( NODE_DELETED );
-			DevMsg( 2, "Probable duplicate node placed at %s\n", VecToString(testNode->GetOrigin()) );
 			continue;
 		}
 
-		// If a deleted node we don't care about it
-		if (testNode->GetType() == NODE_DELETED)
+		// Remove duplicate nodes unless a climb node as they move
+		if (testNode->GetOrigin() == pNode->GetOrigin() && testNode->GetType() != NODE_CLIMB)
 		{
+			testNode->SetType( NODE_DELETED );
+			DevMsg( 2, "Probable duplicate node placed at %s\n", VecToString(testNode->GetOrigin()) );
 			continue;
 		}
 
@@ -2678,61 +2733,20 @@ void CAI_NetworkBuilder::InitVisibility(CAI_Network *pNetwork, CAI_Node *pNode)
 				continue;
 		}
 
-		// The actual position of some nodes may be inside geometry as they have
-		// hull specific position offsets (e.g. climb nodes).  Get the hull specific 
-		// position using the smallest hull to make sure were not in geometry
-		Vector destPos = pNetwork->GetNode( testnode )->GetPosition(HULL_SMALL_CENTERED);
-
-		trace_t	tr;
-		tr.m_pEnt = NULL;
-
-		// Try several line of sight checks
-
-		bool isVisible = false;
-
-		// ------------------
-		//  Bottom to bottom
-		// ------------------
-		AI_TraceLine ( srcPos, destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-		if (!tr.startsolid && tr.fraction == 1.0)
-		{
-			isVisible = true;
-		}
-
-		// ------------------
-		//  Top to top
-		// ------------------
-		if (!isVisible)
+		bool isVisible;
+		if ( m_VisibilityTable.Count() && testnode > pNode->m_iID )
 		{
-			AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-			if (!tr.startsolid && tr.fraction == 1.0)
-			{	
-				isVisible = true;
-			}
+			// Already traced on the worker threads
+			isVisible = m_VisibilityTable[pNode->m_iID].IsBitSet( testnode );
 		}
-
-		// ------------------
-		//  Top to Bottom
-		// ------------------
-		if (!isVisible)
+		else
 		{
-			AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-			if (!tr.startsolid && tr.fraction == 1.0)
-			{	
-				isVisible = true;
-			}
-		}
+			// The actual position of some nodes may be inside geometry as they have
+			// hull specific position offsets (e.g. climb nodes).  Get the hull specific 
+			// position using the smallest hull to make sure were not in geometry
+			Vector destPos = pNetwork->GetNode( testnode )->GetPosition(HULL_SMALL_CENTERED);
 
-		// ------------------
-		//  Bottom to Top
-		// ------------------
-		if (!isVisible)
-		{
-			AI_TraceLine ( srcPos,destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-			if (!tr.startsolid && tr.fraction == 1.0)
-			{	
-				isVisible = true;
-			}
+			isVisible = IsNodeVisible( srcPos, destPos );
 		}
 
 		// ------------------
@@ -2793,6 +2807,132 @@ void CAI_NetworkBuilder::InitVisibility(CAI_Network *pNetwork, CAI_Node *pNode)
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Line of sight test between two node positions.  Tries several
+//			heights, since a node may be visible over a low obstruction
+//-----------------------------------------------------------------------------
+bool CAI_NetworkBuilder::IsNodeVisible( const Vector &srcPos, const Vector &destPos )
+{
+	trace_t	tr;
+	tr.m_pEnt = NULL;
+
+	// ------------------
+	//  Bottom to bottom
+	// ------------------
+	AI_TraceLine ( srcPos, destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+	{
+		return true;
+	}
+
+	// ------------------
+	//  Top to top
+	// ------------------
+	AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+	{	
+		return true;
+	}
+
+	// ------------------
+	//  Top to Bottom
+	// ------------------
+	AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+	{	
+		return true;
+	}
+
+	// ------------------
+	//  Bottom to Top
+	// ------------------
+	AI_TraceLine ( srcPos,destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+	{	
+		return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Delete nodes placed on top of another node, in the same order
+//			InitVisibility would find them
+//-----------------------------------------------------------------------------
+void CAI_NetworkBuilder::RemoveDuplicateNodes( CAI_Network *pNetwork )
+{
+	for ( int node = 0; node < pNetwork->NumNodes(); node++ )
+	{
+		CAI_Node *pNode = pNetwork->GetNode( node );
+		if ( pNode->GetType() == NODE_DELETED )
+			continue;
+
+		for ( int testnode = 0; testnode < pNetwork->NumNodes(); testnode++ )
+		{
+			CAI_Node *pTestNode = pNetwork->GetNode( testnode );
+			if ( testnode == node || pTestNode->GetType() == NODE_DELETED )
+				continue;
+
+			// Remove duplicate nodes unless a climb node as they move
+			if ( pTestNode->GetOrigin() == pNode->GetOrigin() && pTestNode->GetType() != NODE_CLIMB )
+			{
+				pTestNode->SetType( NODE_DELETED );
+				DevMsg( 2, "Probable duplicate node placed at %s\n", VecToString( pTestNode->GetOrigin() ) );
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Trace the line of sight from one node to every higher numbered node
+//			in range.  Runs on a worker thread; only writes the node's own row.
+//-----------------------------------------------------------------------------
+void CAI_NetworkBuilder::ComputeNodeVisibility( CAI_Node *&pNode )
+{
+	CAI_Network *pNetwork = g_AINetworkBuilder.m_pBuildNetwork;
+	CVarBitVec &visible = g_AINetworkBuilder.m_VisibilityTable[pNode->m_iID];
+
+	if ( pNode->GetType() == NODE_DELETED )
+		return;
+
+	Vector srcPos = pNode->GetPosition(HULL_SMALL_CENTERED);
+
+	for ( int testnode = pNode->m_iID + 1; testnode < pNetwork->NumNodes(); testnode++ )
+	{
+		CAI_Node *pTestNode = pNetwork->GetNode( testnode );
+		if ( pTestNode->GetType() == NODE_DELETED )
+			continue;
+
+		float flDistToCheckNode = ( pTestNode->GetOrigin() - pNode->GetOrigin() ).LengthSqr(); 
+		if ( flDistToCheckNode > ( ( pTestNode->GetType() == NODE_AIR ) ? MAX_AIR_NODE_LINK_DIST_SQ : MAX_NODE_LINK_DIST_SQ ) )
+			continue;
+
+		if ( IsNodeVisible( srcPos, pTestNode->GetPosition(HULL_SMALL_CENTERED) ) )
+		{
+			visible.Set( testnode );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Do the O(n^2) visibility traces of a full build across all cores,
+//			ahead of the serial neighbor pass that consumes them
+//-----------------------------------------------------------------------------
+void CAI_NetworkBuilder::ComputeVisibilityTable( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+
+	m_pBuildNetwork = pNetwork;
+	m_VisibilityTable.SetSize( nNodes );
+	for ( int i = 0; i < nNodes; i++ )
+	{
+		m_VisibilityTable[i].Resize( nNodes );
+		m_VisibilityTable[i].ClearAll();
+	}
+
+	ParallelProcess( "CAI_NetworkBuilder::ComputeVisibilityTable", pNetwork->AccessNodes(), nNodes, &ComputeNodeVisibility );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Initializes the neighbors list
 // Input  :
@@ -2956,6 +3096,31 @@ static bool IsInLineForClimb( const Vector &srcPos, const Vector &srcFacing, con
 	return true;
 }
 
+//-------------------------------------
+// Every node is tested against each of its neighbors for every hull, so
+// remember whether the test hull fits rather than re-tracing it per link.
+// Expects the test hull to already be set to the given hull.
+
+bool CAI_NetworkBuilder::CanHullFitAtNode( int nodeId, Hull_t hull )
+{
+	int index = nodeId * NUM_HULLS + hull;
+	if ( index >= m_HullFitTested.GetNumBits() )
+	{
+		return m_pTestHull->GetNavigator()->CanFitAtNode( nodeId, MASK_NPCWORLDSTATIC );
+	}
+
+	if ( !m_HullFitTested.IsBitSet( index ) )
+	{
+		m_HullFitTested.Set( index );
+		if ( m_pTestHull->GetNavigator()->CanFitAtNode( nodeId, MASK_NPCWORLDSTATIC ) )
+		{
+			m_HullFits.Set( index );
+		}
+	}
+
+	return m_HullFits.IsBitSet( index );
+}
+
 //-------------------------------------
 
 int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull )
@@ -2981,16 +3146,15 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 	// ==============================================================
 	// FIRST CHECK IF HULL CAN EVEN FIT AT THESE NODES
 	// ==============================================================
-	// @Note (toml 02-10-03): this should be optimized, caching the results of CanFitAtNode() 
 	if ( !( pSrcNode->m_eNodeInfo & ( HullToBit( hull ) << NODE_ENT_FLAGS_SHIFT ) ) &&
-		 !m_pTestHull->GetNavigator()->CanFitAtNode(srcId,MASK_NPCWORLDSTATIC) )
+		 !CanHullFitAtNode( srcId, hull ) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", srcId );
 		return 0;
 	}
 	
 	if (  !( pDestNode->m_eNodeInfo & ( HullToBit( hull ) << NODE_ENT_FLAGS_SHIFT ) ) &&
-		 !m_pTestHull->GetNavigator()->CanFitAtNode(destId,MASK_NPCWORLDSTATIC) )
+		 !CanHullFitAtNode( destId, hull ) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", destId );
 		return 0;
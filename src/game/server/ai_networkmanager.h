@@ -104,6 +104,10 @@ public:
 
 private:
 	void			InitVisibility( CAI_Network *pNetwork, CAI_Node *pNode );
+	void			RemoveDuplicateNodes( CAI_Network *pNetwork );
+	void			ComputeVisibilityTable( CAI_Network *pNetwork );
+	static void		ComputeNodeVisibility( CAI_Node *&pNode );
+	static bool		IsNodeVisible( const Vector &srcPos, const Vector &destPos );
 	void			InitNeighbors( CAI_Network *pNetwork, CAI_Node *pNode );
 	void			InitClimbNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
 	void			InitGroundNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
@@ -113,6 +117,7 @@ private:
 	void			FloodFillZone( CAI_Node **ppNodes, CAI_Node *pNode, int zone );
 
 	int				ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull );
+	bool			CanHullFitAtNode( int nodeId, Hull_t hull );
 	
 	void 			BeginBuild();
 	void			EndBuild();
@@ -120,6 +125,12 @@ private:
 	CUtlVector<CVarBitVec>	m_NeighborsTable;
 	CVarBitVec				m_DidSetNeighborsTable;
 	CAI_TestHull *			m_pTestHull;
+
+	// Only filled in during a full build
+	CAI_Network *			m_pBuildNetwork;
+	CUtlVector<CVarBitVec>	m_VisibilityTable;				// line of sight from each node to every higher numbered node
+	CVarBitVec				m_HullFitTested;				// indexed by node * NUM_HULLS + hull
+	CVarBitVec				m_HullFits;
 };
 
 extern CAI_NetworkBuilder g_AINetworkBuilder;
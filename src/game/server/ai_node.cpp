@@ -244,6 +244,10 @@ Vector CAI_Node::GetPosition(int hull)
 	}
 }
 
+// Nodes are created a whole graph at a time, so pool them rather than going
+// to the heap for each one
+DEFINE_FIXEDSIZE_ALLOCATOR( CAI_Node, MAX_NODES, CUtlMemoryPool::GROW_SLOW );
+
 //-----------------------------------------------------------------------------
 // Purpose: Constructor
 // Input  :
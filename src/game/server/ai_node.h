@@ -18,6 +18,7 @@
 #include "ai_hull.h"
 #include "bitstring.h"
 #include "utlvector.h"
+#include "mempool.h"
 
 enum AI_ZoneIds_t
 {
@@ -159,6 +160,8 @@ public:
 	float			m_flNextUseTime;		// When can I be used again?
 	CAI_Hint*		m_pHint;				// hint attached to this node
 	int				m_iFirstShuffledLink;				// first link to check
+
+	DECLARE_FIXEDSIZE_ALLOCATOR( CAI_Node );
 };
 
 
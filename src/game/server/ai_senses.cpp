@@ -12,6 +12,7 @@
 #include "soundent.h"
 #include "team.h"
 #include "ai_basenpc.h"
+#include "ai_squad.h"
 #include "saverestore_utlvector.h"
 
 #ifdef PORTAL
@@ -38,6 +39,13 @@ const float AI_MISC_SEARCH_TIME  = 0.45;
 //-----------------------------------------------------------------------------
 
 CAI_SensedObjectsManager g_AI_SensedObjectsManager;
+CAI_SensingGrid g_AI_SensingGrid;
+
+ConVar ai_sensing_grid( "ai_sensing_grid", "1", 0, "Gather sight candidates from a spatial hash instead of testing every NPC and object" );
+ConVar ai_sensing_grid_cell_size( "ai_sensing_grid_cell_size", "512", 0, "Cell size of the AI sensing spatial hash", true, 64, true, 4096 );
+
+// Entities may have moved since the grid was built this tick
+#define AI_SENSING_GRID_SLACK	64.0f
 
 //-----------------------------------------------------------------------------
 
@@ -387,6 +395,42 @@ bool CAI_Senses::LookThroughPortal( const CProp_Portal *pPortal, CBaseEntity *pS
 }
 #endif
 
+//-----------------------------------------------------------------------------
+// Collects the NPCs or sensed objects that may lie within iDistance. Squad
+// members share one grid sweep per tick; everyone still range tests.
+//-----------------------------------------------------------------------------
+
+void CAI_Senses::GetSensingCandidates( int types, int iDistance, CUtlVector<CBaseEntity *> *pResult )
+{
+	if ( !ai_sensing_grid.GetBool() )
+	{
+		if ( types & AI_SENSING_GRID_NPCS )
+		{
+			CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+			for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+			{
+				pResult->AddToTail( ppAIs[i] );
+			}
+		}
+
+		if ( types & AI_SENSING_GRID_OBJECTS )
+		{
+			int iter;
+			for ( CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetFirst( &iter ); pEnt; pEnt = g_AI_SensedObjectsManager.GetNext( &iter ) )
+			{
+				pResult->AddToTail( pEnt );
+			}
+		}
+		return;
+	}
+
+	CAI_Squad *pSquad = GetOuter()->GetSquad();
+	if ( pSquad && pSquad->GetSensingCandidates( GetAbsOrigin(), types, iDistance, pResult ) )
+		return;
+
+	g_AI_SensingGrid.QueryRadius( GetAbsOrigin(), iDistance, types, pResult );
+}
+
 //-----------------------------------------------------------------------------
 
 int CAI_Senses::LookForHighPriorityEntities( int iDistance )
@@ -462,13 +506,15 @@ int CAI_Senses::LookForNPCs( int iDistance )
 
 			BeginGather();
 
-			CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+			CUtlVector<CBaseEntity *> candidates;
+			GetSensingCandidates( AI_SENSING_GRID_NPCS, iDistance, &candidates );
 			
-			for ( i = 0; i < g_AI_Manager.NumAIs(); i++ )
+			for ( i = 0; i < candidates.Count(); i++ )
 			{
-				if ( ppAIs[i] != GetOuter() && ( ppAIs[i]->ShouldNotDistanceCull() || origin.DistToSqr(ppAIs[i]->GetAbsOrigin()) < distSq ) )
+				CAI_BaseNPC *pNPC = candidates[i]->MyNPCPointer();
+				if ( pNPC != GetOuter() && ( pNPC->ShouldNotDistanceCull() || origin.DistToSqr(pNPC->GetAbsOrigin()) < distSq ) )
 				{
-					if ( Look( ppAIs[i] ) )
+					if ( Look( pNPC ) )
 					{
 						nSeen++;
 					}
@@ -520,10 +566,11 @@ int CAI_Senses::LookForObjects( int iDistance )
 
 		float distSq = ( iDistance * iDistance );
 		const Vector &origin = GetAbsOrigin();
-		int iter;
-		CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetFirst( &iter );
-		while ( pEnt )
+		CUtlVector<CBaseEntity *> candidates;
+		GetSensingCandidates( AI_SENSING_GRID_OBJECTS, iDistance, &candidates );
+		for ( int i = 0; i < candidates.Count(); i++ )
 		{
+			CBaseEntity *pEnt = candidates[i];
 			if ( pEnt->GetFlags() & BOX_QUERY_MASK )
 			{
 				if ( origin.DistToSqr(pEnt->GetAbsOrigin()) < distSq && Look( pEnt) )
@@ -531,7 +578,6 @@ int CAI_Senses::LookForObjects( int iDistance )
 					nSeen++;
 				}
 			}
-			pEnt = g_AI_SensedObjectsManager.GetNext( &iter );
 		}
 		
 		EndGather( nSeen, &m_SeenMisc );
@@ -687,6 +733,7 @@ void CAI_SensedObjectsManager::Term()
 {
 	gEntList.RemoveListenerEntity( this );
 	m_SensedObjects.RemoveAll();
+	g_AI_SensingGrid.Purge();
 }
 
 //-----------------------------------------------------------------------------
@@ -754,3 +801,151 @@ void CAI_SensedObjectsManager::AddEntity( CBaseEntity *pEntity )
 }
 
 //=============================================================================
+//
+// CAI_SensingGrid
+//
+//=============================================================================
+
+void CAI_SensingGrid::Purge()
+{
+	m_Entries.Purge();
+	m_Cells.Purge();
+	m_Unculled.Purge();
+	m_iBuildTick = -1;
+}
+
+//-----------------------------------------------------------------------------
+
+int CAI_SensingGrid::EntryCompare( const Entry_t *pLeft, const Entry_t *pRight )
+{
+	if ( pLeft->cell != pRight->cell )
+		return ( pLeft->cell < pRight->cell ) ? -1 : 1;
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::AddEntry( CBaseEntity *pEntity, int type )
+{
+	const Vector &origin = pEntity->GetAbsOrigin();
+
+	int i = m_Entries.AddToTail();
+	m_Entries[i].cell = CellKey( CellCoord( origin.x ), CellCoord( origin.y ) );
+	m_Entries[i].type = type;
+	m_Entries[i].hEntity = pEntity;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::Build()
+{
+	AI_PROFILE_SENSES(CAI_SensingGrid_Build);
+
+	m_iBuildTick = gpGlobals->tickcount;
+	m_flCellSize = ai_sensing_grid_cell_size.GetFloat();
+
+	m_Entries.RemoveAll();
+	m_Cells.RemoveAll();
+	m_Unculled.RemoveAll();
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+	{
+		if ( ppAIs[i]->ShouldNotDistanceCull() )
+			m_Unculled.AddToTail( ppAIs[i] );
+		else
+			AddEntry( ppAIs[i], AI_SENSING_GRID_NPCS );
+	}
+
+	int iter;
+	for ( CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetFirst( &iter ); pEnt; pEnt = g_AI_SensedObjectsManager.GetNext( &iter ) )
+	{
+		AddEntry( pEnt, AI_SENSING_GRID_OBJECTS );
+	}
+
+	m_Entries.Sort( &EntryCompare );
+
+	for ( int i = 0; i < m_Entries.Count(); )
+	{
+		CellRange_t range;
+		range.first = i;
+		for ( ++i; i < m_Entries.Count() && m_Entries[i].cell == m_Entries[range.first].cell; ++i )
+		{
+		}
+		range.count = i - range.first;
+		m_Cells.Insert( m_Entries[range.first].cell, range );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+inline void CAI_SensingGrid::AppendEntry( const Entry_t &entry, int types, CUtlVector<CBaseEntity *> *pResult )
+{
+	if ( entry.type & types )
+	{
+		CBaseEntity *pEntity = entry.hEntity.Get();
+		if ( pEntity )
+			pResult->AddToTail( pEntity );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::Query( const Vector &mins, const Vector &maxs, int types, CUtlVector<CBaseEntity *> *pResult )
+{
+	if ( m_iBuildTick != gpGlobals->tickcount )
+		Build();
+
+	int xMin = CellCoord( mins.x - AI_SENSING_GRID_SLACK );
+	int xMax = CellCoord( maxs.x + AI_SENSING_GRID_SLACK );
+	int yMin = CellCoord( mins.y - AI_SENSING_GRID_SLACK );
+	int yMax = CellCoord( maxs.y + AI_SENSING_GRID_SLACK );
+
+	// Once the box spans more cells than there are entries, a straight walk is cheaper.
+	// Cell keys also wrap past 65536 cells per axis, so very large boxes must walk.
+	int64 nCells = (int64)( xMax - xMin + 1 ) * ( yMax - yMin + 1 );
+	if ( nCells > m_Entries.Count() || xMax - xMin >= 0xffff || yMax - yMin >= 0xffff )
+	{
+		for ( int i = 0; i < m_Entries.Count(); i++ )
+		{
+			AppendEntry( m_Entries[i], types, pResult );
+		}
+	}
+	else
+	{
+		for ( int x = xMin; x <= xMax; x++ )
+		{
+			for ( int y = yMin; y <= yMax; y++ )
+			{
+				UtlHashHandle_t h = m_Cells.Find( CellKey( x, y ) );
+				if ( h == m_Cells.InvalidHandle() )
+					continue;
+
+				const CellRange_t &range = m_Cells[h];
+				for ( int i = range.first; i < range.first + range.count; i++ )
+				{
+					AppendEntry( m_Entries[i], types, pResult );
+				}
+			}
+		}
+	}
+
+	if ( types & AI_SENSING_GRID_NPCS )
+	{
+		for ( int i = 0; i < m_Unculled.Count(); i++ )
+		{
+			if ( m_Unculled[i].Get() )
+				pResult->AddToTail( m_Unculled[i] );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::QueryRadius( const Vector &center, float flRadius, int types, CUtlVector<CBaseEntity *> *pResult )
+{
+	Vector extent( flRadius, flRadius, flRadius );
+	Query( center - extent, center + extent, types, pResult );
+}
+
+//=============================================================================
@@ -10,6 +10,7 @@
 
 #include "tier1/utlvector.h"
 #include "tier1/utlmap.h"
+#include "tier1/utlhashtable.h"
 #include "simtimer.h"
 #include "ai_component.h"
 #include "soundent.h"
@@ -115,6 +116,8 @@ private:
 	bool 			LookThroughPortal( const CProp_Portal *pPortal, CBaseEntity *pSightEnt );
 #endif
 
+	void			GetSensingCandidates( int types, int iDistance, CUtlVector<CBaseEntity *> *pResult );
+
 	int 			LookForHighPriorityEntities( int iDistance );
 	int 			LookForNPCs( int iDistance );
 	int 			LookForObjects( int iDistance );
@@ -163,6 +166,62 @@ private:
 extern CAI_SensedObjectsManager g_AI_SensedObjectsManager;
 
 //-----------------------------------------------------------------------------
+// CAI_SensingGrid
+//
+// Purpose: Uniform spatial hash over the NPCs and sensed objects, built at
+//			most once per tick on first use, so sensing only range tests the
+//			entities that share cells with the observer. Adding or removing
+//			an NPC forces a rebuild on the next query.
+//-----------------------------------------------------------------------------
+
+#define AI_SENSING_GRID_NPCS	0x01
+#define AI_SENSING_GRID_OBJECTS	0x02
+
+class CAI_SensingGrid
+{
+public:
+	CAI_SensingGrid() : m_iBuildTick( -1 ), m_flCellSize( 0 ) {}
+
+	// Appends every candidate in the box. NPCs that must not be distance
+	// culled are always appended. Callers still do their own range tests.
+	void			Query( const Vector &mins, const Vector &maxs, int types, CUtlVector<CBaseEntity *> *pResult );
+	void			QueryRadius( const Vector &center, float flRadius, int types, CUtlVector<CBaseEntity *> *pResult );
+
+	void			Invalidate()	{ m_iBuildTick = -1; }
+	void			Purge();
+
+private:
+	struct Entry_t
+	{
+		uint32		cell;
+		int			type;
+		EHANDLE		hEntity;
+	};
+
+	struct CellRange_t
+	{
+		int			first;
+		int			count;
+	};
+
+	void			Build();
+	uint32			CellKey( int x, int y ) const	{ return ( (uint32)( x & 0xffff ) << 16 ) | (uint32)( y & 0xffff ); }
+	int				CellCoord( float f ) const		{ return (int)floorf( f / m_flCellSize ); }
+	void			AddEntry( CBaseEntity *pEntity, int type );
+	void			AppendEntry( const Entry_t &entry, int types, CUtlVector<CBaseEntity *> *pResult );
+
+	static int		EntryCompare( const Entry_t *pLeft, const Entry_t *pRight );
+
+	int									m_iBuildTick;
+	float								m_flCellSize;
+	CUtlVector<Entry_t>					m_Entries;		// sorted by cell
+	CUtlHashtable<uint32, CellRange_t>	m_Cells;
+	CUtlVector<EHANDLE>					m_Unculled;		// NPCs that ignore look distance
+};
+
+extern CAI_SensingGrid g_AI_SensingGrid;
+
+//-----------------------------------------------------------------------------
 
 
 
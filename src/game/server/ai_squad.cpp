@@ -8,6 +8,7 @@
 #include "ai_squad.h"
 #include "ai_squadslot.h"
 #include "ai_basenpc.h"
+#include "ai_senses.h"
 #include "saverestore_bitstring.h"
 #include "saverestore_utlvector.h"
 
@@ -189,6 +190,11 @@ void CAI_Squad::Init(string_t newName)
 	m_pLastFoundEnemyInfo = NULL;
 #endif
 
+	for ( int i = 0; i < ARRAYSIZE( m_SensingSweeps ); i++ )
+	{
+		m_SensingSweeps[i].tick = -1;
+		m_SensingSweeps[i].candidates.RemoveAll();
+	}
 }
 
 //-------------------------------------
@@ -540,6 +546,64 @@ int	CAI_Squad::BroadcastInteraction( int interactionType, void *data, CBaseComba
 	return true;
 }
 
+//-------------------------------------
+// Purpose: Shares one sensing grid sweep around the whole squad between the
+//			members that look this tick. Returns false when the squad is
+//			spread too far apart for a shared sweep to pay off.
+//-------------------------------------
+
+bool CAI_Squad::GetSensingCandidates( const Vector &origin, int types, int iDistance, CUtlVector<CBaseEntity *> *pResult )
+{
+	if ( types != AI_SENSING_GRID_NPCS && types != AI_SENSING_GRID_OBJECTS )
+		return false;
+
+	SensingSweep_t &sweep = m_SensingSweeps[ ( types == AI_SENSING_GRID_NPCS ) ? 0 : 1 ];
+	Vector extent( iDistance, iDistance, iDistance );
+
+	// Sweep again unless this tick's sweep already covers the caller's own query box
+	if ( sweep.tick != gpGlobals->tickcount || 
+		 origin.x - iDistance < sweep.mins.x || origin.x + iDistance > sweep.maxs.x ||
+		 origin.y - iDistance < sweep.mins.y || origin.y + iDistance > sweep.maxs.y )
+	{
+		Vector mins = origin;
+		Vector maxs = origin;
+		for ( int i = 0; i < m_SquadMembers.Count(); i++ )
+		{
+			if ( m_SquadMembers[i] != NULL )
+			{
+				const Vector &memberOrigin = m_SquadMembers[i]->GetAbsOrigin();
+				VectorMin( mins, memberOrigin, mins );
+				VectorMax( maxs, memberOrigin, maxs );
+			}
+		}
+
+		if ( maxs.x - mins.x > iDistance || maxs.y - mins.y > iDistance )
+			return false;
+
+		sweep.tick = gpGlobals->tickcount;
+		sweep.mins = mins - extent;
+		sweep.maxs = maxs + extent;
+
+		int first = pResult->Count();
+		g_AI_SensingGrid.Query( sweep.mins, sweep.maxs, types, pResult );
+
+		sweep.candidates.SetCount( pResult->Count() - first );
+		for ( int i = first; i < pResult->Count(); i++ )
+		{
+			sweep.candidates[i - first] = (*pResult)[i];
+		}
+		return true;
+	}
+
+	for ( int i = 0; i < sweep.candidates.Count(); i++ )
+	{
+		CBaseEntity *pEntity = sweep.candidates[i].Get();
+		if ( pEntity )
+			pResult->AddToTail( pEntity );
+	}
+	return true;
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: is it ok to make a sound of the given priority?  Check for conflicts
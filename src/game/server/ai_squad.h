@@ -114,6 +114,8 @@ public:
 
 	int						BroadcastInteraction( int interactionType, void *data, CBaseCombatCharacter *sender = NULL );
 
+	bool					GetSensingCandidates( const Vector &origin, int types, int iDistance, CUtlVector<CBaseEntity *> *pResult );
+
 	void					AddToSquad(CAI_BaseNPC *pNPC);
 	bool					FOkToMakeSound( int soundPriority );
 	void					JustMadeSound( int soundPriority, float time );
@@ -176,6 +178,17 @@ private:
 
 	int												m_SquadData[MAX_SQUAD_DATA_SLOTS];
 
+	// One sensing grid sweep per tick and candidate type, shared by the members (not saved)
+	struct SensingSweep_t
+	{
+		int					tick;
+		Vector				mins;
+		Vector				maxs;
+		CUtlVector<EHANDLE>	candidates;
+	};
+
+	SensingSweep_t									m_SensingSweeps[2];
+
 #ifdef PER_ENEMY_SQUADSLOTS
 
 	AISquadEnemyInfo_t *FindEnemyInfo( CBaseEntity *pEnemy );
@@ -38,6 +38,8 @@
 #include "rumble_shared.h"
 #include "saverestoretypes.h"
 #include "nav_mesh.h"
+#include "tier1/utlhashtable.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TF_DLL
 #include "nav_mesh/tf_nav_area.h"
@@ -79,6 +81,10 @@ ConVar ai_use_visibility_cache( "ai_use_visibility_cache", "1" );
 #define ShouldUseVisibilityCache() true
 #endif
 
+ConVar ai_use_occlusion_cache( "ai_use_occlusion_cache", "1", 0, "Share world line of sight results between all NPCs and bots" );
+ConVar ai_occlusion_cache_max_age( "ai_occlusion_cache_max_age", "0.1", 0, "Oldest shared world line of sight result a visibility check will accept, in seconds" );
+ConVar ai_occlusion_cache_grid( "ai_occlusion_cache_grid", "8", 0, "Rays whose ends fall in the same cells of this size share a world line of sight result" );
+
 BEGIN_DATADESC( CBaseCombatCharacter )
 
 #ifdef INVASION_DLL
@@ -403,7 +409,16 @@ bool CBaseCombatCharacter::FVisible( CBaseEntity *pEntity, int traceMask, CBaseE
 		ppBlocker = &pBlocker;
 	}
 
-	bool bResult = BaseClass::FVisible( pEntity, traceMask, ppBlocker );
+	bool bResult;
+	if ( IsLineOfSightOccluded( EyePosition(), pEntity->EyePosition(), traceMask ) )
+	{
+		*ppBlocker = GetWorldEntity();
+		bResult = false;
+	}
+	else
+	{
+		bResult = BaseClass::FVisible( pEntity, traceMask, ppBlocker );
+	}
 
 	if ( !bResult )
 	{
@@ -445,6 +460,207 @@ void CBaseCombatCharacter::ResetVisibilityCache( CBaseCombatCharacter *pBCC )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// World occlusion caching
+//
+// NPCs and bots watching the same targets keep tracing nearly the same eye to
+// eye rays.  Whether the world blocks such a ray doesn't depend on who is
+// looking, so the answer is shared: rays are keyed by the PVS clusters and
+// the grid cells of their ends.  Entries that were read recently are traced
+// again together on worker threads at the start of the frame, before anyone
+// thinks, so steady watchers read results instead of tracing.
+//
+// Only world geometry is considered.  A clear result says nothing about
+// entities in the way, so callers still do their own trace in that case.
+//-----------------------------------------------------------------------------
+
+struct OcclusionCacheKey_t
+{
+	int				from[3];
+	int				to[3];
+	int				fromCluster;
+	int				toCluster;
+	unsigned int	mask;
+};
+
+struct OcclusionCacheKeyHash
+{
+	unsigned int operator()( const OcclusionCacheKey_t &key ) const { return HashBlock( &key, sizeof( key ) ); }
+};
+
+struct OcclusionCacheKeyEqual
+{
+	bool operator()( const OcclusionCacheKey_t &lhs, const OcclusionCacheKey_t &rhs ) const { return memcmp( &lhs, &rhs, sizeof( lhs ) ) == 0; }
+};
+
+struct OcclusionCacheEntry_t
+{
+	Vector			from;			// ray of the latest query that read the entry
+	Vector			to;
+	unsigned int	mask;
+	float			fraction;
+	float			time;			// when last traced
+	bool			bInPVS;
+	bool			bOccluded;
+	bool			bRead;			// read since the last refresh
+};
+
+static CUtlHashtable< OcclusionCacheKey_t, OcclusionCacheEntry_t, OcclusionCacheKeyHash, OcclusionCacheKeyEqual > g_OcclusionCache;
+
+static void TraceOcclusionCacheEntry( OcclusionCacheEntry_t *&pEntry )
+{
+	if ( !pEntry->bInPVS )
+	{
+		pEntry->bOccluded = true;
+		pEntry->fraction = 0.0f;
+		return;
+	}
+
+	Ray_t ray;
+	ray.Init( pEntry->from, pEntry->to );
+
+	trace_t tr;
+	CTraceFilterWorldOnly traceFilter;
+	enginetrace->TraceRay( ray, pEntry->mask, &traceFilter, &tr );
+
+	pEntry->bOccluded = ( tr.fraction < 1.0f || tr.startsolid );
+	pEntry->fraction = tr.fraction;
+}
+
+bool CBaseCombatCharacter::IsLineOfSightOccluded( const Vector &vecFrom, const Vector &vecTo, int traceMask, Vector *pEndPos )
+{
+	if ( !ai_use_occlusion_cache.GetBool() )
+		return false;
+
+	// The cache only knows about solid world geometry; other masks get no opinion
+	if ( !( traceMask & CONTENTS_SOLID ) )
+		return false;
+
+	VPROF( "CBaseCombatCharacter::IsLineOfSightOccluded" );
+
+	float flGrid = MAX( ai_occlusion_cache_grid.GetFloat(), 1.0f );
+
+	OcclusionCacheKey_t key;
+	for ( int i = 0; i < 3; i++ )
+	{
+		key.from[i] = (int)floorf( vecFrom[i] / flGrid );
+		key.to[i] = (int)floorf( vecTo[i] / flGrid );
+	}
+	key.fromCluster = engine->GetClusterForOrigin( vecFrom );
+	key.toCluster = engine->GetClusterForOrigin( vecTo );
+	key.mask = traceMask & ( CONTENTS_SOLID | CONTENTS_IGNORE_NODRAW_OPAQUE );
+
+	UtlHashHandle_t hEntry = g_OcclusionCache.Find( key );
+	if ( hEntry == g_OcclusionCache.InvalidHandle() )
+	{
+		OcclusionCacheEntry_t entry;
+		entry.from = vecFrom;
+		entry.to = vecTo;
+		entry.mask = key.mask;
+		entry.bRead = false;
+		entry.bInPVS = true;
+
+		// A target outside the PVS of the eye can't be seen, no trace needed
+		if ( key.fromCluster >= 0 && key.toCluster >= 0 )
+		{
+			byte pvs[ MAX_MAP_CLUSTERS/8 ];
+			engine->GetPVSForCluster( key.fromCluster, sizeof( pvs ), pvs );
+			entry.bInPVS = engine->CheckOriginInPVS( vecTo, pvs, sizeof( pvs ) );
+		}
+
+		OcclusionCacheEntry_t *pEntry = &entry;
+		TraceOcclusionCacheEntry( pEntry );
+		entry.time = gpGlobals->curtime;
+
+		hEntry = g_OcclusionCache.Insert( key, entry );
+	}
+	else
+	{
+		// Keep the latest ray in the cell, so refreshes trace what's being asked now
+		OcclusionCacheEntry_t *pEntry = &g_OcclusionCache[hEntry];
+		pEntry->from = vecFrom;
+		pEntry->to = vecTo;
+
+		if ( gpGlobals->curtime - pEntry->time > ai_occlusion_cache_max_age.GetFloat() )
+		{
+			TraceOcclusionCacheEntry( pEntry );
+			pEntry->time = gpGlobals->curtime;
+		}
+	}
+
+	OcclusionCacheEntry_t &entry = g_OcclusionCache[hEntry];
+	entry.bRead = true;
+
+	if ( entry.bOccluded && pEndPos )
+	{
+		*pEndPos = vecFrom + entry.fraction * ( vecTo - vecFrom );
+	}
+
+	return entry.bOccluded;
+}
+
+//-----------------------------------------------------------------------------
+
+class COcclusionCacheSystem : public CAutoGameSystemPerFrame
+{
+public:
+	COcclusionCacheSystem() : CAutoGameSystemPerFrame( "COcclusionCacheSystem" )
+	{
+	}
+
+	virtual void LevelShutdownPreEntity()
+	{
+		g_OcclusionCache.Purge();
+	}
+
+	virtual void FrameUpdatePreEntityThink()
+	{
+		VPROF( "COcclusionCacheSystem::FrameUpdatePreEntityThink" );
+
+		if ( !g_OcclusionCache.Count() )
+			return;
+
+		// Anything that would go stale before the end of this frame's thinking
+		float flMaxAge = ai_occlusion_cache_max_age.GetFloat();
+		float flRefreshAge = flMaxAge - gpGlobals->interval_per_tick;
+
+		m_Refresh.RemoveAll();
+
+		UtlHashHandle_t hEntry = g_OcclusionCache.FirstHandle();
+		while ( hEntry != g_OcclusionCache.InvalidHandle() )
+		{
+			OcclusionCacheEntry_t &entry = g_OcclusionCache[hEntry];
+			float flAge = gpGlobals->curtime - entry.time;
+
+			if ( !entry.bRead && flAge > flMaxAge )
+			{
+				// nobody is looking along this ray anymore
+				hEntry = g_OcclusionCache.RemoveAndAdvance( hEntry );
+				continue;
+			}
+
+			if ( entry.bRead && entry.bInPVS && flAge >= flRefreshAge )
+			{
+				entry.bRead = false;
+				entry.time = gpGlobals->curtime;
+				m_Refresh.AddToTail( &entry );
+			}
+
+			hEntry = g_OcclusionCache.NextHandle( hEntry );
+		}
+
+		if ( m_Refresh.Count() )
+		{
+			ParallelProcess( "COcclusionCacheSystem::Refresh", m_Refresh.Base(), m_Refresh.Count(), &TraceOcclusionCacheEntry );
+		}
+	}
+
+private:
+	CUtlVector< OcclusionCacheEntry_t * > m_Refresh;
+};
+
+static COcclusionCacheSystem g_OcclusionCacheSystem;
+
 #ifdef PORTAL
 bool CBaseCombatCharacter::FVisibleThroughPortal( const CProp_Portal *pPortal, CBaseEntity *pEntity, int traceMask, CBaseEntity **ppBlocker )
 {
@@ -62,6 +62,7 @@
 #include "env_debughistory.h"
 #include "tier1/utlstring.h"
 #include "utlhashtable.h"
+#include "tier1/generichash.h"
 #include "vscript_server.h"
 
 #if defined( TF_DLL )
@@ -706,6 +707,13 @@ CBaseEntity *CBaseEntity::GetFollowedEntity()
 void CBaseEntity::SetClassname( const char *className )
 {
 	m_iClassname = AllocPooledString( className );
+	gEntList.UpdateEntityNameIndex( this );
+}
+
+void CBaseEntity::SetName( string_t newName )
+{
+	m_iName = newName;
+	gEntList.UpdateEntityNameIndex( this );
 }
 
 void CBaseEntity::SetModelIndex( int index )
@@ -1215,6 +1223,9 @@ void CBaseEntity::TransformStepData_WorldToParent( CBaseEntity *pParent )
 //-----------------------------------------------------------------------------
 void CBaseEntity::SetParent( CBaseEntity *pParentEntity, int iAttachment )
 {
+	// Children don't hold trigger touches, so settle ours before we become one
+	EntityTouch_FlushSolidMoved( this );
+
 	// If they didn't specify an attachment, use our current
 	if ( iAttachment == -1 )
 	{
@@ -3114,7 +3125,7 @@ void CBaseEntity::PhysicsTouchTriggers( const Vector *pPrevAbsOrigin )
 		}
 
 		SetCheckUntouch( true );
-		if ( isSolidCheckTriggers )
+		if ( isSolidCheckTriggers && !EntityTouch_DeferSolidMoved( this, pPrevAbsOrigin ) )
 		{
 			engine->SolidMoved( pEdict, CollisionProp(), pPrevAbsOrigin, sm_bAccurateTriggerBboxChecks );
 		}
@@ -3722,6 +3733,9 @@ int CBaseEntity::Restore( IRestore &restore )
 		m_hGroundEntity->AddEntityToGroundList( this );
 	}
 
+	// Name and classname were written straight into the fields
+	gEntList.UpdateEntityNameIndex( this );
+
 	return status;
 }
 
@@ -4364,6 +4378,107 @@ void CBaseEntity::OnEntityEvent( EntityEvent_t event, void *pEventData )
 ConVar ent_messages_draw( "ent_messages_draw", "0", FCVAR_CHEAT, "Visualizes all entity input/output activity." );
 
 
+//-----------------------------------------------------------------------------
+// Input dispatch tables. Built the first time a datamap receives an input: all
+// the inputs of the map and its base maps, sorted by caseless name hash. Entries
+// sharing a hash keep datamap chain order so a derived class input still wins
+// over a base class input of the same name, as with the old linear walk.
+//-----------------------------------------------------------------------------
+struct InputDispatchEntry_t
+{
+	unsigned int				m_nHash;
+	int							m_nOrder;
+	const typedescription_t		*m_pDesc;
+};
+
+class CInputDispatchTable
+{
+public:
+	CInputDispatchTable( datamap_t *pMap )
+	{
+		for ( datamap_t *dmap = pMap; dmap != NULL; dmap = dmap->baseMap )
+		{
+			for ( int i = 0; i < dmap->dataNumFields; i++ )
+			{
+				const typedescription_t *pDesc = &dmap->dataDesc[i];
+				if ( !( pDesc->flags & FTYPEDESC_INPUT ) || !pDesc->externalName )
+					continue;
+
+				InputDispatchEntry_t &entry = m_Entries[ m_Entries.AddToTail() ];
+				entry.m_nHash = HashStringCaseless( pDesc->externalName );
+				entry.m_nOrder = m_Entries.Count();
+				entry.m_pDesc = pDesc;
+			}
+		}
+
+		m_Entries.Sort( EntryCompare );
+	}
+
+	const typedescription_t *Find( const char *szInputName ) const
+	{
+		unsigned int nHash = HashStringCaseless( szInputName );
+
+		int nLow = 0, nHigh = m_Entries.Count();
+		while ( nLow < nHigh )
+		{
+			int nMid = ( nLow + nHigh ) >> 1;
+			if ( m_Entries[nMid].m_nHash < nHash )
+				nLow = nMid + 1;
+			else
+				nHigh = nMid;
+		}
+
+		for ( int i = nLow; i < m_Entries.Count() && m_Entries[i].m_nHash == nHash; i++ )
+		{
+			if ( !Q_stricmp( m_Entries[i].m_pDesc->externalName, szInputName ) )
+				return m_Entries[i].m_pDesc;
+		}
+
+		return NULL;
+	}
+
+private:
+	static int __cdecl EntryCompare( const InputDispatchEntry_t *pLeft, const InputDispatchEntry_t *pRight )
+	{
+		if ( pLeft->m_nHash != pRight->m_nHash )
+			return ( pLeft->m_nHash < pRight->m_nHash ) ? -1 : 1;
+		return pLeft->m_nOrder - pRight->m_nOrder;
+	}
+
+	CUtlVector< InputDispatchEntry_t > m_Entries;
+};
+
+// Datamaps are static, so the tables live for the life of the dll
+static CUtlHashtable< datamap_t *, CInputDispatchTable *, PointerHashFunctor, PointerEqualFunctor > s_InputDispatchTables;
+
+const typedescription_t *CBaseEntity::FindInputDesc( datamap_t *pMap, const char *szInputName )
+{
+	if ( !pMap || !szInputName )
+		return NULL;
+
+	UtlHashHandle_t h = s_InputDispatchTables.Find( pMap );
+	if ( h == s_InputDispatchTables.InvalidHandle() )
+	{
+		h = s_InputDispatchTables.Insert( pMap, new CInputDispatchTable( pMap ) );
+	}
+
+	return s_InputDispatchTables.Element( h )->Find( szInputName );
+}
+
+//-----------------------------------------------------------------------------
+// The lookup AcceptResolvedInput hands to the base AcceptInput. It only applies
+// to the same datamap and the same name string, so an override that renames
+// the input or forwards it to another class still gets a fresh lookup.
+//-----------------------------------------------------------------------------
+struct ResolvedInputHint_t
+{
+	datamap_t					*m_pMap;
+	const char					*m_pszInputName;
+	const typedescription_t		*m_pInputDesc;
+};
+
+static ResolvedInputHint_t s_ResolvedInputHint = { NULL, NULL, NULL };
+
 //-----------------------------------------------------------------------------
 // Purpose: calls the appropriate message mapped function in the entity according
 //			to the fired action.
@@ -4373,6 +4488,42 @@ ConVar ent_messages_draw( "ent_messages_draw", "0", FCVAR_CHEAT, "Visualizes all
 // Output : Returns true on success, false on failure.
 //-----------------------------------------------------------------------------
 bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID )
+{
+	datamap_t *pMap = GetDataDescMap();
+	const typedescription_t *pInputDesc;
+	if ( s_ResolvedInputHint.m_pMap == pMap && s_ResolvedInputHint.m_pszInputName == szInputName )
+	{
+		pInputDesc = s_ResolvedInputHint.m_pInputDesc;
+	}
+	else
+	{
+		pInputDesc = FindInputDesc( pMap, szInputName );
+	}
+
+	return DispatchResolvedInput( pInputDesc, szInputName, pActivator, pCaller, Value, outputID );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: AcceptInput with the datamap lookup already done by the caller
+//-----------------------------------------------------------------------------
+bool CBaseEntity::AcceptResolvedInput( const typedescription_t *pInputDesc, const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID )
+{
+	// inputs can fire other inputs synchronously, so keep the outer hint
+	ResolvedInputHint_t outerHint = s_ResolvedInputHint;
+	s_ResolvedInputHint.m_pMap = GetDataDescMap();
+	s_ResolvedInputHint.m_pszInputName = szInputName;
+	s_ResolvedInputHint.m_pInputDesc = pInputDesc;
+
+	bool bResult = AcceptInput( szInputName, pActivator, pCaller, Value, outputID );
+
+	s_ResolvedInputHint = outerHint;
+	return bResult;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: runs an input found with FindInputDesc, skipping the name lookup
+//-----------------------------------------------------------------------------
+bool CBaseEntity::DispatchResolvedInput( const typedescription_t *pInputDesc, const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID )
 {
 	if ( ent_messages_draw.GetBool() )
 	{
@@ -4386,127 +4537,121 @@ bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator,
 		NDebugOverlay::Box( GetAbsOrigin(), Vector(-4, -4, -4), Vector(4, 4, 4), 0, 255, 0, 0, 3 );
 	}
 
-	// loop through the data description list, restoring each data desc block
-	for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
+	if ( !pInputDesc )
 	{
-		// search through all the actions in the data description, looking for a match
-		for ( int i = 0; i < dmap->dataNumFields; i++ )
-		{
-			if ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT )
-			{
-				if ( !Q_stricmp(dmap->dataDesc[i].externalName, szInputName) )
-				{
-					// found a match
+		DevMsg( 2, "unhandled input: (%s) -> (%s,%s)\n", szInputName, STRING(m_iClassname), GetDebugName()/*,", from (%s,%s)" STRING(pCaller->m_iClassname), STRING(pCaller->m_iName)*/ );
+		return false;
+	}
 
-					char szBuffer[256];
-					// mapper debug message
-					if (pCaller != NULL)
-					{
+	Assert( FindInputDesc( GetDataDescMap(), pInputDesc->externalName ) == pInputDesc );
+
+	// mapper debug message, only formatted when something will show it
+#ifdef DISABLE_DEBUG_HISTORY
+	if ( developer.GetInt() >= 2 )
+#endif
+	{
+		char szBuffer[256];
+		if (pCaller != NULL)
+		{
 #ifdef AS_DLL
-						Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, STRING(pCaller->m_iName.Get()), GetDebugName(), szInputName, Value.String() );
+			Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, STRING(pCaller->m_iName.Get()), GetDebugName(), szInputName, Value.String() );
 #else
-						Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, STRING(pCaller->m_iName), GetDebugName(), szInputName, Value.String() );
+			Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, STRING(pCaller->m_iName), GetDebugName(), szInputName, Value.String() );
 #endif // AS_DLL
-					}
-					else
-					{
-						Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input <NULL>: %s.%s(%s)\n", gpGlobals->curtime, GetDebugName(), szInputName, Value.String() );
-					}
-					DevMsg( 2, "%s", szBuffer );
-					ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+		}
+		else
+		{
+			Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input <NULL>: %s.%s(%s)\n", gpGlobals->curtime, GetDebugName(), szInputName, Value.String() );
+		}
+		DevMsg( 2, "%s", szBuffer );
+		ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+	}
 
-					if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
-					{
-						DrawInputOverlay(szInputName,pCaller,Value);
-					}
+	if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
+	{
+		DrawInputOverlay(szInputName,pCaller,Value);
+	}
 
-					// convert the value if necessary
-					if ( Value.FieldType() != dmap->dataDesc[i].fieldType )
-					{
-						if ( !(Value.FieldType() == FIELD_VOID && dmap->dataDesc[i].fieldType == FIELD_STRING) ) // allow empty strings
-						{
-							if ( !Value.Convert( (fieldtype_t)dmap->dataDesc[i].fieldType ) )
-							{
-								// bad conversion
-								Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
-									STRING(m_iClassname), GetDebugName(), szInputName, 
-									( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
+	// convert the value if necessary
+	if ( Value.FieldType() != pInputDesc->fieldType )
+	{
+		if ( !(Value.FieldType() == FIELD_VOID && pInputDesc->fieldType == FIELD_STRING) ) // allow empty strings
+		{
+			if ( !Value.Convert( (fieldtype_t)pInputDesc->fieldType ) )
+			{
+				// bad conversion
+				Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
+					STRING(m_iClassname), GetDebugName(), szInputName, 
+					( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
 #ifdef AS_DLL
-									( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>" );
+					( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>" );
 #else
-									( pCaller != NULL ) ? STRING(pCaller->m_iName) : "<null>" );
+					( pCaller != NULL ) ? STRING(pCaller->m_iName) : "<null>" );
 #endif // AS_DLL
-								return false;
-							}
-						}
-					}
-
-					// call the input handler, or if there is none just set the value
-					inputfunc_t pfnInput = dmap->dataDesc[i].inputFunc;
+				return false;
+			}
+		}
+	}
 
-					if ( pfnInput )
-					{ 
-						// Package the data into a struct for passing to the input handler.
-						inputdata_t data;
-						data.pActivator = pActivator;
-						data.pCaller = pCaller;
-						data.value = Value;
-						data.nOutputID = outputID;
+	// call the input handler, or if there is none just set the value
+	inputfunc_t pfnInput = pInputDesc->inputFunc;
 
-						// Now, see if there's a function named Input<Name of Input> in this entity's script file. 
-						// If so, execute it and let it decide whether to allow the default behavior to also execute.
-						bool bCallInputFunc = true; // Always assume default behavior (do call the input function)
-						ScriptVariant_t functionReturn;
+	if ( pfnInput )
+	{ 
+		// Package the data into a struct for passing to the input handler.
+		inputdata_t data;
+		data.pActivator = pActivator;
+		data.pCaller = pCaller;
+		data.value = Value;
+		data.nOutputID = outputID;
 
-						if ( m_ScriptScope.IsInitialized() )
-						{
-							char szScriptFunctionName[255];
-							Q_strcpy( szScriptFunctionName, "Input" );
-							Q_strcat( szScriptFunctionName, szInputName, 255 );
+		// Now, see if there's a function named Input<Name of Input> in this entity's script file. 
+		// If so, execute it and let it decide whether to allow the default behavior to also execute.
+		bool bCallInputFunc = true; // Always assume default behavior (do call the input function)
+		ScriptVariant_t functionReturn;
 
-							g_pScriptVM->SetValue( "activator", ( pActivator ) ? ScriptVariant_t( pActivator->GetScriptInstance() ) : SCRIPT_VARIANT_NULL );
-							g_pScriptVM->SetValue( "caller", ( pCaller ) ? ScriptVariant_t( pCaller->GetScriptInstance() ) : SCRIPT_VARIANT_NULL );
-
-							if( CallScriptFunction( szScriptFunctionName, &functionReturn ) )
-							{
-								bCallInputFunc = functionReturn;
-							}
-						}
+		if ( m_ScriptScope.IsInitialized() )
+		{
+			char szScriptFunctionName[255];
+			Q_strcpy( szScriptFunctionName, "Input" );
+			Q_strcat( szScriptFunctionName, szInputName, 255 );
 
-						if( bCallInputFunc )
-						{
-							(this->*pfnInput)( data );
-						}
-					
-						if ( m_ScriptScope.IsInitialized() )
-						{
-							g_pScriptVM->ClearValue( "activator" );
-							g_pScriptVM->ClearValue( "caller" );
-						}
-					}
-					else if ( dmap->dataDesc[i].flags & FTYPEDESC_KEY )
-					{
-						// set the value directly
-						Value.SetOther( ((char*)this) + dmap->dataDesc[i].fieldOffset[ TD_OFFSET_NORMAL ]);
-					
-						// TODO: if this becomes evil and causes too many full entity updates, then we should make
-						// a macro like this:
-						//
-						// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
-						//
-						// Then the datadesc points at that function and we call it here. The only pain is to add
-						// that function for all the DEFINE_INPUT calls.
-						NetworkStateChanged();
-					}
+			g_pScriptVM->SetValue( "activator", ( pActivator ) ? ScriptVariant_t( pActivator->GetScriptInstance() ) : SCRIPT_VARIANT_NULL );
+			g_pScriptVM->SetValue( "caller", ( pCaller ) ? ScriptVariant_t( pCaller->GetScriptInstance() ) : SCRIPT_VARIANT_NULL );
 
-					return true;
-				}
+			if( CallScriptFunction( szScriptFunctionName, &functionReturn ) )
+			{
+				bCallInputFunc = functionReturn;
 			}
 		}
+
+		if( bCallInputFunc )
+		{
+			(this->*pfnInput)( data );
+		}
+	
+		if ( m_ScriptScope.IsInitialized() )
+		{
+			g_pScriptVM->ClearValue( "activator" );
+			g_pScriptVM->ClearValue( "caller" );
+		}
+	}
+	else if ( pInputDesc->flags & FTYPEDESC_KEY )
+	{
+		// set the value directly
+		Value.SetOther( ((char*)this) + pInputDesc->fieldOffset[ TD_OFFSET_NORMAL ]);
+	
+		// TODO: if this becomes evil and causes too many full entity updates, then we should make
+		// a macro like this:
+		//
+		// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
+		//
+		// Then the datadesc points at that function and we call it here. The only pain is to add
+		// that function for all the DEFINE_INPUT calls.
+		NetworkStateChanged();
 	}
 
-	DevMsg( 2, "unhandled input: (%s) -> (%s,%s)\n", szInputName, STRING(m_iClassname), GetDebugName()/*,", from (%s,%s)" STRING(pCaller->m_iClassname), STRING(pCaller->m_iName)*/ );
-	return false;
+	return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -6615,6 +6760,9 @@ void CBaseEntity::SetAbsOrigin( const Vector& absOrigin )
 	if ( m_vecAbsOrigin == absOrigin )
 		return;
 
+	// Resolve any trigger touches still held for where we are now
+	EntityTouch_FlushSolidMoved( this );
+
 	// All children are invalid, but we are not
 	InvalidatePhysicsRecursive( POSITION_CHANGED );
 	RemoveEFlags( EFL_DIRTY_ABSTRANSFORM );
@@ -6657,6 +6805,8 @@ void CBaseEntity::SetAbsAngles( const QAngle& absAngles )
 	if ( m_angAbsRotation == absAngles )
 		return;
 
+	EntityTouch_FlushSolidMoved( this );
+
 	// All children are invalid, but we are not
 	InvalidatePhysicsRecursive( ANGLES_CHANGED );
 	RemoveEFlags( EFL_DIRTY_ABSTRANSFORM );
@@ -6789,6 +6939,7 @@ void CBaseEntity::SetLocalOrigin( const Vector& origin )
 		Assert( origin.z >= -largeVal && origin.z <= largeVal );
 #endif
 		
+		EntityTouch_FlushSolidMoved( this );
 		InvalidatePhysicsRecursive( POSITION_CHANGED );
 		m_vecOrigin.SetDirect( origin );
 		SetSimulationTime( gpGlobals->curtime );
@@ -6818,6 +6969,7 @@ void CBaseEntity::SetLocalAngles( const QAngle& angles )
 
 	if (m_angRotation != angles)
 	{
+		EntityTouch_FlushSolidMoved( this );
 		InvalidatePhysicsRecursive( ANGLES_CHANGED );
 		m_angRotation.SetDirect( angles );
 		SetSimulationTime( gpGlobals->curtime );
@@ -669,6 +669,17 @@ public:
 	// returns true if the the value in the pass in should be set, false if the input is to be ignored
 	virtual bool AcceptInput( const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID );
 
+	// AcceptInput for an input already looked up in this entity's datamap with FindInputDesc (NULL if
+	// unhandled). Overrides of AcceptInput still see the input; the base version skips its name lookup.
+	bool AcceptResolvedInput( const typedescription_t *pInputDesc, const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID );
+
+	// handles an input already looked up in this entity's datamap with FindInputDesc (NULL if unhandled),
+	// this is what AcceptInput runs after the name lookup. Bypasses AcceptInput overrides.
+	bool DispatchResolvedInput( const typedescription_t *pInputDesc, const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID );
+
+	// finds the input named szInputName in pMap or its base maps, NULL if there is none
+	static const typedescription_t *FindInputDesc( datamap_t *pMap, const char *szInputName );
+
 	//
 	// Input handlers.
 	//
@@ -2199,12 +2210,6 @@ inline const char *CBaseEntity::GetPreTemplateName()
 #endif // AS_DLL
 }
 
-inline void CBaseEntity::SetName( string_t newName )
-{
-	m_iName = newName;
-}
-
-
 inline bool CBaseEntity::NameMatches( const char *pszNameOrWildcard )
 {
 	if ( IDENT_STRINGS(m_iName, pszNameOrWildcard) )
@@ -731,8 +731,8 @@ CEventQueue g_EventQueue;
 
 CEventQueue::CEventQueue()
 {
-	m_Events.m_flFireTime = -FLT_MAX;
-	m_Events.m_pNext = NULL;
+	m_pServicingEvent = NULL;
+	m_nNextSequence = 0;
 
 	Init();
 }
@@ -846,21 +846,42 @@ void CEventQueue::Init( void )
 void CEventQueue::Clear( void )
 {
 	// delete all the events in the queue
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-	
-	while ( pe != NULL )
+	for ( int i = 0; i < m_Heap.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
-		delete pe;
-		pe = next;
+		m_Heap[i]->m_iHeapIndex = -1;
+		FreeEvent( m_Heap[i] );
 	}
 
-	m_Events.m_pNext = NULL;
+	m_Heap.RemoveAll();
+	m_CallerChains.RemoveAll();
+	m_TargetChains.RemoveAll();
+	m_nNextSequence = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: returns the pending events sorted the way they will be fired
+//-----------------------------------------------------------------------------
+static int __cdecl EventFireOrderCompare( EventQueuePrioritizedEvent_t * const *ppLeft, EventQueuePrioritizedEvent_t * const *ppRight )
+{
+	const EventQueuePrioritizedEvent_t *pLeft = *ppLeft;
+	const EventQueuePrioritizedEvent_t *pRight = *ppRight;
+	if ( pLeft->m_flFireTime != pRight->m_flFireTime )
+		return ( pLeft->m_flFireTime < pRight->m_flFireTime ) ? -1 : 1;
+	if ( pLeft->m_nSequence != pRight->m_nSequence )
+		return ( pLeft->m_nSequence < pRight->m_nSequence ) ? -1 : 1;
+	return 0;
+}
+
+void CEventQueue::GetEventsInFireOrder( CUtlVector< EventQueuePrioritizedEvent_t * > &events )
+{
+	events.CopyArray( m_Heap.Base(), m_Heap.Count() );
+	events.Sort( EventFireOrderCompare );
 }
 
 void CEventQueue::Dump( void )
 {
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	CUtlVector< EventQueuePrioritizedEvent_t * > events;
+	GetEventsInFireOrder( events );
 
 	Msg("Dumping event queue. Current time is: %.2f\n",
 #ifdef TF_DLL
@@ -870,9 +891,9 @@ void CEventQueue::Dump( void )
 #endif
 		);
 
-	while ( pe != NULL )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
+		EventQueuePrioritizedEvent_t *pe = events[i];
 
 		Msg("   (%.2f) Target: '%s', Input: '%s', Parameter '%s'. Activator: '%s', Caller '%s'.  \n", 
 			pe->m_flFireTime, 
@@ -881,8 +902,6 @@ void CEventQueue::Dump( void )
 			pe->m_VariantValue.String(),
 			pe->m_pActivator ? pe->m_pActivator->GetDebugName() : "None", 
 			pe->m_pCaller ? pe->m_pCaller->GetDebugName() : "None"  );
-
-		pe = next;
 	}
 
 	Msg("Finished dump.\n");
@@ -944,44 +963,217 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 
 
 //-----------------------------------------------------------------------------
-// Purpose: private function, adds an event into the list
-// Input  : *newEvent - the (already built) event to add
+// Event chains: intrusive lists of the events posted by, or sent directly to,
+// a given entity handle. The chain heads live in a hash table keyed on the
+// handle so CancelEvents/CancelEventOn/HasEventPending only touch those events.
 //-----------------------------------------------------------------------------
-void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
+typedef EventQueuePrioritizedEvent_t *EventQueuePrioritizedEvent_t::*EventChainLink_t;
+
+static void LinkEventChain( CUtlHashtable< int, EventQueuePrioritizedEvent_t * > &chains, int iKey, EventQueuePrioritizedEvent_t *pe, EventChainLink_t pNext, EventChainLink_t pPrev )
+{
+	UtlHashHandle_t h = chains.Find( iKey );
+	EventQueuePrioritizedEvent_t *pHead = ( h != chains.InvalidHandle() ) ? chains.Element( h ) : NULL;
+
+	pe->*pNext = pHead;
+	pe->*pPrev = NULL;
+	if ( pHead )
+	{
+		pHead->*pPrev = pe;
+		chains.Element( h ) = pe;
+	}
+	else
+	{
+		chains.Insert( iKey, pe );
+	}
+}
+
+static void UnlinkEventChain( CUtlHashtable< int, EventQueuePrioritizedEvent_t * > &chains, int iKey, EventQueuePrioritizedEvent_t *pe, EventChainLink_t pNext, EventChainLink_t pPrev )
 {
-	// loop through the actions looking for a place to insert
-	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	if ( pe->*pNext )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
+		(pe->*pNext)->*pPrev = pe->*pPrev;
+	}
+
+	if ( pe->*pPrev )
+	{
+		(pe->*pPrev)->*pNext = pe->*pNext;
+	}
+	else
+	{
+		UtlHashHandle_t h = chains.Find( iKey );
+		Assert( h != chains.InvalidHandle() && chains.Element( h ) == pe );
+		if ( pe->*pNext )
+		{
+			chains.Element( h ) = pe->*pNext;
+		}
+		else
 		{
+			chains.RemoveByHandle( h );
+		}
+	}
+
+	pe->*pNext = NULL;
+	pe->*pPrev = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: queue ordering, earliest fire time first and first-in first-out
+//			among events due at the same time
+//-----------------------------------------------------------------------------
+bool CEventQueue::FiresBefore( const EventQueuePrioritizedEvent_t *a, const EventQueuePrioritizedEvent_t *b )
+{
+	if ( a->m_flFireTime != b->m_flFireTime )
+		return a->m_flFireTime < b->m_flFireTime;
+	return a->m_nSequence < b->m_nSequence;
+}
+
+void CEventQueue::HeapSet( int iIndex, EventQueuePrioritizedEvent_t *pe )
+{
+	m_Heap[iIndex] = pe;
+	pe->m_iHeapIndex = iIndex;
+}
+
+void CEventQueue::HeapSiftUp( int iIndex )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Heap[iIndex];
+	while ( iIndex > 0 )
+	{
+		int iParent = ( iIndex - 1 ) >> 1;
+		if ( !FiresBefore( pe, m_Heap[iParent] ) )
+			break;
+
+		HeapSet( iIndex, m_Heap[iParent] );
+		iIndex = iParent;
+	}
+	HeapSet( iIndex, pe );
+}
+
+void CEventQueue::HeapSiftDown( int iIndex )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Heap[iIndex];
+	int nCount = m_Heap.Count();
+	for ( ;; )
+	{
+		int iChild = iIndex * 2 + 1;
+		if ( iChild >= nCount )
 			break;
+
+		if ( iChild + 1 < nCount && FiresBefore( m_Heap[iChild + 1], m_Heap[iChild] ) )
+		{
+			++iChild;
 		}
+
+		if ( !FiresBefore( m_Heap[iChild], pe ) )
+			break;
+
+		HeapSet( iIndex, m_Heap[iChild] );
+		iIndex = iChild;
 	}
+	HeapSet( iIndex, pe );
+}
 
-	Assert( pe );
+//-----------------------------------------------------------------------------
+// Purpose: private function, adds an event into the queue
+// Input  : *newEvent - the (already built) event to add
+//-----------------------------------------------------------------------------
+void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
+{
+	newEvent->m_pInputDataMap = NULL;
+	newEvent->m_pInputDesc = NULL;
+	newEvent->m_nSequence = m_nNextSequence++;
+	newEvent->m_pNextForCaller = newEvent->m_pPrevForCaller = NULL;
+	newEvent->m_pNextForTarget = newEvent->m_pPrevForTarget = NULL;
+
+	HeapSet( m_Heap.AddToTail(), newEvent );
+	HeapSiftUp( newEvent->m_iHeapIndex );
+
+	if ( newEvent->m_pCaller.IsValid() )
+	{
+		LinkEventChain( m_CallerChains, newEvent->m_pCaller.ToInt(), newEvent, &EventQueuePrioritizedEvent_t::m_pNextForCaller, &EventQueuePrioritizedEvent_t::m_pPrevForCaller );
+	}
 
-	// insert
-	newEvent->m_pNext = pe->m_pNext;
-	newEvent->m_pPrev = pe;
-	pe->m_pNext = newEvent;
-	if ( newEvent->m_pNext )
+	if ( newEvent->m_pEntTarget.IsValid() )
 	{
-		newEvent->m_pNext->m_pPrev = newEvent;
+		LinkEventChain( m_TargetChains, newEvent->m_pEntTarget.ToInt(), newEvent, &EventQueuePrioritizedEvent_t::m_pNextForTarget, &EventQueuePrioritizedEvent_t::m_pPrevForTarget );
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: takes an event out of the queue and its chains, doesn't free it.
+//			Safe to call on an event that has already been removed.
+//-----------------------------------------------------------------------------
 void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
 {
-	Assert( pe->m_pPrev );
-	pe->m_pPrev->m_pNext = pe->m_pNext;
-	if ( pe->m_pNext )
+	int iIndex = pe->m_iHeapIndex;
+	if ( iIndex < 0 )
+		return;
+
+	Assert( m_Heap[iIndex] == pe );
+	pe->m_iHeapIndex = -1;
+
+	EventQueuePrioritizedEvent_t *pLast = m_Heap.Tail();
+	m_Heap.RemoveMultipleFromTail( 1 );
+	if ( pLast != pe )
+	{
+		HeapSet( iIndex, pLast );
+		if ( iIndex > 0 && FiresBefore( pLast, m_Heap[( iIndex - 1 ) >> 1] ) )
+		{
+			HeapSiftUp( iIndex );
+		}
+		else
+		{
+			HeapSiftDown( iIndex );
+		}
+	}
+
+	if ( pe->m_pCaller.IsValid() )
+	{
+		UnlinkEventChain( m_CallerChains, pe->m_pCaller.ToInt(), pe, &EventQueuePrioritizedEvent_t::m_pNextForCaller, &EventQueuePrioritizedEvent_t::m_pPrevForCaller );
+	}
+
+	if ( pe->m_pEntTarget.IsValid() )
+	{
+		UnlinkEventChain( m_TargetChains, pe->m_pEntTarget.ToInt(), pe, &EventQueuePrioritizedEvent_t::m_pNextForTarget, &EventQueuePrioritizedEvent_t::m_pPrevForTarget );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: frees a removed event, unless ServiceEvents is still dispatching it
+//			(an input handler cancelled its own event); it frees that one itself.
+//-----------------------------------------------------------------------------
+void CEventQueue::FreeEvent( EventQueuePrioritizedEvent_t *pe )
+{
+	Assert( pe->m_iHeapIndex < 0 );
+	if ( pe != m_pServicingEvent )
 	{
-		pe->m_pNext->m_pPrev = pe->m_pPrev;
+		delete pe;
 	}
 }
 
 
+ConVar eventqueue_resolve_inputs( "eventqueue_resolve_inputs", "1", 0, "Queued events look up their input once per target class instead of by name on every target." );
+
+//-----------------------------------------------------------------------------
+// Purpose: pumps a queued event's input into one of its targets
+//-----------------------------------------------------------------------------
+static void DispatchEventInput( EventQueuePrioritizedEvent_t *pe, CBaseEntity *pTarget )
+{
+	if ( !eventqueue_resolve_inputs.GetBool() )
+	{
+		pTarget->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+		return;
+	}
+
+	datamap_t *pMap = pTarget->GetDataDescMap();
+	if ( pe->m_pInputDataMap != pMap )
+	{
+		pe->m_pInputDataMap = pMap;
+		pe->m_pInputDesc = CBaseEntity::FindInputDesc( pMap, STRING(pe->m_iTargetInput) );
+	}
+
+	pTarget->AcceptResolvedInput( pe->m_pInputDesc, STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: fires off any events in the queue who's fire time is (or before) the present time
 //-----------------------------------------------------------------------------
@@ -992,16 +1184,18 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-
 #ifdef TF_DLL
-	while ( pe != NULL && pe->m_flFireTime <= engine->GetServerTime() )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= engine->GetServerTime() )
 #else
-	while ( pe != NULL && pe->m_flFireTime <= gpGlobals->curtime )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= gpGlobals->curtime )
 #endif
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		// the event stays queued while it is dispatched so HasEventPending still sees it
+		EventQueuePrioritizedEvent_t *pe = m_Heap[0];
+		m_pServicingEvent = pe;
+
 		bool targetFound = false;
 
 		// find the targets
@@ -1017,7 +1211,7 @@ void CEventQueue::ServiceEvents( void )
 					break;
 
 				// pump the action into the target
-				target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+				DispatchEventInput( pe, target );
 				targetFound = true;
 			}
 		}
@@ -1025,7 +1219,7 @@ void CEventQueue::ServiceEvents( void )
 		// direct pointer
 		if ( pe->m_pEntTarget != NULL )
 		{
-			pe->m_pEntTarget->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+			DispatchEventInput( pe, pe->m_pEntTarget );
 			targetFound = true;
 		}
 
@@ -1042,7 +1236,7 @@ void CEventQueue::ServiceEvents( void )
 						break;
 
 					// pump the action into the target
-					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+					DispatchEventInput( pe, target );
 					targetFound = true;
 				}
 			}
@@ -1065,9 +1259,10 @@ void CEventQueue::ServiceEvents( void )
 			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 		}
 
-		// remove the event from the list (remembering that the queue may have been added to)
+		// remove the event from the queue (it may already be gone if an input cancelled it)
+		m_pServicingEvent = NULL;
 		RemoveEvent( pe );
-		delete pe;
+		FreeEvent( pe );
 
 		//
 		// If we are in debug mode, exit the loop if we have fired the correct number of events.
@@ -1079,9 +1274,6 @@ void CEventQueue::ServiceEvents( void )
 				break;
 			}
 		}
-
-		// restart the list (to catch any new items have probably been added to the queue)
-		pe = m_Events.m_pNext;	
 	}
 }
 
@@ -1109,30 +1301,21 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 	if (!pCaller)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	UtlHashHandle_t h = m_CallerChains.Find( pCaller->GetRefEHandle().ToInt() );
+	if ( h == m_CallerChains.InvalidHandle() )
+		return;
+
+	EventQueuePrioritizedEvent_t *pCur = m_CallerChains.Element( h );
 
 	while (pCur != NULL)
 	{
-		bool bDelete = false;
-		if (pCur->m_pCaller == pCaller)
-		{
-			// Pointers match; make sure everything else matches.
-			if (!stricmp(STRING(pCur->m_pCaller->GetEntityName()), STRING(pCaller->GetEntityName())) &&
-				!stricmp(pCur->m_pCaller->GetClassname(), pCaller->GetClassname()))
-			{
-				// Found a matching event; delete it from the queue.
-				bDelete = true;
-			}
-		}
-
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextForCaller;
 
-		if (bDelete)
-		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
-		}
+		// Found a matching event; delete it from the queue.
+		Assert( pCurSave->m_pCaller == pCaller );
+		RemoveEvent( pCurSave );
+		FreeEvent( pCurSave );
 	}
 }
 
@@ -1147,27 +1330,22 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 	if (!pTarget)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	UtlHashHandle_t h = m_TargetChains.Find( pTarget->GetRefEHandle().ToInt() );
+	if ( h == m_TargetChains.InvalidHandle() )
+		return;
+
+	EventQueuePrioritizedEvent_t *pCur = m_TargetChains.Element( h );
 
 	while (pCur != NULL)
 	{
-		bool bDelete = false;
-		if (pCur->m_pEntTarget == pTarget)
-		{
-			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
-			{
-				// Found a matching event; delete it from the queue.
-				bDelete = true;
-			}
-		}
-
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextForTarget;
 
-		if (bDelete)
+		if ( !Q_strncmp( STRING(pCurSave->m_iTargetInput), sInputName, strlen(sInputName) ) )
 		{
+			// Found a matching event; delete it from the queue.
 			RemoveEvent( pCurSave );
-			delete pCurSave;
+			FreeEvent( pCurSave );
 		}
 	}
 }
@@ -1182,20 +1360,17 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 	if (!pTarget)
 		return false;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
-
-	while (pCur != NULL)
-	{
-		if (pCur->m_pEntTarget == pTarget)
-		{
-			if ( !sInputName )
-				return true;
+	UtlHashHandle_t h = m_TargetChains.Find( pTarget->GetRefEHandle().ToInt() );
+	if ( h == m_TargetChains.InvalidHandle() )
+		return false;
 
-			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
-				return true;
-		}
+	if ( !sInputName )
+		return true;
 
-		pCur = pCur->m_pNext;
+	for ( EventQueuePrioritizedEvent_t *pCur = m_TargetChains.Element( h ); pCur != NULL; pCur = pCur->m_pNextForTarget )
+	{
+		if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
+			return true;
 	}
 
 	return false;
@@ -1230,29 +1405,27 @@ BEGIN_SIMPLE_DATADESC( EventQueuePrioritizedEvent_t )
 	DEFINE_FIELD( m_iOutputID, FIELD_INTEGER ),
 	DEFINE_CUSTOM_FIELD( m_VariantValue, variantFuncs ),
 
-//	DEFINE_FIELD( m_pNext, FIELD_??? ),
-//	DEFINE_FIELD( m_pPrev, FIELD_??? ),
+//	DEFINE_FIELD( m_nSequence, FIELD_INTEGER ),	// rebuilt from the save order on restore
+//	DEFINE_FIELD( m_iHeapIndex, FIELD_INTEGER ),
 END_DATADESC()
 
 
 int CEventQueue::Save( ISave &save )
 {
-	// count the number of items in the queue
-	EventQueuePrioritizedEvent_t *pe;
+	// save in fire order, restore re-adds them in sequence which keeps same-time events in order
+	CUtlVector< EventQueuePrioritizedEvent_t * > events;
+	GetEventsInFireOrder( events );
 
-	m_iListCount = 0;
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
-	{
-		m_iListCount++;
-	}
+	m_iListCount = events.Count();
 
 	// save that value out to disk, so we know how many to restore
 	if ( !save.WriteFields( "EventQueue", this, NULL, m_DataMap.dataDesc, m_DataMap.dataNumFields ) )
 		return 0;
 	
 	// cycle through all the events, saving them all
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
+		EventQueuePrioritizedEvent_t *pe = events[i];
 		if ( !save.WriteFields( "PEvent", pe, NULL, pe->m_DataMap.dataDesc, pe->m_DataMap.dataNumFields ) )
 			return 0;
 	}
@@ -11,6 +11,8 @@
 #include "igamesystem.h"
 #include "collisionutils.h"
 #include "UtlSortVector.h"
+#include "utlhashtable.h"
+#include "tier1/generichash.h"
 #include "tier0/vprof.h"
 #include "mapentities.h"
 #include "client.h"
@@ -33,6 +35,125 @@ static CUtlVector<IServerNetworkable*> g_DeleteList;
 CGlobalEntityList gEntList;
 CBaseEntityList *g_pEntityList = &gEntList;
 
+//-----------------------------------------------------------------------------
+// Name/classname lookup index. Maps the caseless hash of a name to the entity
+// slots carrying it, kept sorted by creation order so indexed searches return
+// matches in the same order as a walk of the active entity list.
+//-----------------------------------------------------------------------------
+struct EntityNameIndexSlot_t
+{
+	unsigned int	m_nOrder;		// creation order, increases along the active list
+	string_t		m_iszName;		// name/classname the slot is currently indexed under
+	string_t		m_iszClassname;
+};
+
+static EntityNameIndexSlot_t s_EntityNameIndexSlots[NUM_ENT_ENTRIES];
+static unsigned int s_nEntityNameIndexOrder;
+
+class CEntityNameIndex
+{
+public:
+	void Insert( string_t iszName, int iSlot )
+	{
+		if ( iszName == NULL_STRING )
+			return;
+
+		unsigned int nHash = HashStringCaseless( STRING( iszName ) );
+		UtlHashHandle_t h = m_BucketLookup.Find( nHash );
+		if ( h == m_BucketLookup.InvalidHandle() )
+		{
+			h = m_BucketLookup.Insert( nHash, m_Buckets.AddToTail() );
+		}
+
+		// New entities have the highest order, so this is almost always an append
+		CUtlVector<int> &bucket = m_Buckets[ m_BucketLookup.Element( h ) ];
+		int nInsert = LowerBound( bucket, s_EntityNameIndexSlots[iSlot].m_nOrder );
+		bucket.InsertBefore( nInsert, iSlot );
+	}
+
+	void Remove( string_t iszName, int iSlot )
+	{
+		if ( iszName == NULL_STRING )
+			return;
+
+		CUtlVector<int> *pBucket = Find( STRING( iszName ) );
+		if ( !pBucket )
+			return;
+
+		int nIndex = LowerBound( *pBucket, s_EntityNameIndexSlots[iSlot].m_nOrder );
+		if ( nIndex < pBucket->Count() && pBucket->Element( nIndex ) == iSlot )
+		{
+			pBucket->Remove( nIndex );
+		}
+		else
+		{
+			Assert( 0 );
+			pBucket->FindAndRemove( iSlot );
+		}
+	}
+
+	CUtlVector<int> *Find( const char *pszName )
+	{
+		UtlHashHandle_t h = m_BucketLookup.Find( HashStringCaseless( pszName ) );
+		if ( h == m_BucketLookup.InvalidHandle() )
+			return NULL;
+		return &m_Buckets[ m_BucketLookup.Element( h ) ];
+	}
+
+	void Purge()
+	{
+		m_BucketLookup.Purge();
+		for ( int i = 0; i < m_Buckets.Count(); i++ )
+		{
+			m_Buckets[i].Purge();
+		}
+		m_Buckets.Purge();
+	}
+
+	// Index of the first slot in the bucket created after nOrder
+	static int UpperBound( const CUtlVector<int> &bucket, unsigned int nOrder )
+	{
+		int nLow = 0, nHigh = bucket.Count();
+		while ( nLow < nHigh )
+		{
+			int nMid = ( nLow + nHigh ) >> 1;
+			if ( s_EntityNameIndexSlots[ bucket[nMid] ].m_nOrder <= nOrder )
+				nLow = nMid + 1;
+			else
+				nHigh = nMid;
+		}
+		return nLow;
+	}
+
+private:
+	static int LowerBound( const CUtlVector<int> &bucket, unsigned int nOrder )
+	{
+		int nLow = 0, nHigh = bucket.Count();
+		while ( nLow < nHigh )
+		{
+			int nMid = ( nLow + nHigh ) >> 1;
+			if ( s_EntityNameIndexSlots[ bucket[nMid] ].m_nOrder < nOrder )
+				nLow = nMid + 1;
+			else
+				nHigh = nMid;
+		}
+		return nLow;
+	}
+
+	CUtlHashtable< unsigned int, int >	m_BucketLookup;
+	CUtlVector< CUtlVector<int> >		m_Buckets;
+};
+
+static CEntityNameIndex s_EntityNameIndex;
+static CEntityNameIndex s_EntityClassnameIndex;
+
+static ConVar ent_find_use_index( "ent_find_use_index", "1", 0, "Use the hashed name/classname index for entity searches that don't use wildcards." );
+
+static bool CanUseEntityNameIndex( const char *szName )
+{
+	return ent_find_use_index.GetBool() && szName[0] != '\0' && szName[0] != '!' && !V_strchr( szName, '*' );
+}
+
 class CAimTargetManager : public IEntityListener
 {
 public:
@@ -127,12 +248,37 @@ void AimTarget_ForceRepopulateList()
 // NOTE: This is usually a small subset of the global entity list, so it's
 // an optimization to maintain this list incrementally rather than polling each
 // frame.
+//
+// Entries waiting on a future think tick are also filed in a two level timer
+// wheel: 256 one-tick slots, then 64 slots of 256 ticks each, then an overflow
+// list. Advancing the wheel moves entries whose tick has come onto the due list,
+// so each frame only touches the due entries instead of every thinker.
 struct simthinkentry_t
 {
 	unsigned short	entEntry;
 	unsigned short	unused0;
 	int				nextThinkTick;
 };
+
+static ConVar sv_think_wheel( "sv_think_wheel", "1", 0, "Find due thinkers through a timer wheel instead of checking every thinking entity each tick." );
+
+#define THINK_WHEEL_L0_BITS		8
+#define THINK_WHEEL_L1_BITS		6
+#define THINK_WHEEL_L0_SLOTS	( 1 << THINK_WHEEL_L0_BITS )
+#define THINK_WHEEL_L1_SLOTS	( 1 << THINK_WHEEL_L1_BITS )
+#define THINK_WHEEL_SPAN_BITS	( THINK_WHEEL_L0_BITS + THINK_WHEEL_L1_BITS )
+
+enum
+{
+	THINK_BUCKET_L0 = 0,
+	THINK_BUCKET_L1 = THINK_BUCKET_L0 + THINK_WHEEL_L0_SLOTS,
+	THINK_BUCKET_OVERFLOW = THINK_BUCKET_L1 + THINK_WHEEL_L1_SLOTS,
+	THINK_BUCKET_DUE,
+
+	THINK_BUCKET_COUNT,
+	THINK_BUCKET_NONE = 0xFFFF,
+};
+
 class CSimThinkManager : public IEntityListener
 {
 public:
@@ -146,7 +292,13 @@ public:
 		for ( int i = 0; i < ARRAYSIZE(m_entinfoIndex); i++ )
 		{
 			m_entinfoIndex[i] = 0xFFFF;
+			m_wheelBucket[i] = THINK_BUCKET_NONE;
+		}
+		for ( int i = 0; i < THINK_BUCKET_COUNT; i++ )
+		{
+			m_wheelHead[i] = 0xFFFF;
 		}
+		m_nWheelTick = 0;
 	}
 	void LevelInitPreEntity()
 	{
@@ -177,6 +329,7 @@ public:
 			Assert(m_simThinkList[listHandle].entEntry == index);
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
+			WheelUnlink( index );
 			
 			// fast remove shifted someone, update that someone
 			if ( listHandle < m_simThinkList.Count() )
@@ -192,24 +345,33 @@ public:
 
 	int ListCopy( CBaseEntity *pList[], int listMax )
 	{
-		int count = MIN(listMax, ListCount());
-		int out = 0;
+		if ( !sv_think_wheel.GetBool() )
+			return ListCopyAll( pList, listMax );
+
+		VPROF( "CSimThinkManager::ListCopy" );
+
+		WheelAdvance( gpGlobals->tickcount );
+
+		// Hand the due entries out in list order, the order a full sweep visits them in
+		CUtlVectorFixedGrowable< int, 256 > due;
+		for ( int index = m_wheelHead[THINK_BUCKET_DUE]; index != 0xFFFF; index = m_wheelNext[index] )
+		{
+			due.AddToTail( m_entinfoIndex[index] );
+		}
+		due.Sort( DueListCompare );
+
+		int count = MIN( listMax, due.Count() );
 		for ( int i = 0; i < count; i++ )
 		{
-			// only copy out entities that will simulate or think this frame
-			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
-			{
-				Assert(m_simThinkList[i].nextThinkTick>=0);
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
-				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
-			}
+			const simthinkentry_t &entry = m_simThinkList[due[i]];
+			Assert(entry.nextThinkTick>=0 && entry.nextThinkTick <= gpGlobals->tickcount);
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entry.entEntry );
+			pList[i] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert(entry.nextThinkTick==0 || pList[i]->GetFirstThinkTick()==entry.nextThinkTick);
+			Assert( gEntList.IsEntityPtr( pList[i] ) );
 		}
 
-		return out;
+		return count;
 	}
 
 	void EntityChanged( CBaseEntity *pEntity )
@@ -255,12 +417,150 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
 			}
+
+			WheelInsert( index, m_simThinkList[m_entinfoIndex[index]].nextThinkTick );
 		}
 	}
 
 private:
+	// The original sweep: every entry, checked against the current tick
+	int ListCopyAll( CBaseEntity *pList[], int listMax )
+	{
+		int count = MIN(listMax, ListCount());
+		int out = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			// only copy out entities that will simulate or think this frame
+			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			{
+				Assert(m_simThinkList[i].nextThinkTick>=0);
+				int entinfoIndex = m_simThinkList[i].entEntry;
+				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
+				Assert( gEntList.IsEntityPtr( pList[out] ) );
+				out++;
+			}
+		}
+
+		return out;
+	}
+
+	static int __cdecl DueListCompare( const int *pLeft, const int *pRight )
+	{
+		return *pLeft - *pRight;
+	}
+
+	// Files an entry under the bucket for its think tick, relative to the wheel's current tick
+	void WheelInsert( int index, int nTick )
+	{
+		WheelUnlink( index );
+
+		int bucket;
+		if ( nTick < m_nWheelTick )
+		{
+			bucket = THINK_BUCKET_DUE;
+		}
+		else if ( ( nTick >> THINK_WHEEL_L0_BITS ) == ( m_nWheelTick >> THINK_WHEEL_L0_BITS ) )
+		{
+			bucket = THINK_BUCKET_L0 + ( nTick & ( THINK_WHEEL_L0_SLOTS - 1 ) );
+		}
+		else if ( ( nTick >> THINK_WHEEL_SPAN_BITS ) == ( m_nWheelTick >> THINK_WHEEL_SPAN_BITS ) )
+		{
+			bucket = THINK_BUCKET_L1 + ( ( nTick >> THINK_WHEEL_L0_BITS ) & ( THINK_WHEEL_L1_SLOTS - 1 ) );
+		}
+		else
+		{
+			bucket = THINK_BUCKET_OVERFLOW;
+		}
+
+		m_wheelBucket[index] = bucket;
+		m_wheelPrev[index] = 0xFFFF;
+		m_wheelNext[index] = m_wheelHead[bucket];
+		if ( m_wheelHead[bucket] != 0xFFFF )
+		{
+			m_wheelPrev[m_wheelHead[bucket]] = index;
+		}
+		m_wheelHead[bucket] = index;
+	}
+
+	void WheelUnlink( int index )
+	{
+		int bucket = m_wheelBucket[index];
+		if ( bucket == THINK_BUCKET_NONE )
+			return;
+
+		if ( m_wheelPrev[index] != 0xFFFF )
+		{
+			m_wheelNext[m_wheelPrev[index]] = m_wheelNext[index];
+		}
+		else
+		{
+			m_wheelHead[bucket] = m_wheelNext[index];
+		}
+
+		if ( m_wheelNext[index] != 0xFFFF )
+		{
+			m_wheelPrev[m_wheelNext[index]] = m_wheelPrev[index];
+		}
+
+		m_wheelBucket[index] = THINK_BUCKET_NONE;
+	}
+
+	// Re-files every entry of a bucket against the current wheel tick
+	void WheelRefile( int bucket )
+	{
+		int index = m_wheelHead[bucket];
+		while ( index != 0xFFFF )
+		{
+			int next = m_wheelNext[index];
+			WheelInsert( index, m_simThinkList[m_entinfoIndex[index]].nextThinkTick );
+			index = next;
+		}
+	}
+
+	// Moves everything with a think tick at or before nTick onto the due list
+	void WheelAdvance( int nTick )
+	{
+		// Clock went backwards (restore) or jumped further than the wheel spans, re-file everything
+		if ( nTick < m_nWheelTick - 1 || nTick - m_nWheelTick >= ( 1 << THINK_WHEEL_SPAN_BITS ) )
+		{
+			m_nWheelTick = nTick + 1;
+			for ( int i = 0; i < m_simThinkList.Count(); i++ )
+			{
+				WheelInsert( m_simThinkList[i].entEntry, m_simThinkList[i].nextThinkTick );
+			}
+			return;
+		}
+
+		while ( m_nWheelTick <= nTick )
+		{
+			int slot = THINK_BUCKET_L0 + ( m_nWheelTick & ( THINK_WHEEL_L0_SLOTS - 1 ) );
+			++m_nWheelTick;
+			WheelRefile( slot );
+
+			// Entering a new block of level 0 ticks, cascade the matching level 1 slot
+			// (and at the start of a new level 1 span, the overflow list first)
+			if ( ( m_nWheelTick & ( THINK_WHEEL_L0_SLOTS - 1 ) ) == 0 )
+			{
+				if ( ( m_nWheelTick & ( ( 1 << THINK_WHEEL_SPAN_BITS ) - 1 ) ) == 0 )
+				{
+					WheelRefile( THINK_BUCKET_OVERFLOW );
+				}
+				WheelRefile( THINK_BUCKET_L1 + ( ( m_nWheelTick >> THINK_WHEEL_L0_BITS ) & ( THINK_WHEEL_L1_SLOTS - 1 ) ) );
+			}
+		}
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	// timer wheel, intrusive lists threaded through the entity entry index
+	unsigned short m_wheelHead[THINK_BUCKET_COUNT];
+	unsigned short m_wheelNext[NUM_ENT_ENTRIES];
+	unsigned short m_wheelPrev[NUM_ENT_ENTRIES];
+	unsigned short m_wheelBucket[NUM_ENT_ENTRIES];
+	int m_nWheelTick;	// next tick the wheel will advance over
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -382,6 +682,13 @@ void CGlobalEntityList::Clear( void )
 	m_iHighestEnt = 0;
 	m_iNumEnts = 0;
 
+	if ( !FirstEntInfo() )
+	{
+		s_EntityNameIndex.Purge();
+		s_EntityClassnameIndex.Purge();
+		s_nEntityNameIndexOrder = 0;
+	}
+
 	m_bClearingEntities = false;
 }
 
@@ -481,6 +788,28 @@ bool CGlobalEntityList::IsEntityPtr( void *pTest )
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName, IEntityFindFilter *pFilter )
 {
+	if ( CanUseEntityNameIndex( szName ) )
+	{
+		CUtlVector<int> *pBucket = s_EntityClassnameIndex.Find( szName );
+		if ( !pBucket )
+			return NULL;
+
+		int i = pStartEntity ? CEntityNameIndex::UpperBound( *pBucket, s_EntityNameIndexSlots[ pStartEntity->GetRefEHandle().GetEntryIndex() ].m_nOrder ) : 0;
+		for ( ; i < pBucket->Count(); i++ )
+		{
+			CBaseEntity *pEntity = (CBaseEntity *)GetEntInfoPtrByIndex( pBucket->Element( i ) )->m_pEntity;
+			if ( pEntity && pEntity->ClassMatches( szName ) )
+			{
+				if ( pFilter && !pFilter->ShouldFindEntity( pEntity ) )
+					continue;
+
+				return pEntity;
+			}
+		}
+
+		return NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -606,6 +935,28 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	if ( CanUseEntityNameIndex( szName ) )
+	{
+		CUtlVector<int> *pBucket = s_EntityNameIndex.Find( szName );
+		if ( !pBucket )
+			return NULL;
+
+		int i = pStartEntity ? CEntityNameIndex::UpperBound( *pBucket, s_EntityNameIndexSlots[ pStartEntity->GetRefEHandle().GetEntryIndex() ].m_nOrder ) : 0;
+		for ( ; i < pBucket->Count(); i++ )
+		{
+			CBaseEntity *ent = (CBaseEntity *)GetEntInfoPtrByIndex( pBucket->Element( i ) )->m_pEntity;
+			if ( ent && ent->NameMatches( szName ) )
+			{
+				if ( pFilter && !pFilter->ShouldFindEntity( ent ) )
+					continue;
+
+				return ent;
+			}
+		}
+
+		return NULL;
+	}
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -1140,6 +1491,14 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	CBaseEntity *pBaseEnt = static_cast<IServerUnknown*>(pEnt)->GetBaseEntity();
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts++;
+
+	// Slots are appended to the active list, so the order stamp tracks list position
+	EntityNameIndexSlot_t &slot = s_EntityNameIndexSlots[i];
+	slot.m_nOrder = ++s_nEntityNameIndexOrder;
+	slot.m_iszName = pBaseEnt->GetEntityName();
+	slot.m_iszClassname = pBaseEnt->m_iClassname;
+	s_EntityNameIndex.Insert( slot.m_iszName, i );
+	s_EntityClassnameIndex.Insert( slot.m_iszClassname, i );
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
@@ -1174,6 +1533,42 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 		m_iNumEdicts--;
 
 	m_iNumEnts--;
+
+	// Use the indexed strings, the entity is partially destructed by now
+	int iSlot = handle.GetEntryIndex();
+	EntityNameIndexSlot_t &slot = s_EntityNameIndexSlots[iSlot];
+	s_EntityNameIndex.Remove( slot.m_iszName, iSlot );
+	s_EntityClassnameIndex.Remove( slot.m_iszClassname, iSlot );
+	slot.m_iszName = NULL_STRING;
+	slot.m_iszClassname = NULL_STRING;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves an entity between name index buckets after its name or
+//			classname changed.
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::UpdateEntityNameIndex( CBaseEntity *pEntity )
+{
+	if ( !pEntity || GetBaseEntity( pEntity->GetRefEHandle() ) != pEntity )
+		return;
+
+	int iSlot = pEntity->GetRefEHandle().GetEntryIndex();
+	EntityNameIndexSlot_t &slot = s_EntityNameIndexSlots[iSlot];
+
+	string_t iszName = pEntity->GetEntityName();
+	if ( slot.m_iszName != iszName )
+	{
+		s_EntityNameIndex.Remove( slot.m_iszName, iSlot );
+		slot.m_iszName = iszName;
+		s_EntityNameIndex.Insert( iszName, iSlot );
+	}
+
+	if ( slot.m_iszClassname != pEntity->m_iClassname )
+	{
+		s_EntityClassnameIndex.Remove( slot.m_iszClassname, iSlot );
+		slot.m_iszClassname = pEntity->m_iClassname;
+		s_EntityClassnameIndex.Insert( slot.m_iszClassname, iSlot );
+	}
 }
 
 void CGlobalEntityList::NotifyCreateEntity( CBaseEntity *pEnt )
@@ -1193,6 +1588,8 @@ void CGlobalEntityList::NotifySpawn( CBaseEntity *pEnt )
 	if ( !pEnt )
 		return;
 
+	UpdateEntityNameIndex( pEnt );
+
 	//DevMsg(2,"Deleted %s\n", pBaseEnt->GetClassname() );
 	for ( int i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
@@ -1339,9 +1736,73 @@ void CNotifyList::ReportSystemEvent( CBaseEntity *pEntity, notify_system_event_t
 static CNotifyList g_NotifyList;
 INotify *g_pNotify = &g_NotifyList;
 
+static ConVar sv_trigger_broadphase( "sv_trigger_broadphase", "1", 0, "Collect the solids moved by a physics step and test them against triggers in one sweep-and-prune pass." );
+
+//-----------------------------------------------------------------------------
+// A solid that moved inside a deferral scope and still needs its trigger
+// touches resolved.
+// Only the entity's latest move is held; an earlier one is sent to the engine
+// before the entity moves again (see FlushSolidMoved).
+//-----------------------------------------------------------------------------
+struct TouchMovedSolid_t
+{
+	EHANDLE		m_hEntity;
+	Vector		m_vecStartOrigin;
+	Vector		m_vecLastOrigin;
+};
+
+//-----------------------------------------------------------------------------
+// Bounds entry for the trigger broadphase, sorted along x for the sweep
+//-----------------------------------------------------------------------------
+struct TouchBroadphaseBox_t
+{
+	Vector		m_vecMins;
+	Vector		m_vecMaxs;
+	int			m_nIndex;		// into the moved solid or trigger list
+	bool		m_bTrigger;
+};
+
+static int __cdecl TouchBroadphaseBoxCompare( const TouchBroadphaseBox_t *pLeft, const TouchBroadphaseBox_t *pRight )
+{
+	if ( pLeft->m_vecMins.x < pRight->m_vecMins.x )
+		return -1;
+	if ( pLeft->m_vecMins.x > pRight->m_vecMins.x )
+		return 1;
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Collects every trigger the spatial partition has in a box
+//-----------------------------------------------------------------------------
+class CTouchTriggerEnum : public IPartitionEnumerator
+{
+public:
+	CTouchTriggerEnum( CUtlVector<CBaseEntity *> &triggers ) : m_triggers( triggers ) {}
+
+	virtual IterationRetval_t EnumElement( IHandleEntity *pHandleEntity )
+	{
+		CBaseEntity *pTrigger = gEntList.GetBaseEntity( pHandleEntity->GetRefEHandle() );
+		if ( pTrigger && pTrigger->edict() && pTrigger->IsSolidFlagSet( FSOLID_TRIGGER ) )
+		{
+			m_triggers.AddToTail( pTrigger );
+		}
+		return ITERATION_CONTINUE;
+	}
+
+private:
+	CUtlVector<CBaseEntity *> &m_triggers;
+};
+
 class CEntityTouchManager : public IEntityListener
 {
 public:
+	CEntityTouchManager()
+	{
+		m_bResolvingMovedSolids = false;
+		m_nDeferScopes = 0;
+		memset( m_movedSolidIndex, 0xFF, sizeof( m_movedSolidIndex ) );
+	}
+
 	// called by CEntityListSystem
 	void LevelInitPreEntity() 
 	{ 
@@ -1358,6 +1819,8 @@ public:
 	void Clear()
 	{
 		m_updateList.Purge();
+		m_movedSolids.Purge();
+		memset( m_movedSolidIndex, 0xFF, sizeof( m_movedSolidIndex ) );
 	}
 	
 	// IEntityListener
@@ -1378,9 +1841,27 @@ public:
 			return;
 		m_updateList.AddToTail( pEntity );
 	}
+	bool DeferSolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin );
+	void FlushSolidMoved( CBaseEntity *pEntity );
+	void BeginDeferSolidMoved() { ++m_nDeferScopes; }
+	void EndDeferSolidMoved();
 
 private:
+	void ResolveMovedSolids();
+
 	CUtlVector<CBaseEntity *>	m_updateList;
+
+	// Trigger broadphase state
+	CUtlVector<TouchMovedSolid_t>		m_movedSolids;
+	int									m_movedSolidIndex[NUM_ENT_ENTRIES];	// entity slot -> m_movedSolids, -1 if none
+	bool								m_bResolvingMovedSolids;
+	int									m_nDeferScopes;
+	CUtlVector<TouchMovedSolid_t>		m_resolveSolids;
+	CUtlVector<CBaseEntity *>			m_resolveTriggers;
+	CUtlVector<TouchBroadphaseBox_t>	m_resolveBoxes;
+	CUtlVector<int>						m_activeSolids;
+	CUtlVector<int>						m_activeTriggers;
+	CUtlVector<bool>					m_solidNearTrigger;
 };
 
 static CEntityTouchManager g_TouchManager;
@@ -1390,10 +1871,270 @@ void EntityTouch_Add( CBaseEntity *pEntity )
 	g_TouchManager.AddEntity( pEntity );
 }
 
+bool EntityTouch_DeferSolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin )
+{
+	return g_TouchManager.DeferSolidMoved( pEntity, pPrevAbsOrigin );
+}
+
+void EntityTouch_FlushSolidMoved( CBaseEntity *pEntity )
+{
+	g_TouchManager.FlushSolidMoved( pEntity );
+}
+
+void EntityTouch_BeginDeferSolidMoved()
+{
+	g_TouchManager.BeginDeferSolidMoved();
+}
+
+void EntityTouch_EndDeferSolidMoved()
+{
+	g_TouchManager.EndDeferSolidMoved();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Inside a deferral scope, queues a moved solid for the trigger pass
+//			run when the scope ends instead of querying the engine right away.
+//			Returns false if the caller should test it immediately.
+//-----------------------------------------------------------------------------
+bool CEntityTouchManager::DeferSolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin )
+{
+	// Players run trigger touches per usercmd, and anything moved while the
+	// batch is being resolved has missed it, so those go straight to the engine.
+	// Children move with their parent without passing through their own
+	// origin setters, so a held move could not be flushed in time. Outside a
+	// scope thinks and inputs may read touchlinks at any point, so nothing waits.
+	if ( !m_nDeferScopes || !sv_trigger_broadphase.GetBool() || m_bResolvingMovedSolids || pEntity->IsPlayer() || pEntity->IsMarkedForDeletion() || pEntity->GetMoveParent() )
+		return false;
+
+	const Vector &vecAbsOrigin = pEntity->GetAbsOrigin();
+	const Vector &vecFrom = pPrevAbsOrigin ? *pPrevAbsOrigin : vecAbsOrigin;
+
+	int iSlot = pEntity->GetRefEHandle().GetEntryIndex();
+	int iMoved = m_movedSolidIndex[iSlot];
+	if ( iMoved >= 0 && m_movedSolids[iMoved].m_hEntity == pEntity )
+	{
+		TouchMovedSolid_t &moved = m_movedSolids[iMoved];
+
+		// Any move flushes the held one first, so a held entry here means the
+		// entity is being re-tested where it already stands.
+		if ( VectorsAreEqual( vecFrom, moved.m_vecLastOrigin, 0.1f ) && VectorsAreEqual( vecAbsOrigin, moved.m_vecLastOrigin, 0.1f ) )
+			return true;
+
+		// Moved without going through the setters. The held segment's end is
+		// gone, so sweep it from its start to here before testing this move
+		// right away like the engine path would
+		FlushSolidMoved( pEntity );
+		return false;
+	}
+
+	iMoved = m_movedSolids.AddToTail();
+	m_movedSolidIndex[iSlot] = iMoved;
+
+	TouchMovedSolid_t &moved = m_movedSolids[iMoved];
+	moved.m_hEntity = pEntity;
+	moved.m_vecStartOrigin = vecFrom;
+	moved.m_vecLastOrigin = vecAbsOrigin;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Called before an entity's origin, angles or parent change. If it
+//			still has a held move, that move is tested now, while the entity is
+//			where the move left it, so every segment of its path gets its own
+//			sweep and its touches fire in the same order as the direct path.
+//-----------------------------------------------------------------------------
+void CEntityTouchManager::FlushSolidMoved( CBaseEntity *pEntity )
+{
+	if ( !m_movedSolids.Count() )
+		return;
+
+	int iSlot = pEntity->GetRefEHandle().GetEntryIndex();
+	int iMoved = m_movedSolidIndex[iSlot];
+	if ( iMoved < 0 || m_movedSolids[iMoved].m_hEntity != pEntity )
+		return;
+
+	// Clear first: touch callbacks below may move this entity again
+	Vector vecStartOrigin = m_movedSolids[iMoved].m_vecStartOrigin;
+	m_movedSolidIndex[iSlot] = -1;
+
+	if ( !pEntity->edict() || pEntity->IsMarkedForDeletion() || !pEntity->IsSolid() || pEntity->IsSolidFlagSet( FSOLID_TRIGGER ) )
+		return;
+
+	bool bSwept = !VectorsAreEqual( vecStartOrigin, pEntity->GetAbsOrigin(), 0.1f );
+	engine->SolidMoved( pEntity->edict(), pEntity->CollisionProp(), bSwept ? &vecStartOrigin : NULL, CBaseEntity::sm_bAccurateTriggerBboxChecks );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Resolves trigger touches for every solid held by the scope that
+//			just closed. One partition query gathers the triggers near any mover, a
+//			sweep-and-prune pass over x pairs movers with nearby triggers, and
+//			only movers with a candidate trigger go to the engine for the exact
+//			test. Movers that end up near no trigger are left to the end of frame
+//			untouch pass, which ends their stale touches as before.
+//-----------------------------------------------------------------------------
+void CEntityTouchManager::ResolveMovedSolids()
+{
+	VPROF( "CEntityTouchManager::ResolveMovedSolids" );
+
+	// Take the batch; anything moved from inside a touch callback below is
+	// tested immediately instead.
+	m_resolveSolids.Swap( m_movedSolids );
+	m_movedSolids.RemoveAll();
+	m_resolveBoxes.RemoveAll();
+	m_resolveTriggers.RemoveAll();
+
+	Vector vecQueryMins( FLT_MAX, FLT_MAX, FLT_MAX );
+	Vector vecQueryMaxs( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+	int nSolids = m_resolveSolids.Count();
+	for ( int i = 0; i < nSolids; i++ )
+	{
+		TouchMovedSolid_t &moved = m_resolveSolids[i];
+
+		// Entries that were flushed early or superseded no longer own their slot
+		int iSlot = moved.m_hEntity.GetEntryIndex();
+		if ( m_movedSolidIndex[iSlot] != i )
+			continue;
+		m_movedSolidIndex[iSlot] = -1;
+
+		CBaseEntity *pEntity = moved.m_hEntity;
+		if ( !pEntity || pEntity->IsMarkedForDeletion() || !pEntity->edict() )
+			continue;
+		if ( !pEntity->IsSolid() || pEntity->IsSolidFlagSet( FSOLID_TRIGGER ) )
+			continue;
+
+		// Same swept box the engine would test: trigger bounds at the end of
+		// the move, stretched back to where the move started.
+		Vector vecMins, vecMaxs;
+		pEntity->CollisionProp()->WorldSpaceTriggerBounds( &vecMins, &vecMaxs );
+		Vector vecDelta = moved.m_vecStartOrigin - pEntity->GetAbsOrigin();
+
+		TouchBroadphaseBox_t &box = m_resolveBoxes[ m_resolveBoxes.AddToTail() ];
+		VectorMin( vecMins, vecMins + vecDelta, box.m_vecMins );
+		VectorMax( vecMaxs, vecMaxs + vecDelta, box.m_vecMaxs );
+		box.m_nIndex = i;
+		box.m_bTrigger = false;
+
+		VectorMin( vecQueryMins, box.m_vecMins, vecQueryMins );
+		VectorMax( vecQueryMaxs, box.m_vecMaxs, vecQueryMaxs );
+	}
+
+	if ( !m_resolveBoxes.Count() )
+	{
+		m_resolveSolids.RemoveAll();
+		return;
+	}
+
+	// One query for the triggers around all movers
+	CTouchTriggerEnum triggerEnum( m_resolveTriggers );
+	::partition->EnumerateElementsInBox( PARTITION_ENGINE_TRIGGER_EDICTS, vecQueryMins, vecQueryMaxs, false, &triggerEnum );
+
+	for ( int i = 0; i < m_resolveTriggers.Count(); i++ )
+	{
+		TouchBroadphaseBox_t &box = m_resolveBoxes[ m_resolveBoxes.AddToTail() ];
+		m_resolveTriggers[i]->CollisionProp()->WorldSpaceSurroundingBounds( &box.m_vecMins, &box.m_vecMaxs );
+		box.m_nIndex = i;
+		box.m_bTrigger = true;
+	}
+
+	m_solidNearTrigger.SetCount( nSolids );
+	for ( int i = 0; i < nSolids; i++ )
+	{
+		m_solidNearTrigger[i] = false;
+	}
+
+	// Sweep and prune along x; y and z are checked per overlapping pair
+	m_resolveBoxes.Sort( TouchBroadphaseBoxCompare );
+	m_activeSolids.RemoveAll();
+	m_activeTriggers.RemoveAll();
+
+	for ( int i = 0; i < m_resolveBoxes.Count(); i++ )
+	{
+		const TouchBroadphaseBox_t &box = m_resolveBoxes[i];
+
+		for ( int j = m_activeSolids.Count(); --j >= 0; )
+		{
+			if ( m_resolveBoxes[ m_activeSolids[j] ].m_vecMaxs.x < box.m_vecMins.x )
+			{
+				m_activeSolids.FastRemove( j );
+			}
+		}
+		for ( int j = m_activeTriggers.Count(); --j >= 0; )
+		{
+			if ( m_resolveBoxes[ m_activeTriggers[j] ].m_vecMaxs.x < box.m_vecMins.x )
+			{
+				m_activeTriggers.FastRemove( j );
+			}
+		}
+
+		CUtlVector<int> &others = box.m_bTrigger ? m_activeSolids : m_activeTriggers;
+		for ( int j = 0; j < others.Count(); j++ )
+		{
+			const TouchBroadphaseBox_t &other = m_resolveBoxes[ others[j] ];
+			const TouchBroadphaseBox_t &solidBox = box.m_bTrigger ? other : box;
+			const TouchBroadphaseBox_t &triggerBox = box.m_bTrigger ? box : other;
+			if ( m_solidNearTrigger[ solidBox.m_nIndex ] )
+				continue;
+
+			if ( !IsBoxIntersectingBox( solidBox.m_vecMins, solidBox.m_vecMaxs, triggerBox.m_vecMins, triggerBox.m_vecMaxs ) )
+				continue;
+
+			CBaseEntity *pSolid = m_resolveSolids[ solidBox.m_nIndex ].m_hEntity;
+			CBaseEntity *pTrigger = m_resolveTriggers[ triggerBox.m_nIndex ];
+			if ( pSolid == pTrigger || !pSolid->CollisionProp()->ShouldTouchTrigger( pTrigger->GetSolidFlags() ) )
+				continue;
+
+			m_solidNearTrigger[ solidBox.m_nIndex ] = true;
+		}
+
+		( box.m_bTrigger ? m_activeTriggers : m_activeSolids ).AddToTail( i );
+	}
+
+	// Exact tests, in the order the solids first moved
+	m_bResolvingMovedSolids = true;
+	for ( int i = 0; i < nSolids; i++ )
+	{
+		if ( !m_solidNearTrigger[i] )
+			continue;
+
+		// Earlier touch callbacks may have removed or changed this one
+		CBaseEntity *pEntity = m_resolveSolids[i].m_hEntity;
+		if ( !pEntity || pEntity->IsMarkedForDeletion() || !pEntity->IsSolid() || pEntity->IsSolidFlagSet( FSOLID_TRIGGER ) )
+			continue;
+
+		const Vector &vecStartOrigin = m_resolveSolids[i].m_vecStartOrigin;
+		bool bSwept = !VectorsAreEqual( vecStartOrigin, pEntity->GetAbsOrigin(), 0.1f );
+		engine->SolidMoved( pEntity->edict(), pEntity->CollisionProp(), bSwept ? &vecStartOrigin : NULL, CBaseEntity::sm_bAccurateTriggerBboxChecks );
+	}
+	m_bResolvingMovedSolids = false;
+
+	m_resolveSolids.RemoveAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Closes a deferral scope; the outermost one resolves the batch
+//-----------------------------------------------------------------------------
+void CEntityTouchManager::EndDeferSolidMoved()
+{
+	Assert( m_nDeferScopes > 0 );
+	if ( --m_nDeferScopes == 0 && m_movedSolids.Count() )
+	{
+		ResolveMovedSolids();
+	}
+}
+
 
 void CEntityTouchManager::FrameUpdatePostEntityThink()
 {
 	VPROF( "CEntityTouchManager::FrameUpdatePostEntityThink" );
+
+	// Deferral scopes resolve their moves when they close
+	Assert( !m_nDeferScopes && !m_movedSolids.Count() );
+
 	// Loop through all entities again, checking their untouch if flagged to do so
 	
 	int count = m_updateList.Count();
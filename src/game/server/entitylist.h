@@ -112,6 +112,10 @@ public:
 	void NotifyCreateEntity( CBaseEntity *pEnt );
 	void NotifySpawn( CBaseEntity *pEnt );
 	void NotifyRemoveEntity( CBaseHandle hEnt );
+
+	// re-indexes the entity's name and classname for the FindEntityByName/Classname
+	// lookups, call after changing m_iName or m_iClassname on a listed entity
+	void UpdateEntityNameIndex( CBaseEntity *pEntity );
 	// iteration functions
 
 	// returns the next entity after pCurrentEnt;  if pCurrentEnt is NULL, return the first entity
@@ -352,6 +356,11 @@ public:
 extern INotify *g_pNotify;
 
 void EntityTouch_Add( CBaseEntity *pEntity );
+bool EntityTouch_DeferSolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin );
+void EntityTouch_FlushSolidMoved( CBaseEntity *pEntity );
+// Solids moved between these are tested against triggers in one batch at the end
+void EntityTouch_BeginDeferSolidMoved();
+void EntityTouch_EndDeferSolidMoved();
 int AimTarget_ListCount();
 int AimTarget_ListCopy( CBaseEntity *pList[], int listMax );
 void AimTarget_ForceRepopulateList();
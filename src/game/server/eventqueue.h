@@ -15,6 +15,7 @@
 #endif
 
 #include "mempool.h"
+#include "utlhashtable.h"
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -28,8 +29,18 @@ struct EventQueuePrioritizedEvent_t
 
 	variant_t m_VariantValue;	// variable-type parameter
 
-	EventQueuePrioritizedEvent_t *m_pNext;
-	EventQueuePrioritizedEvent_t *m_pPrev;
+	// input looked up for the last target's datamap, reused while targets share a class
+	datamap_t *m_pInputDataMap;
+	const typedescription_t *m_pInputDesc;
+
+	unsigned int m_nSequence;	// insertion order, breaks fire time ties first-in first-out
+	int m_iHeapIndex;			// position in the queue heap, -1 once removed
+
+	// per caller / per target chains, so cancellation doesn't walk the whole queue
+	EventQueuePrioritizedEvent_t *m_pNextForCaller;
+	EventQueuePrioritizedEvent_t *m_pPrevForCaller;
+	EventQueuePrioritizedEvent_t *m_pNextForTarget;
+	EventQueuePrioritizedEvent_t *m_pPrevForTarget;
 
 	DECLARE_SIMPLE_DATADESC();
 
@@ -68,11 +79,26 @@ public:
 
 private:
 
+	typedef CUtlHashtable< int, EventQueuePrioritizedEvent_t * > EventChainTable_t;
+
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
+	void FreeEvent( EventQueuePrioritizedEvent_t *pe );
+
+	// binary heap keyed on fire time, then insertion sequence
+	static bool FiresBefore( const EventQueuePrioritizedEvent_t *a, const EventQueuePrioritizedEvent_t *b );
+	void HeapSiftUp( int iIndex );
+	void HeapSiftDown( int iIndex );
+	void HeapSet( int iIndex, EventQueuePrioritizedEvent_t *pe );
+
+	void GetEventsInFireOrder( CUtlVector< EventQueuePrioritizedEvent_t * > &events );
 
 	DECLARE_SIMPLE_DATADESC();
-	EventQueuePrioritizedEvent_t m_Events;
+	CUtlVector< EventQueuePrioritizedEvent_t * > m_Heap;
+	EventChainTable_t m_CallerChains;	// caller ehandle -> events posted by that caller
+	EventChainTable_t m_TargetChains;	// target ehandle -> events sent directly to that entity
+	EventQueuePrioritizedEvent_t *m_pServicingEvent;	// event currently being dispatched
+	unsigned int m_nNextSequence;
 	int m_iListCount;
 };
 
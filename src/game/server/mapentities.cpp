@@ -19,6 +19,8 @@
 #include "world.h"
 #include "toolframework/iserverenginetools.h"
 #include "vscript_server.h"
+#include "filesystem.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -33,6 +35,157 @@ struct HierarchicalSpawnMapData_t
 static CStringRegistry *g_pClassnameSpawnPriority = NULL;
 extern edict_t *g_pForceAttachEdict;
 
+ConVar sv_parallel_map_entity_parse( "sv_parallel_map_entity_parse", "1", 0, "Pre-parse the entity lump on worker threads and prefetch the models it references during map load" );
+
+//-----------------------------------------------------------------------------
+// What the parallel pre-parse learns about one entity block before the serial
+// create/spawn loop reaches it
+//-----------------------------------------------------------------------------
+struct MapEntityRecord_t
+{
+	const char		*m_pMapData;			// just past the opening brace
+	IEntityFactory	*m_pFactory;
+	bool			m_bHasClassName;
+	char			m_szClassName[64];
+	char			m_szModel[MAX_PATH];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds where each top level entity block starts with a raw scan for
+//			braces outside of quotes and comments. Records are only hints; the
+//			serial loop still tokenizes and ignores records it doesn't land on.
+//-----------------------------------------------------------------------------
+static void MapEntity_SplitEntityLump( const char *pMapData, CUtlVector<MapEntityRecord_t> &records )
+{
+	int nDepth = 0;
+	for ( const char *p = pMapData; *p; ++p )
+	{
+		if ( *p == '\"' )
+		{
+			p = strchr( p + 1, '\"' );
+			if ( !p )
+				break;
+		}
+		else if ( *p == '/' && p[1] == '/' )
+		{
+			p = strchr( p, '\n' );
+			if ( !p )
+				break;
+		}
+		else if ( *p == '{' )
+		{
+			if ( nDepth++ == 0 )
+			{
+				MapEntityRecord_t &record = records[ records.AddToTail() ];
+				record.m_pMapData = p + 1;
+			}
+		}
+		else if ( *p == '}' && nDepth > 0 )
+		{
+			nDepth--;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Worker thread pass: pulls the classname and model out of one entity
+//			block and resolves the classname's factory
+//-----------------------------------------------------------------------------
+static void MapEntity_PreparseRecord( MapEntityRecord_t &record )
+{
+	record.m_pFactory = NULL;
+	record.m_bHasClassName = false;
+	record.m_szClassName[0] = 0;
+	record.m_szModel[0] = 0;
+
+	char szKey[MAPKEY_MAXLENGTH];
+	char szValue[MAPKEY_MAXLENGTH];
+	const char *pData = record.m_pMapData;
+	while ( pData )
+	{
+		pData = MapEntity_ParseToken( pData, szKey );
+		if ( szKey[0] == '}' )
+			break;
+
+		pData = MapEntity_ParseToken( pData, szValue );
+
+		// first key wins, as with MapEntity_ExtractValue
+		if ( !record.m_bHasClassName && !Q_strcmp( szKey, "classname" ) )
+		{
+			// Too long to be a real class; let the serial loop report it
+			if ( Q_strlen( szValue ) >= sizeof( record.m_szClassName ) )
+				return;
+
+			Q_strncpy( record.m_szClassName, szValue, sizeof( record.m_szClassName ) );
+			record.m_bHasClassName = true;
+		}
+		else if ( !record.m_szModel[0] && !Q_strcmp( szKey, "model" ) && szValue[0] != '*' )
+		{
+			Q_strncpy( record.m_szModel, szValue, sizeof( record.m_szModel ) );
+		}
+	}
+
+	if ( record.m_bHasClassName )
+	{
+		record.m_pFactory = EntityFactoryDictionary()->FindFactory( record.m_szClassName );
+	}
+}
+
+static void MapEntity_OnModelPrefetched( const FileAsyncRequest_t &request, int nBytesRead, FSAsyncStatus_t err )
+{
+	delete [] (char *)request.pContext;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Queues background reads of the studio model files the map uses so
+//			the file system has them on hand by the time Precache() asks
+//-----------------------------------------------------------------------------
+static void MapEntity_PrefetchModels( const CUtlVector<MapEntityRecord_t> &records )
+{
+	static const char *s_pModelExtensions[] = { ".mdl", ".vvd", ".dx90.vtx", ".phy" };
+
+	CUtlDict<int, int> models( k_eDictCompareTypeCaseInsensitive );
+	CUtlVector<FileAsyncRequest_t> requests;
+
+	for ( int i = 0; i < records.Count(); i++ )
+	{
+		const char *pModel = records[i].m_szModel;
+		const char *pExtension = V_GetFileExtension( pModel );
+		if ( !pExtension || Q_stricmp( pExtension, "mdl" ) )
+			continue;
+		if ( models.Find( pModel ) != models.InvalidIndex() )
+			continue;
+		models.Insert( pModel, 0 );
+
+		char szBase[MAX_PATH];
+		Q_StripExtension( pModel, szBase, sizeof( szBase ) );
+		for ( int j = 0; j < ARRAYSIZE( s_pModelExtensions ); j++ )
+		{
+			char szFileName[MAX_PATH];
+			Q_snprintf( szFileName, sizeof( szFileName ), "%s%s", szBase, s_pModelExtensions[j] );
+
+			// Missing files (models without physics, say) just fail quietly in the background.
+			// The name stays alive until the read completes.
+			char *pFileName = V_strdup( szFileName );
+
+			FileAsyncRequest_t &request = requests[ requests.AddToTail() ];
+			request.pszFilename = pFileName;
+			request.pszPathID = "GAME";
+			request.pfnCallback = MapEntity_OnModelPrefetched;
+			request.pContext = pFileName;
+			request.flags = FSASYNC_FLAGS_FREEDATAPTR;
+			request.priority = 0;
+		}
+	}
+
+	if ( requests.Count() )
+	{
+		g_pFullFileSystem->AsyncReadMultiple( requests.Base(), requests.Count() );
+	}
+}
+
+static const char *MapEntity_ParseEntity( CBaseEntity *&pEntity, const char *pEntData, IMapEntityFilter *pFilter, const MapEntityRecord_t *pRecord );
+
 // creates an entity by string name, but does not spawn it
 CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
 {
@@ -332,6 +485,25 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 		pMapData = serverenginetools->GetEntityData( pMapData );
 	}
 
+	// Pre-parse the entity blocks in parallel and start the model reads, so only creation,
+	// keyvalues, spawn and activate are left for the serial loop below
+	CUtlVector<MapEntityRecord_t> records;
+	int iNextRecord = 0;
+	if ( sv_parallel_map_entity_parse.GetBool() && pMapData )
+	{
+		VPROF( "MapEntity_ParseAllEntities_Preparse" );
+
+		MapEntity_SplitEntityLump( pMapData, records );
+		if ( records.Count() )
+		{
+			// Builds the tokenizer's lazily initialized brace table before the workers share it
+			MapEntity_ParseToken( pMapData, szTokenBuffer );
+
+			ParallelProcess( "MapEntity_PreparseRecord", records.Base(), records.Count(), &MapEntity_PreparseRecord );
+			MapEntity_PrefetchModels( records );
+		}
+	}
+
 	//  Loop through all entities in the map data, creating each.
 	for ( ; true; pMapData = MapEntity_SkipToNextEntity(pMapData, szTokenBuffer) )
 	{
@@ -358,7 +530,18 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 		//
 		CBaseEntity *pEntity;
 		const char *pCurMapData = pMapData;
-		pMapData = MapEntity_ParseEntity(pEntity, pMapData, pFilter);
+
+		const MapEntityRecord_t *pRecord = NULL;
+		while ( iNextRecord < records.Count() && records[iNextRecord].m_pMapData < pCurMapData )
+		{
+			iNextRecord++;
+		}
+		if ( iNextRecord < records.Count() && records[iNextRecord].m_pMapData == pCurMapData )
+		{
+			pRecord = &records[iNextRecord++];
+		}
+
+		pMapData = MapEntity_ParseEntity(pEntity, pMapData, pFilter, pRecord);
 		if (pEntity == NULL)
 			continue;
 
@@ -553,11 +736,24 @@ void MapEntity_PrecacheEntity( const char *pEntData, int &nStringSize )
 // Output : Returns the current position in the entity data block.
 //-----------------------------------------------------------------------------
 const char *MapEntity_ParseEntity(CBaseEntity *&pEntity, const char *pEntData, IMapEntityFilter *pFilter)
+{
+	return MapEntity_ParseEntity( pEntity, pEntData, pFilter, NULL );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: As above, reusing the classname and factory the parallel pre-parse
+//			found for this block when there is one
+//-----------------------------------------------------------------------------
+static const char *MapEntity_ParseEntity(CBaseEntity *&pEntity, const char *pEntData, IMapEntityFilter *pFilter, const MapEntityRecord_t *pRecord)
 {
 	CEntityMapData entData( (char*)pEntData );
 	char className[MAPKEY_MAXLENGTH];
 	
-	if (!entData.ExtractValue("classname", className))
+	if ( pRecord && pRecord->m_bHasClassName )
+	{
+		Q_strncpy( className, pRecord->m_szClassName, sizeof( className ) );
+	}
+	else if (!entData.ExtractValue("classname", className))
 	{
 		Error( "classname missing from entity!\n" );
 	}
@@ -569,9 +765,18 @@ const char *MapEntity_ParseEntity(CBaseEntity *&pEntity, const char *pEntData, I
 		// Construct via the LINK_ENTITY_TO_CLASS factory.
 		//
 		if ( pFilter )
+		{
 			pEntity = pFilter->CreateNextEntity( className );
+		}
+		else if ( pRecord && pRecord->m_pFactory )
+		{
+			IServerNetworkable *pNetwork = pRecord->m_pFactory->Create( className );
+			pEntity = pNetwork ? pNetwork->GetBaseEntity() : NULL;
+		}
 		else
+		{
 			pEntity = CreateEntityByName(className);
+		}
 
 		//
 		// Set up keyvalues.
@@ -766,10 +766,19 @@ void CNavArea::OnDestroyNotify( CNavArea *dead )
 		m_incomingConnect[ d ].FindAndRemove( con );
 	}
 
-	// remove all visibility info, since we're editing the mesh anyways
-	m_inheritVisibilityFrom.area = NULL;
-	m_potentiallyVisibleAreas.RemoveAll();
-	m_isInheritedFrom = false;
+	// keep the rest of our visibility info, so a partial regeneration doesn't have to rebuild it
+	if ( m_inheritVisibilityFrom.area == dead )
+	{
+		ExpandInheritedVisibility();
+	}
+
+	for ( int i=m_potentiallyVisibleAreas.Count()-1; i>=0; --i )
+	{
+		if ( m_potentiallyVisibleAreas[i].area == dead )
+		{
+			m_potentiallyVisibleAreas.FastRemove( i );
+		}
+	}
 }
 
 
@@ -5518,6 +5527,66 @@ void CNavArea::ResetPotentiallyVisibleAreas()
 }
 
 
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Replace our delta list with the full list of areas it describes, so we no longer
+ * depend on the area we inherit from.
+ */
+void CNavArea::ExpandInheritedVisibility( void )
+{
+	CNavArea *anchor = m_inheritVisibilityFrom.area;
+	if ( !anchor )
+		return;
+
+	CAreaBindInfoArray expanded;
+	expanded.EnsureCapacity( anchor->m_potentiallyVisibleAreas.Count() + m_potentiallyVisibleAreas.Count() );
+
+	// our own entries override the anchor's
+	++s_nCurrVisTestCounter;
+	FOR_EACH_VEC( m_potentiallyVisibleAreas, it )
+	{
+		const AreaBindInfo &info = m_potentiallyVisibleAreas[ it ];
+		if ( !info.area )
+			continue;
+
+		info.area->m_nVisTestCounter = s_nCurrVisTestCounter;
+		if ( info.attributes != NOT_VISIBLE )
+		{
+			expanded.AddToTail( info );
+		}
+	}
+
+	FOR_EACH_VEC( anchor->m_potentiallyVisibleAreas, it )
+	{
+		const AreaBindInfo &info = anchor->m_potentiallyVisibleAreas[ it ];
+		if ( !info.area || info.area->m_nVisTestCounter == s_nCurrVisTestCounter )
+			continue;
+
+		if ( info.attributes != NOT_VISIBLE )
+		{
+			expanded.AddToTail( info );
+		}
+	}
+
+	m_potentiallyVisibleAreas = expanded;
+	m_inheritVisibilityFrom.area = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+void CNavArea::RemovePotentiallyVisibleMarkedAreas( void )
+{
+	for ( int i=m_potentiallyVisibleAreas.Count()-1; i>=0; --i )
+	{
+		CNavArea *area = m_potentiallyVisibleAreas[i].area;
+		if ( area && area->IsMarked() )
+		{
+			m_potentiallyVisibleAreas.FastRemove( i );
+		}
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------
 /**
  * Determine visibility between areas.
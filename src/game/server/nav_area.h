@@ -739,6 +739,8 @@ private:
 	//- visibility --------------------------------------------------------------------------------------
 	void ComputeVisibilityToMesh( void );						// compute visibility to surrounding mesh
 	void ResetPotentiallyVisibleAreas();
+	void ExpandInheritedVisibility( void );						// fold our inherited visibility list into our own, and stop inheriting
+	void RemovePotentiallyVisibleMarkedAreas( void );			// remove all marked areas from our visibility list
 	static void ComputeVisToArea( CNavArea *&pOtherArea );
 
 #ifndef _X360
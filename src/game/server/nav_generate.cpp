@@ -17,6 +17,7 @@
 #include "viewport_panel_names.h"
 //#include "terror/TerrorShared.h"
 #include "fmtstr.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "func_simpleladder.h"
@@ -43,6 +44,8 @@ ConVar nav_generate_jump_connections( "nav_generate_jump_connections", "1", FCVA
 ConVar nav_generate_incremental_range( "nav_generate_incremental_range", "2000", FCVAR_CHEAT );
 ConVar nav_generate_incremental_tolerance( "nav_generate_incremental_tolerance", "0", FCVAR_CHEAT, "Z tolerance for adding new nav areas." );
 ConVar nav_area_max_size( "nav_area_max_size", "50", FCVAR_CHEAT, "Max area size created in nav generation" );
+ConVar nav_generate_threaded( "nav_generate_threaded", "1", FCVAR_CHEAT, "Sample walkable space and find area connections on worker threads during nav generation" );
+ConVar nav_generate_tile_size( "nav_generate_tile_size", "1024", FCVAR_CHEAT, "Size of the spatial tiles that threaded nav generation hands to each worker" );
 
 // Common bounding box for traces
 Vector NavTraceMins( -0.45, -0.45, 0 );
@@ -1251,6 +1254,11 @@ void CNavMesh::MarkStairAreas( void )
 	FOR_EACH_VEC( TheNavAreas, it )
 	{
 		CNavArea *area = TheNavAreas[ it ];
+
+		// existing areas have already been tested, and have no nodes to test with
+		if ( m_generationMode == GENERATE_INCREMENTAL && !area->HasNodes() )
+			continue;
+
 		area->TestStairs();
 	}
 }
@@ -1935,154 +1943,191 @@ inline bool CheckCliff( const Vector *fromPos, NavDirType dir, bool bExhaustive
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Define connections between adjacent generated areas
+ * Find the connections between an area and the generated areas adjacent to it
  */
-void CNavMesh::ConnectGeneratedAreas( void )
+void CNavMesh::FindGeneratedAreaConnections( GeneratedAreaConnections &pending )
 {
-	Msg( "Connecting navigation areas...\n" );
+	CNavArea *area = pending.area;
 
-	FOR_EACH_VEC( TheNavAreas, it )
-	{
-		CNavArea *area = TheNavAreas[ it ];
+	// scan along edge nodes, stepping one node over into the next area
+	// for now, only use bi-directional connections
 
-		// scan along edge nodes, stepping one node over into the next area
-		// for now, only use bi-directional connections
+	// north edge
+	CNavNode *node;
+	for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ NORTH_EAST ]; node = node->GetConnectedNode( EAST ) )
+	{
+		CNavNode *adj = node->GetConnectedNode( NORTH );
 
-		// north edge
-		CNavNode *node;
-		for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ NORTH_EAST ]; node = node->GetConnectedNode( EAST ) )
+		if (adj && adj->GetArea() && adj->GetConnectedNode( SOUTH ) == node )
+		{
+			pending.connections.AddToTail( GeneratedAreaConnection( adj->GetArea(), NORTH ) );
+		}
+		else
 		{
-			CNavNode *adj = node->GetConnectedNode( NORTH );
+			CNavArea *downArea = findJumpDownArea( node->GetPosition(), NORTH );
+			if (downArea && downArea != area)
+				pending.connections.AddToTail( GeneratedAreaConnection( downArea, NORTH ) );
+		}
+	}
 
-			if (adj && adj->GetArea() && adj->GetConnectedNode( SOUTH ) == node )
-			{
-				area->ConnectTo( adj->GetArea(), NORTH );
-			}
-			else
-			{
-				CNavArea *downArea = findJumpDownArea( node->GetPosition(), NORTH );
-				if (downArea && downArea != area)
-					area->ConnectTo( downArea, NORTH );
-			}
+	// west edge
+	for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ SOUTH_WEST ]; node = node->GetConnectedNode( SOUTH ) )
+	{
+		CNavNode *adj = node->GetConnectedNode( WEST );
+		
+		if (adj && adj->GetArea() && adj->GetConnectedNode( EAST ) == node )
+		{
+			pending.connections.AddToTail( GeneratedAreaConnection( adj->GetArea(), WEST ) );
 		}
+		else
+		{
+			CNavArea *downArea = findJumpDownArea( node->GetPosition(), WEST );
+			if (downArea && downArea != area)
+				pending.connections.AddToTail( GeneratedAreaConnection( downArea, WEST ) );
+		}
+	}
 
-		// west edge
-		for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ SOUTH_WEST ]; node = node->GetConnectedNode( SOUTH ) )
+	// south edge - this edge's nodes are actually part of adjacent areas
+	// move one node north, and scan west to east
+	/// @todo This allows one-node-wide areas - do we want this?
+	node = area->m_node[ SOUTH_WEST ];
+	if ( node ) // pre-existing areas in incremental generates won't have nodes
+	{
+		node = node->GetConnectedNode( NORTH );
+	}
+	if (node)
+	{
+		CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( NORTH );
+		/// @todo Figure out why cs_backalley gets a NULL node in here...
+		for( ; node && node != end; node = node->GetConnectedNode( EAST ) )
 		{
-			CNavNode *adj = node->GetConnectedNode( WEST );
+			CNavNode *adj = node->GetConnectedNode( SOUTH );
 			
-			if (adj && adj->GetArea() && adj->GetConnectedNode( EAST ) == node )
+			if (adj && adj->GetArea() && adj->GetConnectedNode( NORTH ) == node )
 			{
-				area->ConnectTo( adj->GetArea(), WEST );
+				pending.connections.AddToTail( GeneratedAreaConnection( adj->GetArea(), SOUTH ) );
 			}
 			else
 			{
-				CNavArea *downArea = findJumpDownArea( node->GetPosition(), WEST );
+				CNavArea *downArea = findJumpDownArea( node->GetPosition(), SOUTH );
 				if (downArea && downArea != area)
-					area->ConnectTo( downArea, WEST );
+					pending.connections.AddToTail( GeneratedAreaConnection( downArea, SOUTH ) );
 			}
 		}
+	}
 
-		// south edge - this edge's nodes are actually part of adjacent areas
-		// move one node north, and scan west to east
-		/// @todo This allows one-node-wide areas - do we want this?
-		node = area->m_node[ SOUTH_WEST ];
-		if ( node ) // pre-existing areas in incremental generates won't have nodes
-		{
-			node = node->GetConnectedNode( NORTH );
-		}
-		if (node)
+	// south edge part 2 - scan the actual south edge.  If the node is not part of an adjacent area, then it
+	// really belongs to us.  This will happen if our area runs right up against a ledge.
+	for( node = area->m_node[ SOUTH_WEST ]; node != area->m_node[ SOUTH_EAST ]; node = node->GetConnectedNode( EAST ) )
+	{
+		if ( node->GetArea() )
+			continue;	// some other area owns this node, pay no attention to it
+
+		CNavNode *adj = node->GetConnectedNode( SOUTH );
+
+		if ( node->IsBlockedInAnyDirection() || (adj && adj->IsBlockedInAnyDirection()) )
+			continue;	// The space around this node is blocked, so don't connect across it
+
+		// Don't directly connect to adj's area, since it's already 1 cell removed from our area.
+		// There was no area in between, presumably for good reason.  Only look for jump down links.
+		if ( !adj || !adj->GetArea() )
 		{
-			CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( NORTH );
-			/// @todo Figure out why cs_backalley gets a NULL node in here...
-			for( ; node && node != end; node = node->GetConnectedNode( EAST ) )
-			{
-				CNavNode *adj = node->GetConnectedNode( SOUTH );
-				
-				if (adj && adj->GetArea() && adj->GetConnectedNode( NORTH ) == node )
-				{
-					area->ConnectTo( adj->GetArea(), SOUTH );
-				}
-				else
-				{
-					CNavArea *downArea = findJumpDownArea( node->GetPosition(), SOUTH );
-					if (downArea && downArea != area)
-						area->ConnectTo( downArea, SOUTH );
-				}
-			}
+			CNavArea *downArea = findJumpDownArea( node->GetPosition(), SOUTH );
+			if (downArea && downArea != area)
+				pending.connections.AddToTail( GeneratedAreaConnection( downArea, SOUTH ) );
 		}
+	}
 
-		// south edge part 2 - scan the actual south edge.  If the node is not part of an adjacent area, then it
-		// really belongs to us.  This will happen if our area runs right up against a ledge.
-		for( node = area->m_node[ SOUTH_WEST ]; node != area->m_node[ SOUTH_EAST ]; node = node->GetConnectedNode( EAST ) )
+	// east edge - this edge's nodes are actually part of adjacent areas
+	node = area->m_node[ NORTH_EAST ];
+	if ( node ) // pre-existing areas in incremental generates won't have nodes
+	{
+		node = node->GetConnectedNode( WEST );
+	}
+	if (node)
+	{
+		CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( WEST );
+		for( ; node && node != end; node = node->GetConnectedNode( SOUTH ) )
 		{
-			if ( node->GetArea() )
-				continue;	// some other area owns this node, pay no attention to it
+			CNavNode *adj = node->GetConnectedNode( EAST );			
 
-			CNavNode *adj = node->GetConnectedNode( SOUTH );
-
-			if ( node->IsBlockedInAnyDirection() || (adj && adj->IsBlockedInAnyDirection()) )
-				continue;	// The space around this node is blocked, so don't connect across it
-
-			// Don't directly connect to adj's area, since it's already 1 cell removed from our area.
-			// There was no area in between, presumably for good reason.  Only look for jump down links.
-			if ( !adj || !adj->GetArea() )
+			if (adj && adj->GetArea() && adj->GetConnectedNode( WEST ) == node )
 			{
-				CNavArea *downArea = findJumpDownArea( node->GetPosition(), SOUTH );
+				pending.connections.AddToTail( GeneratedAreaConnection( adj->GetArea(), EAST ) );
+			}
+			else
+			{
+				CNavArea *downArea = findJumpDownArea( node->GetPosition(), EAST );
 				if (downArea && downArea != area)
-					area->ConnectTo( downArea, SOUTH );
+					pending.connections.AddToTail( GeneratedAreaConnection( downArea, EAST ) );
 			}
 		}
+	}
+
+	// east edge part 2 - scan the actual east edge.  If the node is not part of an adjacent area, then it
+	// really belongs to us.  This will happen if our area runs right up against a ledge.
+	for( node = area->m_node[ NORTH_EAST ]; node != area->m_node[ SOUTH_EAST ]; node = node->GetConnectedNode( SOUTH ) )
+	{
+		if ( node->GetArea() )
+			continue;	// some other area owns this node, pay no attention to it
+
+		CNavNode *adj = node->GetConnectedNode( EAST );
 
-		// east edge - this edge's nodes are actually part of adjacent areas
-		node = area->m_node[ NORTH_EAST ];
-		if ( node ) // pre-existing areas in incremental generates won't have nodes
+		if ( node->IsBlockedInAnyDirection() || (adj && adj->IsBlockedInAnyDirection()) )
+			continue;	// The space around this node is blocked, so don't connect across it
+
+		// Don't directly connect to adj's area, since it's already 1 cell removed from our area.
+		// There was no area in between, presumably for good reason.  Only look for jump down links.
+		if ( !adj || !adj->GetArea() )
 		{
-			node = node->GetConnectedNode( WEST );
+			CNavArea *downArea = findJumpDownArea( node->GetPosition(), EAST );
+			if (downArea && downArea != area)
+				pending.connections.AddToTail( GeneratedAreaConnection( downArea, EAST ) );
 		}
-		if (node)
-		{
-			CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( WEST );
-			for( ; node && node != end; node = node->GetConnectedNode( SOUTH ) )
-			{
-				CNavNode *adj = node->GetConnectedNode( EAST );			
+	}
+}
 
-				if (adj && adj->GetArea() && adj->GetConnectedNode( WEST ) == node )
-				{
-					area->ConnectTo( adj->GetArea(), EAST );
-				}
-				else
-				{
-					CNavArea *downArea = findJumpDownArea( node->GetPosition(), EAST );
-					if (downArea && downArea != area)
-						area->ConnectTo( downArea, EAST );
-				}
-			}
-		}
 
-		// east edge part 2 - scan the actual east edge.  If the node is not part of an adjacent area, then it
-		// really belongs to us.  This will happen if our area runs right up against a ledge.
-		for( node = area->m_node[ NORTH_EAST ]; node != area->m_node[ SOUTH_EAST ]; node = node->GetConnectedNode( SOUTH ) )
-		{
-			if ( node->GetArea() )
-				continue;	// some other area owns this node, pay no attention to it
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Define connections between adjacent generated areas
+ */
+void CNavMesh::ConnectGeneratedAreas( void )
+{
+	Msg( "Connecting navigation areas...\n" );
 
-			CNavNode *adj = node->GetConnectedNode( EAST );
+	// Finding connections only reads the node graph and traces the world, so areas are scanned on
+	// worker threads.  The connections are then made in area order, just as a serial scan would.
+	GeneratedAreaConnections *pending = new GeneratedAreaConnections[ MAX( TheNavAreas.Count(), 1 ) ];
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		pending[ it ].area = TheNavAreas[ it ];
+	}
 
-			if ( node->IsBlockedInAnyDirection() || (adj && adj->IsBlockedInAnyDirection()) )
-				continue;	// The space around this node is blocked, so don't connect across it
+	if ( nav_generate_threaded.GetBool() && TheNavAreas.Count() > 1 )
+	{
+		ParallelProcess( "CNavMesh::ConnectGeneratedAreas", pending, TheNavAreas.Count(), &CNavMesh::FindGeneratedAreaConnections );
+	}
+	else
+	{
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			FindGeneratedAreaConnections( pending[ it ] );
+		}
+	}
 
-			// Don't directly connect to adj's area, since it's already 1 cell removed from our area.
-			// There was no area in between, presumably for good reason.  Only look for jump down links.
-			if ( !adj || !adj->GetArea() )
-			{
-				CNavArea *downArea = findJumpDownArea( node->GetPosition(), EAST );
-				if (downArea && downArea != area)
-					area->ConnectTo( downArea, EAST );
-			}
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = pending[ it ].area;
+		FOR_EACH_VEC( pending[ it ].connections, cit )
+		{
+			const GeneratedAreaConnection &con = pending[ it ].connections[ cit ];
+			area->ConnectTo( con.area, con.dir );
 		}
 	}
 
+	delete [] pending;
+
 	StitchGeneratedAreas();
 }
 
@@ -3293,6 +3338,8 @@ int CNavMesh::BuildArea( CNavNode *node, int width, int height )
  */
 void CNavMesh::CreateNavAreasFromNodes( void )
 {
+	double coverStartTime = Plat_FloatTime();
+
 	// haven't yet seen a map use larger than 30...
 	int tryWidth = nav_area_max_size.GetInt();
 	int tryHeight = tryWidth;
@@ -3327,6 +3374,8 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 			break;
 	}
 
+	Msg( "  %-28s %8.2f seconds\n", "CreateNavAreasFromNodes", Plat_FloatTime() - coverStartTime );
+
 	if ( !TheNavAreas.Count() )
 	{
 		// If we somehow have no areas, don't try to create an impossibly-large grid
@@ -3366,16 +3415,16 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 	}
 
 	
-	ConnectGeneratedAreas();
-	MarkPlayerClipAreas();
-	MarkJumpAreas();	// mark jump areas before we merge generated areas, so we don't merge jump and non-jump areas
-	MergeGeneratedAreas();
-	SplitAreasUnderOverhangs();
-	SquareUpAreas();
-	MarkStairAreas();
-	StichAndRemoveJumpAreas();
-	HandleObstacleTopAreas();
-	FixUpGeneratedAreas();
+	RunGenerationPhase( "ConnectGeneratedAreas", &CNavMesh::ConnectGeneratedAreas );
+	RunGenerationPhase( "MarkPlayerClipAreas", &CNavMesh::MarkPlayerClipAreas );
+	RunGenerationPhase( "MarkJumpAreas", &CNavMesh::MarkJumpAreas );	// mark jump areas before we merge generated areas, so we don't merge jump and non-jump areas
+	RunGenerationPhase( "MergeGeneratedAreas", &CNavMesh::MergeGeneratedAreas );
+	RunGenerationPhase( "SplitAreasUnderOverhangs", &CNavMesh::SplitAreasUnderOverhangs );
+	RunGenerationPhase( "SquareUpAreas", &CNavMesh::SquareUpAreas );
+	RunGenerationPhase( "MarkStairAreas", &CNavMesh::MarkStairAreas );
+	RunGenerationPhase( "StichAndRemoveJumpAreas", &CNavMesh::StichAndRemoveJumpAreas );
+	RunGenerationPhase( "HandleObstacleTopAreas", &CNavMesh::HandleObstacleTopAreas );
+	RunGenerationPhase( "FixUpGeneratedAreas", &CNavMesh::FixUpGeneratedAreas );
 
 	/// @TODO: incremental generation doesn't create ladders yet
 	if ( m_generationMode != GENERATE_INCREMENTAL )
@@ -3389,6 +3438,18 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run one pass of area generation and report how long it took
+ */
+void CNavMesh::RunGenerationPhase( const char *name, void (CNavMesh::*phase)( void ) )
+{
+	double startTime = Plat_FloatTime();
+	(this->*phase)();
+	Msg( "  %-28s %8.2f seconds\n", name, Plat_FloatTime() - startTime );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 // adds walkable positions for any/all positions a mod specifies
 void CNavMesh::AddWalkableSeeds( void )
@@ -3439,7 +3500,7 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	// Right now, incrementally-generated areas won't connect to existing areas automatically.
 	// Since this means hand-editing will be necessary, don't do a full analyze.
-	if ( incremental )
+	if ( incremental && !m_isRegionGeneration )
 	{
 		nav_quicksave.SetValue( 1 );
 	}
@@ -3468,6 +3529,9 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	// the system will see this NULL and select the next walkable seed
 	m_currentNode = NULL;
+	m_isSamplingThreaded = nav_generate_threaded.GetBool();
+	m_sampleFrontier.RemoveAll();
+	m_sampleCrouchNodes.RemoveAll();
 
 	// if there are no seed points, we can't generate
 	if (m_walkableSeeds.Count() == 0)
@@ -3482,6 +3546,240 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	Msg( "Generating Navigation Mesh...\n" );
 	m_generationStartTime = Plat_FloatTime();
+	m_sampleStartTime = m_generationStartTime;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Regenerate only the part of the mesh inside 'bounds'.  Areas overlapping the bounds are destroyed
+ * and the space is resampled from their centers and from any walkable seeds inside the bounds.  The
+ * new areas are stitched into the surrounding mesh as in incremental generation.  Only the new areas
+ * and the areas that were connected to the old ones have their hiding spots, visibility and occupy
+ * times recomputed; encounter spots are also recomputed wherever they referred to the region.  The
+ * rest of the mesh keeps its analysis data.
+ */
+void CNavMesh::BeginRegionGeneration( const Extent &bounds )
+{
+	if ( IsGenerating() )
+	{
+		Msg( "Navigation Mesh generation is already in progress.\n" );
+		return;
+	}
+
+	NavAreaVector deadAreas;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+
+		Extent areaExtent;
+		area->GetExtent( &areaExtent );
+		if ( bounds.IsOverlapping( areaExtent ) )
+		{
+			deadAreas.AddToTail( area );
+		}
+	}
+
+	// sample from walkable seeds inside the region, and from the middle of each area being replaced
+	for ( int i=m_walkableSeeds.Count()-1; i>=0; --i )
+	{
+		if ( !bounds.Contains( m_walkableSeeds[i].pos ) )
+		{
+			m_walkableSeeds.Remove( i );
+		}
+	}
+
+	FOR_EACH_VEC( deadAreas, it )
+	{
+		Vector center = deadAreas[ it ]->GetCenter();
+		center.x = SnapToGrid( center.x );
+		center.y = SnapToGrid( center.y );
+
+		Vector normal;
+		if ( FindGroundForNode( &center, &normal ) && bounds.Contains( center ) )
+		{
+			AddWalkableSeed( center, normal );
+		}
+	}
+
+	if ( m_walkableSeeds.Count() == 0 )
+	{
+		Msg( "No valid walkable seed positions inside the region.  Use nav_mark_walkable inside it first.\n" );
+		return;
+	}
+
+	// mark the areas being replaced, and the areas connected to them
+	m_regionNeighborIDs.RemoveAll();
+	m_regionEncounterIDs.RemoveAll();
+
+	CNavArea::MakeNewMarker();
+	FOR_EACH_VEC( deadAreas, it )
+	{
+		deadAreas[ it ]->Mark();
+	}
+
+	FOR_EACH_VEC( deadAreas, it )
+	{
+		CNavArea *area = deadAreas[ it ];
+		for ( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+		{
+			const NavConnectVector *connections[] = { area->GetAdjacentAreas( (NavDirType)dir ), area->GetIncomingConnections( (NavDirType)dir ) };
+			for ( int c=0; c<ARRAYSIZE( connections ); ++c )
+			{
+				FOR_EACH_VEC( (*connections[c]), cit )
+				{
+					CNavArea *adjArea = (*connections[c])[ cit ].area;
+					if ( !adjArea->IsMarked() )
+					{
+						adjArea->Mark();
+						m_regionNeighborIDs.Insert( adjArea->GetID() );
+					}
+				}
+			}
+		}
+	}
+
+	// The hiding spots in the marked areas are rebuilt.  Encounter spots anywhere that pass through
+	// a marked area or look at one of its hiding spots are rebuilt too, so nothing points at them.
+	HidingSpot::ChangeMasterMarker();
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		if ( area->IsMarked() )
+		{
+			FOR_EACH_VEC( area->m_hidingSpots, sit )
+			{
+				area->m_hidingSpots[ sit ]->Mark();
+			}
+			area->m_hidingSpots.RemoveAll();
+			area->m_spotEncounters.PurgeAndDeleteElements();
+		}
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		if ( area->IsMarked() )
+			continue;
+
+		bool isStale = false;
+		for ( int e=0; e<area->m_spotEncounters.Count() && !isStale; ++e )
+		{
+			const SpotEncounter *encounter = area->m_spotEncounters[e];
+			isStale = encounter->from.area->IsMarked() || encounter->to.area->IsMarked();
+			for ( int o=0; o<encounter->spots.Count() && !isStale; ++o )
+			{
+				isStale = encounter->spots[o].spot->IsMarked();
+			}
+		}
+
+		if ( isStale )
+		{
+			area->m_spotEncounters.PurgeAndDeleteElements();
+			m_regionEncounterIDs.Insert( area->GetID() );
+		}
+	}
+
+	for ( int i=TheHidingSpots.Count()-1; i>=0; --i )
+	{
+		if ( TheHidingSpots[i]->IsMarked() )
+		{
+			delete TheHidingSpots[i];
+			TheHidingSpots.FastRemove( i );
+		}
+	}
+
+	// Visibility between the untouched areas stays valid.  Expand any inherited lists, since the
+	// areas they inherit from may change, and drop the marked areas from every list.
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		TheNavAreas[ it ]->ExpandInheritedVisibility();
+	}
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		area->m_isInheritedFrom = false;
+		area->RemovePotentiallyVisibleMarkedAreas();
+	}
+
+	// destroy the areas being replaced
+	ClearSelectedSet();
+	FOR_EACH_VEC( deadAreas, it )
+	{
+		CNavArea *area = deadAreas[ it ];
+		TheNavAreas.FindAndRemove( area );
+		OnEditDestroyNotify( area );
+		DestroyArea( area );
+	}
+
+	Msg( "Regenerating %d navigation areas in ( %.0f, %.0f, %.0f ) - ( %.0f, %.0f, %.0f )\n", deadAreas.Count(),
+		bounds.lo.x, bounds.lo.y, bounds.lo.z, bounds.hi.x, bounds.hi.y, bounds.hi.z );
+
+	m_isRegionGeneration = true;
+	m_regionGenerationExtent = bounds;
+	BeginGeneration( INCREMENTAL_GENERATION );
+
+	if ( !IsGenerating() )
+	{
+		m_isRegionGeneration = false;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Once the region's areas exist, build the lists of areas the analysis steps revisit
+ */
+void CNavMesh::CollectRegionAreas( void )
+{
+	m_regionAreas.RemoveAll();
+	m_regionEncounterAreas.RemoveAll();
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		if ( area->HasNodes() || m_regionNeighborIDs.Find( area->GetID() ) != m_regionNeighborIDs.InvalidIndex() )
+		{
+			m_regionAreas.AddToTail( area );
+		}
+	}
+
+	// Encounter spots also change for anything the new areas were stitched to
+	CNavArea::MakeNewMarker();
+	FOR_EACH_VEC( m_regionAreas, it )
+	{
+		m_regionAreas[ it ]->Mark();
+		m_regionEncounterAreas.AddToTail( m_regionAreas[ it ] );
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		if ( area->IsMarked() )
+			continue;
+
+		bool isAffected = ( m_regionEncounterIDs.Find( area->GetID() ) != m_regionEncounterIDs.InvalidIndex() );
+		for ( int dir=0; dir<NUM_DIRECTIONS && !isAffected; ++dir )
+		{
+			const NavConnectVector *connections = area->GetAdjacentAreas( (NavDirType)dir );
+			FOR_EACH_VEC( (*connections), cit )
+			{
+				if ( (*connections)[ cit ].area->HasNodes() )
+				{
+					isAffected = true;
+					break;
+				}
+			}
+		}
+
+		if ( isAffected )
+		{
+			area->Mark();
+			m_regionEncounterAreas.AddToTail( area );
+		}
+	}
+
+	Msg( "Region generation: analyzing %d areas, updating encounter spots in %d areas\n", m_regionAreas.Count(), m_regionEncounterAreas.Count() );
 }
 
 
@@ -3650,7 +3948,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
 			m_sampleTick = ( m_sampleTick + 1 ) % 1000;
 
-			while ( SampleStep() )
+			while ( m_isSamplingThreaded ? SampleWave() : SampleStep() )
 			{
 				if ( Plat_FloatTime() - startTime > maxTime )
 				{
@@ -3658,6 +3956,14 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				}
 			}
 
+			if ( m_isSamplingThreaded )
+			{
+				CheckSampledNodeCrouch();
+				m_isSamplingThreaded = false;
+			}
+
+			Msg( "Sampled %d nodes in %.2f seconds\n", CNavNode::GetListLength(), Plat_FloatTime() - m_sampleStartTime );
+
 			// sampling is complete, now build nav areas
 			m_generationState = CREATE_AREAS_FROM_SAMPLES;
 
@@ -3681,7 +3987,9 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			}
 
 			// Create new areas
+			double createStartTime = Plat_FloatTime();
 			CreateNavAreasFromNodes();
+			Msg( "Created %d navigation areas in %.2f seconds\n", TheNavAreas.Count(), Plat_FloatTime() - createStartTime );
 
 			// And toggle the selection, so we end up with the new areas
 			if ( m_generationMode == GENERATE_INCREMENTAL )
@@ -3689,7 +3997,14 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				CommandNavToggleSelectedSet();
 			}
 
-			DestroyHidingSpots();
+			if ( m_isRegionGeneration )
+			{
+				CollectRegionAreas();
+			}
+			else
+			{
+				DestroyHidingSpots();
+			}
 
 			// Remove and re-add elements in TheNavAreas, to ensure indices are useful for progress feedback
 			NavAreaVector tmpSet;
@@ -3715,9 +4030,11 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case FIND_HIDING_SPOTS:
 		{
-			while( m_generationIndex < TheNavAreas.Count() )
+			NavAreaVector &areas = GetAnalysisAreas();
+
+			while( m_generationIndex < areas.Count() )
 			{
-				CNavArea *area = TheNavAreas[ m_generationIndex ];
+				CNavArea *area = areas[ m_generationIndex ];
 				++m_generationIndex;
 
 				area->ComputeHidingSpots();
@@ -3725,7 +4042,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				// don't go over our time allotment
 				if( Plat_FloatTime() - startTime > maxTime )
 				{
-					AnalysisProgress( "Finding hiding spots...", 100, 100 * m_generationIndex / TheNavAreas.Count() );
+					AnalysisProgress( "Finding hiding spots...", 100, 100 * m_generationIndex / areas.Count() );
 					return true;
 				}
 			}
@@ -3740,9 +4057,11 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case FIND_ENCOUNTER_SPOTS:
 		{
-			while( m_generationIndex < TheNavAreas.Count() )
+			NavAreaVector &areas = GetEncounterAnalysisAreas();
+
+			while( m_generationIndex < areas.Count() )
 			{
-				CNavArea *area = TheNavAreas[ m_generationIndex ];
+				CNavArea *area = areas[ m_generationIndex ];
 				++m_generationIndex;
 
 				area->ComputeSpotEncounters();
@@ -3750,7 +4069,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				// don't go over our time allotment
 				if( Plat_FloatTime() - startTime > maxTime )
 				{
-					AnalysisProgress( "Finding encounter spots...", 100, 100 * m_generationIndex / TheNavAreas.Count() );
+					AnalysisProgress( "Finding encounter spots...", 100, 100 * m_generationIndex / areas.Count() );
 					return true;
 				}
 			}
@@ -3765,9 +4084,11 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case FIND_SNIPER_SPOTS:
 		{
-			while( m_generationIndex < TheNavAreas.Count() )
+			NavAreaVector &areas = GetAnalysisAreas();
+
+			while( m_generationIndex < areas.Count() )
 			{
-				CNavArea *area = TheNavAreas[ m_generationIndex ];
+				CNavArea *area = areas[ m_generationIndex ];
 				++m_generationIndex;
 
 				area->ComputeSniperSpots();
@@ -3775,7 +4096,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				// don't go over our time allotment
 				if( Plat_FloatTime() - startTime > maxTime )
 				{
-					AnalysisProgress( "Finding sniper spots...", 100, 100 * m_generationIndex / TheNavAreas.Count() );
+					AnalysisProgress( "Finding sniper spots...", 100, 100 * m_generationIndex / areas.Count() );
 					return true;
 				}
 			}
@@ -3793,9 +4114,11 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case COMPUTE_MESH_VISIBILITY:
 		{
-			while( m_generationIndex < TheNavAreas.Count() )
+			NavAreaVector &areas = GetAnalysisAreas();
+
+			while( m_generationIndex < areas.Count() )
 			{
-				CNavArea *area = TheNavAreas[ m_generationIndex ];
+				CNavArea *area = areas[ m_generationIndex ];
 				++m_generationIndex;
 
 				area->ComputeVisibilityToMesh();
@@ -3803,7 +4126,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				// don't go over our time allotment
 				if ( Plat_FloatTime() - startTime > maxTime )
 				{
-					AnalysisProgress( "Computing mesh visibility...", 100, 100 * m_generationIndex / TheNavAreas.Count() );
+					AnalysisProgress( "Computing mesh visibility...", 100, 100 * m_generationIndex / areas.Count() );
 					return true;
 				}
 			}
@@ -3822,9 +4145,11 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case FIND_EARLIEST_OCCUPY_TIMES:
 		{
-			while( m_generationIndex < TheNavAreas.Count() )
+			NavAreaVector &areas = GetAnalysisAreas();
+
+			while( m_generationIndex < areas.Count() )
 			{
-				CNavArea *area = TheNavAreas[ m_generationIndex ];
+				CNavArea *area = areas[ m_generationIndex ];
 				++m_generationIndex;
 
 				area->ComputeEarliestOccupyTimes();
@@ -3832,7 +4157,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				// don't go over our time allotment
 				if( Plat_FloatTime() - startTime > maxTime )
 				{
-					AnalysisProgress( "Finding earliest occupy times...", 100, 100 * m_generationIndex / TheNavAreas.Count() );
+					AnalysisProgress( "Finding earliest occupy times...", 100, 100 * m_generationIndex / areas.Count() );
 					return true;
 				}
 			}
@@ -3956,14 +4281,16 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case CUSTOM:
 		{
+			NavAreaVector &areas = GetAnalysisAreas();
+
 			if ( m_generationIndex == 0 )
 			{
 				BeginCustomAnalysis( m_generationMode == GENERATE_INCREMENTAL );
 				Msg( "Start custom...\n ");
 			}
-			while( m_generationIndex < TheNavAreas.Count() )
+			while( m_generationIndex < areas.Count() )
 			{
-				CNavArea *area = TheNavAreas[ m_generationIndex ];
+				CNavArea *area = areas[ m_generationIndex ];
 				++m_generationIndex;
 
 				area->CustomAnalysis( m_generationMode == GENERATE_INCREMENTAL );
@@ -3971,7 +4298,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 				// don't go over our time allotment
 				if( Plat_FloatTime() - startTime > maxTime )
 				{
-					AnalysisProgress( "Custom game-specific analysis...", 100, 100 * m_generationIndex / TheNavAreas.Count() );
+					AnalysisProgress( "Custom game-specific analysis...", 100, 100 * m_generationIndex / areas.Count() );
 					return true;
 				}
 			}
@@ -4006,6 +4333,10 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			m_isLoaded = true;
 			ClearWalkableSeeds();
 
+			m_isRegionGeneration = false;
+			m_regionAreas.RemoveAll();
+			m_regionEncounterAreas.RemoveAll();
+
 			HideAnalysisProgress();
 
 			// save the mesh
@@ -4127,7 +4458,14 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 		m_currentNode = node;
 	}
 
-	node->CheckCrouch();
+	if ( m_isSamplingThreaded )
+	{
+		m_sampleCrouchNodes.AddToTail( node );
+	}
+	else
+	{
+		node->CheckCrouch();
+	}
 
 	// determine if there's a cliff nearby and set an attribute on this node
 	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
@@ -4432,208 +4770,447 @@ bool CNavMesh::SampleStep( void )
 				// mark direction as visited
 				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+				SampleStepJob job;
+				job.node = m_currentNode;
+				job.dir = m_generationDir;
+				job.pos = pos;
+				if ( !TraceSampleStep( &job ) )
 				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
-
-					if ( !inRange )
-					{
-						return true;
-					}
+					return true;
 				}
 
-				if ( m_generationMode == GENERATE_SIMPLIFY )
-				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
-				}
+				// we can move here
+				// create a new navigation node, and update current node pointer
+				AddNode( job.to, job.toNormal, m_generationDir, m_currentNode, job.isOnDisplacement, job.obstacleHeight, job.obstacleStartDist, job.obstacleEndDist );
 
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to = vec3_origin, toNormal = vec3_origin;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
-				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
-				}
-				else
-				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
-						{
-							if ( !StayOnFloor( &tr ) )
-							{
-								break;
-							}
+				return true;
+			}
+		}
 
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
+		// all directions have been searched from this node - pop back to its parent and continue
+		m_currentNode = m_currentNode->GetParent();
+	}
+}
 
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
 
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
+//--------------------------------------------------------------------------------------------------------------
+int __cdecl CNavMesh::SampleStepJobCompare( const SampleStepJob *lhs, const SampleStepJob *rhs )
+{
+	if ( lhs->tile != rhs->tile )
+		return ( lhs->tile < rhs->tile ) ? -1 : 1;
 
-					if ( !success )
-					{
-						return true;
-					}
-				}
+	return lhs->sequence - rhs->sequence;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::SampleTileSteps( SampleTile &tile )
+{
+	for ( int i=0; i<tile.count; ++i )
+	{
+		SampleStepJob *job = &tile.jobs[i];
+		job->isValid = TheNavMesh->TraceSampleStep( job );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Breadth-first version of SampleStep.  Every unvisited direction of every node in the frontier
+ * is queued as a step, the steps are bucketed into spatial tiles and traced on worker threads,
+ * and the results are then added to the node graph in a fixed order on this thread.  Nodes created
+ * by the wave form the next frontier, so seams between tiles are stitched by AddNode as usual.
+ * All walkable seeds start flooding at once.
+ *
+ * Returns true if sampling needs to continue, or false if done.
+ */
+bool CNavMesh::SampleWave( void )
+{
+	if ( m_sampleFrontier.Count() == 0 )
+	{
+		while ( m_seedIdx < m_walkableSeeds.Count() )
+		{
+			CNavNode *seed = GetNextWalkableSeedNode();
+			if ( seed )
+			{
+				m_sampleFrontier.AddToTail( seed );
+			}
+		}
+
+		if ( m_sampleFrontier.Count() == 0 )
+		{
+			if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
+			{
+				return false;
+			}
+
+			// search is exhausted - continue search from ends of ladders
+			for ( int i=0; i<m_ladders.Count(); ++i )
+			{
+				CNavLadder *ladder = m_ladders[i];
+				CNavNode *node;
 
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+				// check ladder bottom
+				if ((node = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != NULL)
 				{
-					return true;
+					m_sampleFrontier.AddToTail( node );
+					break;
 				}
 
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+				// check ladder top
+				if ((node = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != NULL)
 				{
-					return true;
+					m_sampleFrontier.AddToTail( node );
+					break;
 				}
+			}
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
+			if ( m_sampleFrontier.Count() == 0 )
+			{
+				// all seeds exhausted, sampling complete
+				return false;
+			}
+		}
+	}
 
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
+	// queue a step in every direction not yet searched
+	const float tileSize = MAX( nav_generate_tile_size.GetFloat(), GenerationStepSize );
+	CUtlVector< SampleStepJob > jobs;
+	jobs.EnsureCapacity( m_sampleFrontier.Count() * NUM_DIRECTIONS );
+	FOR_EACH_VEC( m_sampleFrontier, it )
+	{
+		CNavNode *node = m_sampleFrontier[ it ];
+		for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+		{
+			if ( node->HasVisited( (NavDirType)dir ) )
+				continue;
 
-					if ( !bValid )
-						return true;
+			SampleStepJob &job = jobs[ jobs.AddToTail() ];
+			job.node = node;
+			job.dir = (NavDirType)dir;
+			job.pos = *node->GetPosition();
+			job.pos.x = (int)SnapToGrid( job.pos.x );
+			job.pos.y = (int)SnapToGrid( job.pos.y );
+			AddDirectionVector( &job.pos, job.dir, GenerationStepSize );
+			job.isValid = false;
+			job.sequence = jobs.Count() - 1;
+
+			int tileX = (int)floor( job.pos.x / tileSize );
+			int tileY = (int)floor( job.pos.y / tileSize );
+			job.tile = ( ( tileY & 0xffff ) << 16 ) | ( tileX & 0xffff );
+		}
+	}
+	m_sampleFrontier.RemoveAll();
+
+	// trace the steps, one tile per job so each thread works on a compact region of the world
+	jobs.Sort( SampleStepJobCompare );
+
+	CUtlVector< SampleTile > tiles;
+	for ( int i=0; i<jobs.Count(); ++i )
+	{
+		if ( i == 0 || jobs[i].tile != jobs[i-1].tile )
+		{
+			SampleTile &tile = tiles[ tiles.AddToTail() ];
+			tile.jobs = &jobs[i];
+			tile.count = 0;
+		}
+		++tiles.Tail().count;
+	}
+
+	if ( tiles.Count() > 1 )
+	{
+		ParallelProcess( "CNavMesh::SampleWave", tiles.Base(), tiles.Count(), &CNavMesh::SampleTileSteps );
+	}
+	else if ( tiles.Count() == 1 )
+	{
+		SampleTileSteps( tiles[0] );
+	}
+
+	// add the sampled steps to the node graph
+	FOR_EACH_VEC( jobs, it )
+	{
+		SampleStepJob &job = jobs[ it ];
+
+		// an earlier step in this wave may already have linked this direction back to us
+		if ( job.node->HasVisited( job.dir ) )
+			continue;
+
+		job.node->MarkAsVisited( job.dir );
+
+		if ( !job.isValid )
+			continue;
+
+		bool isNew = ( CNavNode::GetNode( job.to ) == NULL );
+		CNavNode *node = AddNode( job.to, job.toNormal, job.dir, job.node, job.isOnDisplacement, job.obstacleHeight, job.obstacleStartDist, job.obstacleEndDist );
+		if ( isNew )
+		{
+			m_sampleFrontier.AddToTail( node );
+		}
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static int __cdecl NavNodePtrCompare( CNavNode * const *lhs, CNavNode * const *rhs )
+{
+	if ( *lhs == *rhs )
+		return 0;
+
+	return ( *lhs < *rhs ) ? -1 : 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::CheckNodeCrouch( CNavNode *&node )
+{
+	node->CheckCrouch();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Threaded sampling defers CNavNode::CheckCrouch out of AddNode.  The test only traces and writes
+ * to the node itself, so once sampling is done each node is checked once, on worker threads.
+ */
+void CNavMesh::CheckSampledNodeCrouch( void )
+{
+	m_sampleCrouchNodes.Sort( NavNodePtrCompare );
+
+	int unique = 0;
+	FOR_EACH_VEC( m_sampleCrouchNodes, it )
+	{
+		if ( unique == 0 || m_sampleCrouchNodes[ it ] != m_sampleCrouchNodes[ unique - 1 ] )
+		{
+			m_sampleCrouchNodes[ unique++ ] = m_sampleCrouchNodes[ it ];
+		}
+	}
+	m_sampleCrouchNodes.SetCountNonDestructively( unique );
+
+	if ( unique )
+	{
+		ParallelProcess( "CNavMesh::CheckSampledNodeCrouch", m_sampleCrouchNodes.Base(), unique, &CNavMesh::CheckNodeCrouch );
+	}
+	m_sampleCrouchNodes.Purge();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace a single sampling step from job->node towards job->pos, filling in the ground position
+ * and obstacle data.  Only reads the node graph, so steps can be traced on worker threads.
+ * Returns false if the step can't be taken.
+ */
+bool CNavMesh::TraceSampleStep( SampleStepJob *job )
+{
+	// region generation stays inside its bounds
+	if ( m_isRegionGeneration )
+	{
+		if ( !m_regionGenerationExtent.Contains( job->pos ) )
+		{
+			return false;
+		}
+	}
+
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 && !m_isRegionGeneration )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - job->pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
+
+		if ( !inRange )
+		{
+			return false;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( job->pos ) )
+		{
+			return false;
+		}
+	}
+
+	// test if we can move to new position
+	trace_t result;
+	Vector from( *job->node->GetPosition() );
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to = vec3_origin, toNormal = vec3_origin;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, job->pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( job->pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
+				{
+					break;
 				}
 
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
 
-				bool isOnDisplacement = result.IsDispSurface();
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
+				{
+					break;
+				}
 
-				if ( nav_displacement_test.GetInt() > 0 )
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
 				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
 					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
 						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
 							{
-								return true;
+								obstacleEndDist = GenerationStepSize;
 							}
-						}
+						}								
 					}
 				}
+			}
+		}
 
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
-				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
-				}
+		if ( !success )
+		{
+			return false;
+		}
+	}
 
-				// we can move here
-				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return false;
+	}
 
-				return true;
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+	{
+		return false;
+	}
+
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
+
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
 			}
 		}
 
-		// all directions have been searched from this node - pop back to its parent and continue
-		m_currentNode = m_currentNode->GetParent();
+		if ( !bValid )
+			return false;
 	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	float deltaZ = to.z - job->node->GetPosition()->z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
+
+	job->to = to;
+	job->toNormal = toNormal;
+	job->isOnDisplacement = isOnDisplacement;
+	job->obstacleHeight = obstacleHeight;
+	job->obstacleStartDist = obstacleStartDist;
+	job->obstacleEndDist = obstacleEndDist;
+	return true;
 }
 
 
@@ -107,6 +107,8 @@ void CNavMesh::Reset( void )
 
 	m_generationMode = GENERATE_NONE;
 	m_currentNode = NULL;
+	m_isSamplingThreaded = false;
+	m_isRegionGeneration = false;
 	ClearWalkableSeeds();
 
 	m_isAnalyzed = false;
@@ -200,8 +202,11 @@ void CNavMesh::DestroyNavigationMesh( bool incremental )
 		}
 	}
 
-	// destroy all hiding spots
-	DestroyHidingSpots();
+	// destroy all hiding spots, unless only a region is being regenerated and the rest are kept
+	if ( !incremental || !m_isRegionGeneration )
+	{
+		DestroyHidingSpots();
+	}
 
 	// destroy navigation nodes created during map generation
 	CNavNode::CleanupGeneration();
@@ -2620,6 +2625,56 @@ void CommandNavGenerateIncremental( void )
 static ConCommand nav_generate_incremental( "nav_generate_incremental", CommandNavGenerateIncremental, "Generate a Navigation Mesh for the current map and save it to disk.", FCVAR_GAMEDLL | FCVAR_CHEAT );
 
 
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_generate_region, "Regenerate the Navigation Mesh inside the given bounds (minX minY minZ maxX maxY maxZ), or around the Selected Set if no bounds are given, and save it to disk.", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	Extent bounds;
+	if ( args.ArgC() >= 7 )
+	{
+		bounds.lo.Init( atof( args[1] ), atof( args[2] ), atof( args[3] ) );
+		bounds.hi.Init( atof( args[4] ), atof( args[5] ), atof( args[6] ) );
+
+		// accept the corners in either order
+		for ( int i=0; i<3; ++i )
+		{
+			if ( bounds.lo[i] > bounds.hi[i] )
+			{
+				V_swap( bounds.lo[i], bounds.hi[i] );
+			}
+		}
+	}
+	else if ( !TheNavMesh->IsSelectedSetEmpty() )
+	{
+		NavAreaCollector collector;
+		TheNavMesh->ForAllSelectedAreas( collector );
+
+		bounds.lo.Init( FLT_MAX, FLT_MAX, FLT_MAX );
+		bounds.hi.Init( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		FOR_EACH_VEC( collector.m_area, it )
+		{
+			Extent areaExtent;
+			collector.m_area[ it ]->GetExtent( &areaExtent );
+			bounds.Encompass( areaExtent );
+		}
+	}
+	else
+	{
+		Msg( "Usage: nav_generate_region minX minY minZ maxX maxY maxZ\n" );
+		Msg( "   or: select the areas to regenerate, then nav_generate_region\n" );
+		return;
+	}
+
+	// leave the samples room to step up and down at the edges of the region
+	bounds.lo.z -= HalfHumanHeight;
+	bounds.hi.z += HumanHeight;
+
+	TheNavMesh->BeginRegionGeneration( bounds );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 void CommandNavAnalyze( void )
 {
@@ -3445,9 +3500,11 @@ void CNavMesh::BeginVisibilityComputations( void )
 		g_pNavVisPairHash->RemoveAll();
 	}
 
-	FOR_EACH_VEC( TheNavAreas, it )
+	// region generation already dropped the recomputed areas from everyone else's lists
+	NavAreaVector &areas = GetAnalysisAreas();
+	FOR_EACH_VEC( areas, it )
 	{
-		CNavArea *area = TheNavAreas[ it ];
+		CNavArea *area = areas[ it ];
 		area->ResetPotentiallyVisibleAreas();
 	}
 }
@@ -20,6 +20,7 @@
 #define _NAV_MESH_H_
 
 #include "utlbuffer.h"
+#include "UtlSortVector.h"
 #include "filesystem.h"
 #include "GameEventListener.h"
 
@@ -355,6 +356,7 @@ public:
 	//
 	#define INCREMENTAL_GENERATION true
 	void BeginGeneration( bool incremental = false );					// initiate the generation process
+	void BeginRegionGeneration( const Extent &bounds );				// regenerate only the areas inside bounds, keeping the rest of the mesh and its analysis
 	void BeginAnalysis( bool quitWhenFinished = false );						// re-analyze an existing Mesh.  Determine Hiding Spots, Encounter Spots, etc.
 
 	bool IsGenerating( void ) const		{ return m_generationMode != GENERATE_NONE; }	// return true while a Navigation Mesh is being generated
@@ -1189,7 +1191,50 @@ private:
 	void DestroyLadders( void );
 
 	bool SampleStep( void );									// sample the walkable areas of the map
+	bool SampleWave( void );									// sample one breadth-first wave of the walkable areas, tracing on worker threads
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
+	void RunGenerationPhase( const char *name, void (CNavMesh::*phase)( void ) );	// run a generation pass and report how long it took
+
+	struct SampleStepJob
+	{
+		CNavNode *node;											// node being stepped from
+		NavDirType dir;
+		Vector pos;												// grid position being stepped to
+		Vector to;												// resulting ground position and normal, if valid
+		Vector toNormal;
+		float obstacleHeight;
+		float obstacleStartDist;
+		float obstacleEndDist;
+		bool isOnDisplacement;
+		bool isValid;
+		int tile;												// spatial tile the step lies in, used to batch work per thread
+		int sequence;											// order the step was queued in, keeps commits deterministic
+	};
+	struct SampleTile
+	{
+		SampleStepJob *jobs;
+		int count;
+	};
+	static int __cdecl SampleStepJobCompare( const SampleStepJob *lhs, const SampleStepJob *rhs );
+	static void SampleTileSteps( SampleTile &tile );
+	bool TraceSampleStep( SampleStepJob *job );					// trace a single step from a node, without modifying the node graph
+	void CheckSampledNodeCrouch( void );						// run the deferred crouch tests for nodes added by threaded sampling
+	static void CheckNodeCrouch( CNavNode *&node );
+
+	bool m_isRegionGeneration;									// true while regenerating only the areas inside m_regionGenerationExtent
+	Extent m_regionGenerationExtent;
+	CUtlSortVector< unsigned int > m_regionNeighborIDs;			// areas that were connected to the regenerated areas
+	CUtlSortVector< unsigned int > m_regionEncounterIDs;		// areas whose encounter spots referred to the regenerated areas
+	NavAreaVector m_regionAreas;								// areas whose hiding spots, visibility, etc are recomputed by a region generation
+	NavAreaVector m_regionEncounterAreas;						// areas whose encounter spots are recomputed by a region generation
+	void CollectRegionAreas( void );
+	NavAreaVector &GetAnalysisAreas( void )			{ return m_isRegionGeneration ? m_regionAreas : TheNavAreas; }
+	NavAreaVector &GetEncounterAnalysisAreas( void )	{ return m_isRegionGeneration ? m_regionEncounterAreas : TheNavAreas; }
+
+	bool m_isSamplingThreaded;									// true if this generation pass samples with SampleWave
+	double m_sampleStartTime;
+	CUtlVector< CNavNode * > m_sampleFrontier;					// nodes to step from in the next wave
+	CUtlVector< CNavNode * > m_sampleCrouchNodes;				// nodes waiting for CheckCrouch
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
 	int BuildArea( CNavNode *node, int width, int height );		// create a CNavArea of size (width, height) starting fom node at upper left corner
@@ -1202,6 +1247,20 @@ private:
 	void SquareUpAreas( void );
 	void MergeGeneratedAreas( void );
 	void ConnectGeneratedAreas( void );
+	struct GeneratedAreaConnection
+	{
+		GeneratedAreaConnection( void ) {}
+		GeneratedAreaConnection( CNavArea *toArea, NavDirType toDir ) : area( toArea ), dir( toDir ) {}
+
+		CNavArea *area;
+		NavDirType dir;
+	};
+	struct GeneratedAreaConnections
+	{
+		CNavArea *area;
+		CUtlVector< GeneratedAreaConnection > connections;
+	};
+	static void FindGeneratedAreaConnections( GeneratedAreaConnections &pending );	// find the connections ConnectGeneratedAreas should make from an area, without making them
 	void FixUpGeneratedAreas( void );
 	void FixCornerOnCornerAreas( void );
 	void FixConnections( void );
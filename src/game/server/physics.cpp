@@ -1718,6 +1718,9 @@ void PhysFrame( float deltaTime )
 		pActiveList = (IPhysicsObject **)stackalloc( sizeof(IPhysicsObject *)*activeCount );
 		physenv->GetActiveObjects( pActiveList );
 
+		// No thinks run while the simulated objects are moved into place, so
+		// their trigger touches can be resolved together afterwards
+		EntityTouch_BeginDeferSolidMoved();
 		for ( int i = 0; i < activeCount; i++ )
 		{
 			CBaseEntity *pEntity = reinterpret_cast<CBaseEntity *>(pActiveList[i]->GetGameData());
@@ -1730,6 +1733,7 @@ void PhysFrame( float deltaTime )
 				pEntity->VPhysicsUpdate( pActiveList[i] );
 			}
 		}
+		EntityTouch_EndDeferSolidMoved();
 		stackfree( pActiveList );
 	}
 
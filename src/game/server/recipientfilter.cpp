@@ -15,6 +15,50 @@
 
 static IPredictionSystem g_RecipientFilterPredictionSystem;
 
+static ConVar sv_pas_recipient_cache( "sv_pas_recipient_cache", "1", 0, "Reuse PAS recipient sets for sounds from the same cluster and area within a tick." );
+
+//-----------------------------------------------------------------------------
+// PAS recipients depend only on the cluster and area an origin sits in, so
+// sounds emitted from the same spot in one tick share one engine query.
+//-----------------------------------------------------------------------------
+struct PASRecipientCacheEntry_t
+{
+	PASRecipientCacheEntry_t() : m_nFrame( -1 ), m_nTick( -1 ) {}
+
+	int							m_nFrame;		// host frames never repeat across level changes
+	int							m_nTick;
+	int							m_nCluster;
+	int							m_nArea;
+	CBitVec< ABSOLUTE_PLAYER_LIMIT > m_PlayerBits;
+};
+
+#define PAS_RECIPIENT_CACHE_SIZE	64
+
+static PASRecipientCacheEntry_t s_PASRecipientCache[PAS_RECIPIENT_CACHE_SIZE];
+
+static void DeterminePASRecipients( const Vector& origin, CBitVec< ABSOLUTE_PLAYER_LIMIT >& playerbits )
+{
+	int nCluster = sv_pas_recipient_cache.GetBool() ? engine->GetClusterForOrigin( origin ) : -1;
+	if ( nCluster < 0 )
+	{
+		engine->Message_DetermineMulticastRecipients( true, origin, playerbits );
+		return;
+	}
+
+	int nArea = engine->GetArea( origin );
+	PASRecipientCacheEntry_t &entry = s_PASRecipientCache[ ( nCluster ^ ( nArea * 31 ) ) & ( PAS_RECIPIENT_CACHE_SIZE - 1 ) ];
+	if ( entry.m_nFrame != gpGlobals->framecount || entry.m_nTick != gpGlobals->tickcount || entry.m_nCluster != nCluster || entry.m_nArea != nArea )
+	{
+		engine->Message_DetermineMulticastRecipients( true, origin, entry.m_PlayerBits );
+		entry.m_nFrame = gpGlobals->framecount;
+		entry.m_nTick = gpGlobals->tickcount;
+		entry.m_nCluster = nCluster;
+		entry.m_nArea = nArea;
+	}
+
+	playerbits.Copy( entry.m_PlayerBits );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -270,7 +314,7 @@ void CRecipientFilter::AddRecipientsByPAS( const Vector& origin )
 	else
 	{
 		CBitVec< ABSOLUTE_PLAYER_LIMIT > playerbits;
-		engine->Message_DetermineMulticastRecipients( true, origin, playerbits );
+		DeterminePASRecipients( origin, playerbits );
 		AddPlayersFromBitMask( playerbits );
 	}
 }
@@ -16,6 +16,7 @@
 #include "checksum_crc.h"
 #include "tier0/icommandline.h"
 #include "util_shared.h"
+#include "utlhashtable.h"
 
 #if defined( TF_CLIENT_DLL ) || defined( TF_DLL )
 #include "tf_shareddefs.h"
@@ -39,6 +40,10 @@
 #include "tier0/memdbgon.h"
 
 static ConVar sv_soundemitter_trace( "sv_soundemitter_trace", "0", FCVAR_REPLICATED, "Show all EmitSound calls including their symbolic name and the actual wave file they resolved to\n" );
+#if !defined( CLIENT_DLL )
+static ConVar sv_soundemitter_batch( "sv_soundemitter_batch", "1", 0, "Merge identical script sounds from one entity within a tick and drop sounds no recipient could hear." );
+static ConVar sv_soundemitter_cull_gain( "sv_soundemitter_cull_gain", "0.01", 0, "Script sounds whose distance gain falls below this for every recipient are not sent." );
+#endif
 
 extern ISoundEmitterSystemBase *soundemitterbase;
 static ConVar *g_pClosecaption = NULL;
@@ -136,14 +141,40 @@ class CSoundEmitterSystem : public CBaseGameSystem
 public:
 	virtual char const *Name() { return "CSoundEmitterSystem"; }
 
+	// Script sound name -> handle for callers that don't keep a handle. Keys point
+	// at soundemitterbase's copy of the name, so this is purged whenever the
+	// script set can change.
+	CUtlHashtable< const char *, HSOUNDSCRIPTHANDLE, CaselessStringHashFunctor, CaselessStringEqualFunctor > m_ScriptSoundHandles;
+
 #if !defined( CLIENT_DLL )
+	// A script sound already sent this tick, for merging repeats
+	struct EmittedSound_t
+	{
+		int					m_nEntIndex;
+		int					m_nChannel;
+		HSOUNDSCRIPTHANDLE	m_hSound;
+		float				m_flSoundTime;
+		bool				m_bHasOrigin;
+		Vector				m_vecOrigin;
+		int					m_nFirstRecipient;	// into m_EmittedRecipients
+		int					m_nRecipientCount;
+	};
+
 	bool			m_bLogPrecache;
 	FileHandle_t	m_hPrecacheLogFile;
 	CUtlSymbolTable m_PrecachedScriptSounds;
+
+	// Actor gender by pooled model name; both live for the level
+	CUtlHashtable< const char *, gender_t, PointerHashFunctor, PointerEqualFunctor > m_ActorGenders;
+
+	int							m_nEmittedTick;
+	CUtlVector< EmittedSound_t > m_EmittedSounds;
+	CUtlVector< int >			m_EmittedRecipients;
 public:
 	CSoundEmitterSystem( char const *pszName ) :
 		m_bLogPrecache( false ),
-		m_hPrecacheLogFile( FILESYSTEM_INVALID_HANDLE )
+		m_hPrecacheLogFile( FILESYSTEM_INVALID_HANDLE ),
+		m_nEmittedTick( -1 )
 	{
 	}
 
@@ -237,6 +268,46 @@ public:
 	void ReloadSoundEntriesInList( IFileList *pFilesToReload )
 	{
 		soundemitterbase->ReloadSoundEntriesInList( pFilesToReload );
+		m_ScriptSoundHandles.Purge();
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Resolves a script sound name to its handle, hashing the name once
+	//			and remembering the answer instead of searching soundemitterbase
+	//			on every emit.
+	//-----------------------------------------------------------------------------
+	HSOUNDSCRIPTHANDLE LookupScriptSoundHandle( const char *soundname )
+	{
+		if ( !soundname || !soundname[0] )
+			return SOUNDEMITTER_INVALID_HANDLE;
+
+		UtlHashHandle_t h = m_ScriptSoundHandles.Find( soundname );
+		if ( h != m_ScriptSoundHandles.InvalidHandle() )
+			return m_ScriptSoundHandles.Element( h );
+
+		int soundIndex = soundemitterbase->GetSoundIndex( soundname );
+		if ( !soundemitterbase->IsValidIndex( soundIndex ) )
+			return SOUNDEMITTER_INVALID_HANDLE;
+
+		m_ScriptSoundHandles.Insert( soundemitterbase->GetSoundName( soundIndex ), (HSOUNDSCRIPTHANDLE)soundIndex );
+		return (HSOUNDSCRIPTHANDLE)soundIndex;
+	}
+
+	gender_t GetActorGender( CBaseEntity *ent )
+	{
+#if !defined( CLIENT_DLL )
+		// Model names are pooled, so the pointer identifies the model
+		const char *actorModel = STRING( ent->GetModelName() );
+		UtlHashHandle_t h = m_ActorGenders.Find( actorModel );
+		if ( h != m_ActorGenders.InvalidHandle() )
+			return m_ActorGenders.Element( h );
+
+		gender_t gender = soundemitterbase->GetActorGender( actorModel );
+		m_ActorGenders.Insert( actorModel, gender );
+		return gender;
+#else
+		return soundemitterbase->GetActorGender( STRING( ent->GetModelName() ) );
+#endif
 	}
 
 	virtual void TraceEmitSound( char const *fmt, ... )
@@ -257,6 +328,8 @@ public:
 	// Precache all wave files referenced in wave or rndwave keys
 	virtual void LevelInitPreEntity()
 	{
+		m_ScriptSoundHandles.Purge();
+
 		char mapname[ 256 ];
 #if !defined( CLIENT_DLL )
 		StartLog();
@@ -333,6 +406,13 @@ public:
 	virtual void LevelShutdownPostEntity()
 	{
 		soundemitterbase->ClearSoundOverrides();
+		m_ScriptSoundHandles.Purge();
+#if !defined( CLIENT_DLL )
+		m_ActorGenders.Purge();
+		m_EmittedSounds.Purge();
+		m_EmittedRecipients.Purge();
+		m_nEmittedTick = -1;
+#endif
 
 #if !defined( CLIENT_DLL )
 		FinishLog();
@@ -346,6 +426,7 @@ public:
 		FinishLog();
 #endif
 		soundemitterbase->Flush();
+		m_ScriptSoundHandles.Purge();
 	}
 		
 	void InternalPrecacheWaves( int soundIndex )
@@ -458,8 +539,7 @@ public:
 		CBaseEntity *ent = CBaseEntity::Instance( entindex );
 		if ( ent )
 		{
-			char const *actorModel = STRING( ent->GetModelName() );
-			gender = soundemitterbase->GetActorGender( actorModel );
+			gender = GetActorGender( ent );
 		}
 
 		if ( !soundemitterbase->GetParametersForSoundEx( ep.m_pSoundName, handle, params, gender, true ) )
@@ -496,6 +576,10 @@ public:
 			ep.m_UtlVecSoundOrigin );
 		if ( bSwallowed )
 			return;
+
+		// Microphones hear every sound, even ones merged or culled below
+		if ( ShouldSkipBatchedSound( filter, entindex, ent, ep, handle, params ) )
+			return;
 #endif
 
 #if defined( _DEBUG ) && !defined( CLIENT_DLL )
@@ -548,6 +632,125 @@ public:
 #endif
 	}
 
+#if !defined( CLIENT_DLL )
+	//-----------------------------------------------------------------------------
+	// Purpose: Per-tick batching for script sounds. Returns true if the sound
+	//			repeats one this entity already sent this tick on the same channel
+	//			to the same players, or if none of its recipients could hear it.
+	//-----------------------------------------------------------------------------
+	bool ShouldSkipBatchedSound( IRecipientFilter& filter, int entindex, CBaseEntity *ent, const EmitSound_t &ep, HSOUNDSCRIPTHANDLE handle, const CSoundParameters &params )
+	{
+		if ( !sv_soundemitter_batch.GetBool() )
+			return false;
+
+		// Modulations, stops, reliable sends and callers that want results back
+		// always go through
+		if ( ep.m_nFlags || ep.m_pflSoundDuration || ep.m_nSpeakerEntity != -1 || filter.IsReliable() || filter.IsInitMessage() || entindex <= 0 )
+			return false;
+
+		// Auto and static channels mix repeats rather than replacing them, and
+		// voice callers read the sound origins back for captions
+		switch ( params.channel )
+		{
+		case CHAN_AUTO:
+		case CHAN_STATIC:
+		case CHAN_VOICE:
+		case CHAN_VOICE2:
+			return false;
+		}
+
+		int nRecipients = filter.GetRecipientCount();
+		if ( !nRecipients )
+			return false;
+
+		if ( m_nEmittedTick != gpGlobals->tickcount )
+		{
+			m_nEmittedTick = gpGlobals->tickcount;
+			m_EmittedSounds.RemoveAll();
+			m_EmittedRecipients.RemoveAll();
+		}
+
+		for ( int i = 0; i < m_EmittedSounds.Count(); ++i )
+		{
+			const EmittedSound_t &emitted = m_EmittedSounds[i];
+			if ( emitted.m_nEntIndex != entindex || emitted.m_hSound != handle || emitted.m_nChannel != params.channel )
+				continue;
+			if ( emitted.m_flSoundTime != ep.m_flSoundTime || emitted.m_nRecipientCount != nRecipients )
+				continue;
+			if ( emitted.m_bHasOrigin != ( ep.m_pOrigin != NULL ) || ( ep.m_pOrigin && emitted.m_vecOrigin != *ep.m_pOrigin ) )
+				continue;
+
+			int j;
+			for ( j = 0; j < nRecipients; ++j )
+			{
+				if ( m_EmittedRecipients[emitted.m_nFirstRecipient + j] != filter.GetRecipientIndex( j ) )
+					break;
+			}
+			if ( j == nRecipients )
+			{
+				TraceEmitSound( "EmitSound:  '%s' merged with an identical sound this tick (ent %i)\n", ep.m_pSoundName, entindex );
+				return true;
+			}
+		}
+
+		if ( IsInaudibleToRecipients( filter, ent, ep, params ) )
+		{
+			TraceEmitSound( "EmitSound:  '%s' culled, inaudible to all recipients (ent %i)\n", ep.m_pSoundName, entindex );
+			return true;
+		}
+
+		EmittedSound_t &emitted = m_EmittedSounds[ m_EmittedSounds.AddToTail() ];
+		emitted.m_nEntIndex = entindex;
+		emitted.m_nChannel = params.channel;
+		emitted.m_hSound = handle;
+		emitted.m_flSoundTime = ep.m_flSoundTime;
+		emitted.m_bHasOrigin = ( ep.m_pOrigin != NULL );
+		emitted.m_vecOrigin = ep.m_pOrigin ? *ep.m_pOrigin : vec3_origin;
+		emitted.m_nFirstRecipient = m_EmittedRecipients.Count();
+		emitted.m_nRecipientCount = nRecipients;
+		for ( int i = 0; i < nRecipients; ++i )
+		{
+			m_EmittedRecipients.AddToTail( filter.GetRecipientIndex( i ) );
+		}
+		return false;
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Applies the engine's distance falloff (gain = volume / relative
+	//			distance) without its extra air absorption, so this only errs
+	//			toward keeping a sound.
+	//-----------------------------------------------------------------------------
+	bool IsInaudibleToRecipients( IRecipientFilter& filter, CBaseEntity *ent, const EmitSound_t &ep, const CSoundParameters &params )
+	{
+		if ( params.soundlevel == SNDLVL_NONE || ( !ep.m_pOrigin && !ent ) )
+			return false;
+
+		Vector vecOrigin = ep.m_pOrigin ? *ep.m_pOrigin : ent->GetSoundEmissionOrigin();
+
+		// Audible out to the distance where volume / ( dist * attn / clipdist ) hits the floor
+		const float flNormalClipDist = 1000.0f;
+		float flAttenuation = SNDLVL_TO_ATTN( params.soundlevel );
+		float flCullGain = sv_soundemitter_cull_gain.GetFloat();
+		if ( flAttenuation <= 0.0f || flCullGain <= 0.0f )
+			return false;
+
+		float flAudibleDist = params.volume * flNormalClipDist / ( flAttenuation * flCullGain );
+		float flAudibleDistSqr = flAudibleDist * flAudibleDist;
+
+		for ( int i = 0; i < filter.GetRecipientCount(); ++i )
+		{
+			CBasePlayer *pPlayer = UTIL_PlayerByIndex( filter.GetRecipientIndex( i ) );
+			if ( !pPlayer )
+				return false;
+
+			if ( pPlayer->EarPosition().DistToSqr( vecOrigin ) < flAudibleDistSqr )
+				return false;
+		}
+
+		return true;
+	}
+#endif
+
 	void EmitSound( IRecipientFilter& filter, int entindex, const EmitSound_t & ep )
 	{
 		VPROF( "CSoundEmitterSystem::EmitSound (calls engine)" );
@@ -613,7 +816,7 @@ public:
 
 		if ( ep.m_hSoundScriptHandle == SOUNDEMITTER_INVALID_HANDLE )
 		{
-			ep.m_hSoundScriptHandle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( ep.m_pSoundName );
+			ep.m_hSoundScriptHandle = LookupScriptSoundHandle( ep.m_pSoundName );
 		}
 
 		if ( ep.m_hSoundScriptHandle == -1 )
@@ -848,7 +1051,7 @@ public:
 	{
 		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
 		{
-			handle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( soundname );
+			handle = LookupScriptSoundHandle( soundname );
 		}
 
 		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
@@ -881,7 +1084,7 @@ public:
 
 	void StopSound( int entindex, const char *soundname )
 	{
-		HSOUNDSCRIPTHANDLE handle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( soundname );
+		HSOUNDSCRIPTHANDLE handle = LookupScriptSoundHandle( soundname );
 		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
 		{
 			return;
@@ -1330,7 +1533,11 @@ void CBaseEntity::StopSound( int iEntIndex, int iChannel, const char *pSample )
 
 soundlevel_t CBaseEntity::LookupSoundLevel( const char *soundname )
 {
-	return soundemitterbase->LookupSoundLevel( soundname );
+	HSOUNDSCRIPTHANDLE handle = g_SoundEmitterSystem.LookupScriptSoundHandle( soundname );
+	if ( handle == SOUNDEMITTER_INVALID_HANDLE )
+		return soundemitterbase->LookupSoundLevel( soundname );
+
+	return soundemitterbase->LookupSoundLevelByHandle( soundname, handle );
 }
 
 
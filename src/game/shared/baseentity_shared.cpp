@@ -440,7 +440,7 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 	
 	if ( FStrEq( szKeyName, "targetname" ) )
 	{
-		m_iName = AllocPooledString( szValue );
+		SetName( AllocPooledString( szValue ) );
 		return true;
 	}
 
@@ -1472,6 +1472,7 @@ void CBaseEntity::InvalidatePhysicsRecursive( int nChangeFlags )
 	{
 #ifdef CLIENT_DLL
 		g_pClientShadowMgr->MarkRenderToTextureShadowDirty( GetShadowHandle() );
+		MarkRenderBoundsDirty();
 #endif
 
 		// Only set this flag if the only thing that changed us was the animation.
@@ -1141,6 +1141,7 @@ void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 	gpGlobals->frametime *= pPlayer->GetLaggedMovementValue();
 
 	ResetGetPointContentsCache();
+	ResetGroundTraceCache();
 
 	// Cropping movement speed scales mv->m_fForwardSpeed etc. globally
 	// Once we crop, we don't want to recursively crop again, so we set the crop
@@ -3545,6 +3546,51 @@ int CGameMovement::GetPointContentsCached( const Vector &point, int slot )
 }
 
 
+void CGameMovement::ResetGroundTraceCache()
+{
+	for ( int slot = 0; slot < MAX_GROUND_TRACE_SLOTS; ++slot )
+	{
+		m_GroundTraceCache[ slot ].m_bValid = false;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns a ground trace made earlier in this usercmd from the same
+//			hull and endpoints. Exact compares only, so the result is bit for bit
+//			what a fresh trace would return.
+//-----------------------------------------------------------------------------
+bool CGameMovement::GetGroundTraceCached( int slot, const Vector &start, const Vector &end, trace_t &pm )
+{
+	Assert( slot >= 0 && slot < MAX_GROUND_TRACE_SLOTS );
+
+	if ( !g_bMovementOptimizations )
+		return false;
+
+	const GroundTraceCache_t &cache = m_GroundTraceCache[ slot ];
+	if ( !cache.m_bValid || cache.m_vecStart != start || cache.m_vecEnd != end ||
+		 cache.m_vecMins != GetPlayerMins() || cache.m_vecMaxs != GetPlayerMaxs() )
+		return false;
+
+	pm = cache.m_Trace;
+	return true;
+}
+
+
+void CGameMovement::SetGroundTraceCached( int slot, const Vector &start, const Vector &end, const trace_t &pm )
+{
+	Assert( slot >= 0 && slot < MAX_GROUND_TRACE_SLOTS );
+
+	GroundTraceCache_t &cache = m_GroundTraceCache[ slot ];
+	cache.m_bValid = true;
+	cache.m_vecStart = start;
+	cache.m_vecEnd = end;
+	cache.m_vecMins = GetPlayerMins();
+	cache.m_vecMaxs = GetPlayerMaxs();
+	cache.m_Trace = pm;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : &input - 
@@ -3880,13 +3926,21 @@ void CGameMovement::CategorizePosition( void )
 	else
 	{
 		// Try and move down.
-		TryTouchGround( bumpOrigin, point, GetPlayerMins(), GetPlayerMaxs(), MASK_PLAYERSOLID, COLLISION_GROUP_PLAYER_MOVEMENT, pm );
+		if ( !GetGroundTraceCached( GROUND_TRACE_HULL, bumpOrigin, point, pm ) )
+		{
+			TryTouchGround( bumpOrigin, point, GetPlayerMins(), GetPlayerMaxs(), MASK_PLAYERSOLID, COLLISION_GROUP_PLAYER_MOVEMENT, pm );
+			SetGroundTraceCached( GROUND_TRACE_HULL, bumpOrigin, point, pm );
+		}
 		
 		// Was on ground, but now suddenly am not.  If we hit a steep plane, we are not on ground
 		if ( !pm.m_pEnt || pm.plane.normal[2] < 0.7 )
 		{
 			// Test four sub-boxes, to see if any of them would have found shallower slope we could actually stand on
-			TryTouchGroundInQuadrants( bumpOrigin, point, MASK_PLAYERSOLID, COLLISION_GROUP_PLAYER_MOVEMENT, pm );
+			if ( !GetGroundTraceCached( GROUND_TRACE_QUADRANTS, bumpOrigin, point, pm ) )
+			{
+				TryTouchGroundInQuadrants( bumpOrigin, point, MASK_PLAYERSOLID, COLLISION_GROUP_PLAYER_MOVEMENT, pm );
+				SetGroundTraceCached( GROUND_TRACE_QUADRANTS, bumpOrigin, point, pm );
+			}
 
 			if ( !pm.m_pEnt || pm.plane.normal[2] < 0.7 )
 			{
@@ -215,6 +215,10 @@ protected:
 	void ResetGetPointContentsCache();
 	int GetPointContentsCached( const Vector &point, int slot );
 
+	void ResetGroundTraceCache();
+	bool GetGroundTraceCached( int slot, const Vector &start, const Vector &end, trace_t &pm );
+	void SetGroundTraceCached( int slot, const Vector &start, const Vector &end, const trace_t &pm );
+
 	// Ducking
 	virtual void	Duck( void );
 	virtual void	HandleDuckingSpeedCrop();
@@ -273,6 +277,28 @@ protected:
 	int m_CachedGetPointContents[ MAX_PLAYERS_ARRAY_SAFE ][ MAX_PC_CACHE_SLOTS ];
 	Vector m_CachedGetPointContentsPoint[ MAX_PLAYERS_ARRAY_SAFE ][ MAX_PC_CACHE_SLOTS ];	
 
+	enum
+	{
+		// full hull, then the four quadrant hulls when the full hull finds a steep plane
+		GROUND_TRACE_HULL = 0,
+		GROUND_TRACE_QUADRANTS,
+		MAX_GROUND_TRACE_SLOTS,
+	};
+
+	// CategorizePosition runs several times per usercmd, usually without the player
+	// having moved in between. Nothing else moves during ProcessMovement, so a ground
+	// trace from the exact same hull and endpoints is reused until the next command.
+	struct GroundTraceCache_t
+	{
+		bool			m_bValid;
+		Vector			m_vecStart;
+		Vector			m_vecEnd;
+		Vector			m_vecMins;
+		Vector			m_vecMaxs;
+		trace_t			m_Trace;
+	};
+	GroundTraceCache_t m_GroundTraceCache[ MAX_GROUND_TRACE_SLOTS ];
+
 	Vector			m_vecProximityMins;		// Used to be globals in sv_user.cpp.
 	Vector			m_vecProximityMaxs;
 
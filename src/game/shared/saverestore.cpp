@@ -24,6 +24,9 @@
 #include "vphysics/object_hash.h"
 #include "datacache/imdlcache.h"
 #include "tier0/vprof.h"
+#include "tier1/checksum_crc.h"
+#include "tier1/utlhashtable.h"
+#include "tier1/utlstring.h"
 
 #if !defined( CLIENT_DLL )
 
@@ -182,6 +185,303 @@ inputfunc_t *UTIL_FunctionFromName( datamap_t *pMap, const char *pName )
 	return NULL;
 }
 
+//-----------------------------------------------------------------------------
+//
+// Compiled save plans
+//
+// A plan splits one datamap level into plain data fields, saved as a single
+// raw blob, and everything else, saved in the usual named format after it.
+// A compiled level is marked by a header of size SAVEPLAN_HEADER_SIZE rather
+// than sizeof(int). The blob is restored with a straight copy when the
+// schema hash still matches; otherwise it is remapped by field name using
+// the schemas written in the "SavePlans" block headers.
+//
+//-----------------------------------------------------------------------------
+
+#if defined( CLIENT_DLL )
+static ConVar save_compiled_plans( "cl_save_compiled_plans", "1", 0, "Save plain data fields of each datamap as one raw block instead of named fields" );
+#else
+static ConVar save_compiled_plans( "sv_save_compiled_plans", "1", 0, "Save plain data fields of each datamap as one raw block instead of named fields" );
+#endif
+
+struct SavePlanHeader_t
+{
+	int		nNamedFields;
+	uint32	nSchemaHash;
+	int		nPODBytes;
+};
+
+#define SAVEPLAN_HEADER_SIZE	( (int)sizeof( SavePlanHeader_t ) )
+
+struct SavePlanOp_t
+{
+	int		iField;		// into the datamap's dataDesc
+	int		offset;		// in the object
+	int		bytes;
+};
+
+struct SavePlanRun_t
+{
+	int		offset;		// in the object
+	int		bytes;
+};
+
+class CSavePlan
+{
+public:
+	CSavePlan() : m_pMap( NULL ), m_nSchemaHash( 0 ), m_nPODBytes( 0 ), m_bHasGlobalPOD( false ), m_nLastSaveSerial( -1 ) {}
+
+	datamap_t					*m_pMap;
+	uint32						m_nSchemaHash;
+	int							m_nPODBytes;
+	bool						m_bHasGlobalPOD;
+	int							m_nLastSaveSerial;
+	CUtlVector<SavePlanOp_t>	m_PODOps;		// in blob order
+	CUtlVector<SavePlanRun_t>	m_Runs;			// m_PODOps merged where the object memory is contiguous
+	CUtlVector<int>				m_NamedFields;	// fields that keep the named format
+};
+
+// What a save says about a plan it was written with
+struct SavedPlanField_t
+{
+	CUtlString	name;
+	int			type;
+	int			offset;		// in the blob
+	int			bytes;
+};
+
+struct SavedPlanSchema_t
+{
+	CUtlString						className;
+	uint32							nSchemaHash;
+	CUtlVector<SavedPlanField_t>	fields;
+};
+
+static CUtlHashtable<datamap_t *, CSavePlan *>	g_SavePlans;
+static CUtlVector<CSavePlan *>					g_SavePlansUsed;
+static int										g_nSavePlanSerial;
+
+static CUtlVector<SavedPlanSchema_t>			g_SavedPlanSchemas;
+static CGameSaveRestoreInfo						*g_pSavedPlanSchemaOwner;
+
+//-------------------------------------
+
+static bool IsSavePlanPODField( const typedescription_t *pField )
+{
+	if ( pField->flags & FTYPEDESC_PTR )
+		return false;
+
+	switch ( pField->fieldType )
+	{
+	case FIELD_FLOAT:
+	case FIELD_VECTOR:
+	case FIELD_QUATERNION:
+	case FIELD_INTEGER:
+	case FIELD_BOOLEAN:
+	case FIELD_SHORT:
+	case FIELD_CHARACTER:
+	case FIELD_COLOR32:
+		// Mistyped fields go through the named path, which warns about them
+		return ( pField->fieldSizeInBytes == pField->fieldSize * gSizes[pField->fieldType] );
+
+	default:
+		return false;
+	}
+}
+
+//-------------------------------------
+
+static int SavePlanOpLessFunc( const SavePlanOp_t *pLeft, const SavePlanOp_t *pRight )
+{
+	return pLeft->offset - pRight->offset;
+}
+
+//-------------------------------------
+// Purpose: Returns the plan for one datamap level, building it the first
+//			time, or NULL when the level has no plain data fields
+//-------------------------------------
+
+static CSavePlan *GetSavePlan( datamap_t *pMap )
+{
+	UtlHashHandle_t h = g_SavePlans.Find( pMap );
+	if ( h != g_SavePlans.InvalidHandle() )
+	{
+		CSavePlan *pPlan = g_SavePlans[h];
+		return ( pPlan->m_nPODBytes ) ? pPlan : NULL;
+	}
+
+	CSavePlan *pPlan = new CSavePlan;
+	pPlan->m_pMap = pMap;
+
+	for ( int i = 0; i < pMap->dataNumFields; i++ )
+	{
+		const typedescription_t *pField = &pMap->dataDesc[i];
+		if ( !( pField->flags & FTYPEDESC_SAVE ) || pField->fieldType == FIELD_VOID )
+			continue;
+
+		if ( !IsSavePlanPODField( pField ) )
+		{
+			pPlan->m_NamedFields.AddToTail( i );
+			continue;
+		}
+
+		SavePlanOp_t &op = pPlan->m_PODOps[ pPlan->m_PODOps.AddToTail() ];
+		op.iField = i;
+		op.offset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
+		op.bytes = pField->fieldSizeInBytes;
+
+		if ( pField->flags & FTYPEDESC_GLOBAL )
+			pPlan->m_bHasGlobalPOD = true;
+	}
+
+	// Blob order follows the object layout so neighbouring fields copy as one run
+	pPlan->m_PODOps.Sort( SavePlanOpLessFunc );
+
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, pMap->dataClassName, Q_strlen( pMap->dataClassName ) );
+	for ( int i = 0; i < pPlan->m_PODOps.Count(); i++ )
+	{
+		const SavePlanOp_t &op = pPlan->m_PODOps[i];
+		const typedescription_t *pField = &pMap->dataDesc[op.iField];
+		int desc[2] = { pField->fieldType, op.bytes };
+
+		CRC32_ProcessBuffer( &crc, pField->fieldName, Q_strlen( pField->fieldName ) + 1 );
+		CRC32_ProcessBuffer( &crc, desc, sizeof( desc ) );
+
+		if ( pPlan->m_Runs.Count() && pPlan->m_Runs.Tail().offset + pPlan->m_Runs.Tail().bytes == op.offset )
+		{
+			pPlan->m_Runs.Tail().bytes += op.bytes;
+		}
+		else
+		{
+			SavePlanRun_t &run = pPlan->m_Runs[ pPlan->m_Runs.AddToTail() ];
+			run.offset = op.offset;
+			run.bytes = op.bytes;
+		}
+		pPlan->m_nPODBytes += op.bytes;
+	}
+	CRC32_Final( &crc );
+	pPlan->m_nSchemaHash = crc;
+
+	g_SavePlans.Insert( pMap, pPlan );
+	return ( pPlan->m_nPODBytes ) ? pPlan : NULL;
+}
+
+//-------------------------------------
+
+static const SavedPlanSchema_t *FindSavedPlanSchema( CGameSaveRestoreInfo *pOwner, const char *pszClassName, uint32 nSchemaHash )
+{
+	if ( pOwner != g_pSavedPlanSchemaOwner )
+		return NULL;
+
+	for ( int i = 0; i < g_SavedPlanSchemas.Count(); i++ )
+	{
+		const SavedPlanSchema_t &schema = g_SavedPlanSchemas[i];
+		if ( schema.nSchemaHash == nSchemaHash && !Q_strcmp( schema.className, pszClassName ) )
+			return &schema;
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Writes the schemas of the plans a save used into its headers, and reads
+// them back before restore for the plans whose layout has since changed
+//-----------------------------------------------------------------------------
+
+class CSavePlanSaveRestoreBlockHandler : public CDefSaveRestoreBlockHandler
+{
+public:
+	const char *GetBlockName()
+	{
+		return "SavePlans";
+	}
+
+	void PreSave( CSaveRestoreData * )
+	{
+		g_nSavePlanSerial++;
+		g_SavePlansUsed.RemoveAll();
+	}
+
+	void WriteSaveHeaders( ISave *pSave )
+	{
+		int nPlans = g_SavePlansUsed.Count();
+		pSave->WriteInt( &nPlans );
+
+		for ( int i = 0; i < nPlans; i++ )
+		{
+			CSavePlan *pPlan = g_SavePlansUsed[i];
+			datamap_t *pMap = pPlan->m_pMap;
+
+			int nFields = pPlan->m_PODOps.Count();
+			pSave->WriteString( pMap->dataClassName );
+			pSave->WriteInt( (int *)&pPlan->m_nSchemaHash );
+			pSave->WriteInt( &nFields );
+
+			int offset = 0;
+			for ( int j = 0; j < nFields; j++ )
+			{
+				const SavePlanOp_t &op = pPlan->m_PODOps[j];
+				const typedescription_t *pField = &pMap->dataDesc[op.iField];
+				int desc[3] = { pField->fieldType, offset, op.bytes };
+
+				pSave->WriteString( pField->fieldName );
+				pSave->WriteInt( desc, ARRAYSIZE( desc ) );
+				offset += op.bytes;
+			}
+		}
+	}
+
+	void PostSave()
+	{
+		g_SavePlansUsed.Purge();
+	}
+
+	void PreRestore()
+	{
+		g_SavedPlanSchemas.Purge();
+		g_pSavedPlanSchemaOwner = NULL;
+	}
+
+	void ReadRestoreHeaders( IRestore *pRestore )
+	{
+		g_SavedPlanSchemas.Purge();
+		g_pSavedPlanSchemaOwner = pRestore->GetGameSaveRestoreInfo();
+
+		char szName[256];
+		int nPlans = pRestore->ReadInt();
+		for ( int i = 0; i < nPlans; i++ )
+		{
+			SavedPlanSchema_t &schema = g_SavedPlanSchemas[ g_SavedPlanSchemas.AddToTail() ];
+			pRestore->ReadString( szName, sizeof( szName ), 0 );
+			schema.className = szName;
+			schema.nSchemaHash = (uint32)pRestore->ReadInt();
+
+			int nFields = pRestore->ReadInt();
+			schema.fields.SetCount( nFields );
+			for ( int j = 0; j < nFields; j++ )
+			{
+				int desc[3];
+				pRestore->ReadString( szName, sizeof( szName ), 0 );
+				pRestore->ReadInt( desc, ARRAYSIZE( desc ) );
+
+				SavedPlanField_t &field = schema.fields[j];
+				field.name = szName;
+				field.type = desc[0];
+				field.offset = desc[1];
+				field.bytes = desc[2];
+			}
+		}
+	}
+};
+
+static CSavePlanSaveRestoreBlockHandler g_SavePlanSaveRestoreBlockHandler;
+
+ISaveRestoreBlockHandler *GetSavePlanSaveRestoreBlockHandler()
+{
+	return &g_SavePlanSaveRestoreBlockHandler;
+}
+
 //-----------------------------------------------------------------------------
 //
 // CSave
@@ -874,8 +1174,64 @@ int CSave::DoWriteAll( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *
 			return status;
 	}
 
+	// Logging wants every field by name, so it keeps the named format
+	if ( save_compiled_plans.GetBool() && !IsLogging() )
+	{
+		CSavePlan *pPlan = GetSavePlan( pCurMap );
+		if ( pPlan )
+			return WriteCompiledFields( pLeafObject, pLeafMap, pCurMap, pPlan );
+	}
+
 	return WriteFields( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap->dataDesc, pCurMap->dataNumFields );
 }
+
+//-------------------------------------
+// Purpose: Writes one datamap level through its compiled plan: a header, the
+//			raw plain data blob, then the remaining fields by name
+
+int CSave::WriteCompiledFields( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap, CSavePlan *pPlan )
+{
+	if ( pPlan->m_nLastSaveSerial != g_nSavePlanSerial )
+	{
+		pPlan->m_nLastSaveSerial = g_nSavePlanSerial;
+		g_SavePlansUsed.AddToTail( pPlan );
+	}
+
+	SavePlanHeader_t header;
+	header.nNamedFields = 0;
+	header.nSchemaHash = pPlan->m_nSchemaHash;
+	header.nPODBytes = pPlan->m_nPODBytes;
+
+	int iHeaderPos = GetWritePos();
+	WriteHeader( pCurMap->dataClassName, SAVEPLAN_HEADER_SIZE );
+	BufferData( (const char *)&header, SAVEPLAN_HEADER_SIZE );
+
+	const char *pBaseData = (const char *)pLeafObject;
+	for ( int i = 0; i < pPlan->m_Runs.Count(); i++ )
+	{
+		BufferData( pBaseData + pPlan->m_Runs[i].offset, pPlan->m_Runs[i].bytes );
+	}
+
+	for ( int i = 0; i < pPlan->m_NamedFields.Count(); i++ )
+	{
+		typedescription_t *pField = &pCurMap->dataDesc[ pPlan->m_NamedFields[i] ];
+		void *pOutputData = (void *)( pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ] );
+
+		if ( !ShouldSaveField( pOutputData, pField ) )
+			continue;
+
+		if ( !WriteField( pCurMap->dataClassName, pOutputData, pLeafMap, pField ) )
+			break;
+		header.nNamedFields++;
+	}
+
+	int iEndPos = GetWritePos();
+	SetWritePos( iHeaderPos + sizeof(SaveRestoreRecordHeader_t) );
+	BufferData( (const char *)&header.nNamedFields, sizeof(int) );
+	SetWritePos( iEndPos );
+
+	return 1;
+}
 	
 //-------------------------------------
 
@@ -1726,9 +2082,117 @@ int CRestore::DoReadAll( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCur
 			return status;
 	}
 
+	// A compiled level announces itself through the size in its header
+	short size = 0;
+	if ( m_pData && m_pData->BytesAvailable() >= (int)sizeof(short) )
+	{
+		memcpy( &size, BufferPointer(), sizeof(short) );
+	}
+	if ( size == SAVEPLAN_HEADER_SIZE )
+		return ReadCompiledFields( pLeafObject, pLeafMap, pCurMap );
+
 	return ReadFields( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap->dataDesc, pCurMap->dataNumFields );
 }
 
+//-------------------------------------
+// Purpose: Reads a datamap level written by CSave::WriteCompiledFields. The
+//			blob is copied straight in when the plan is unchanged, otherwise
+//			remapped field by field from the schema the save recorded
+
+int CRestore::ReadCompiledFields( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap )
+{
+	SaveRestoreRecordHeader_t recordHeader;
+	ReadHeader( &recordHeader );
+
+	if ( recordHeader.symbol != m_pData->FindCreateSymbol( pCurMap->dataClassName ) )
+	{
+		Msg( "Expected %s found %s!\n", pCurMap->dataClassName, m_pData->StringFromSymbol( recordHeader.symbol ) );
+		Msg( "Field type name may have changed or inheritance graph changed, save file is suspect\n" );
+		m_pData->Rewind( 2*sizeof(short) );
+		return 0;
+	}
+
+	SavePlanHeader_t header;
+	BufferReadBytes( (char *)&header, SAVEPLAN_HEADER_SIZE );
+	if ( header.nPODBytes < 0 || header.nPODBytes > m_pData->BytesAvailable() )
+	{
+		Warning( "Restore: compiled block for %s overruns the save data\n", pCurMap->dataClassName );
+		return 0;
+	}
+
+	// Clear out base data
+	EmptyFields( pLeafObject, pCurMap->dataDesc, pCurMap->dataNumFields );
+
+	char *pBaseData = (char *)pLeafObject;
+	const char *pBlob = BufferPointer();
+	CSavePlan *pPlan = GetSavePlan( pCurMap );
+	if ( pPlan && pPlan->m_nSchemaHash == header.nSchemaHash && pPlan->m_nPODBytes == header.nPODBytes )
+	{
+		if ( !m_global || !pPlan->m_bHasGlobalPOD )
+		{
+			for ( int i = 0; i < pPlan->m_Runs.Count(); i++ )
+			{
+				memcpy( pBaseData + pPlan->m_Runs[i].offset, pBlob, pPlan->m_Runs[i].bytes );
+				pBlob += pPlan->m_Runs[i].bytes;
+			}
+		}
+		else
+		{
+			for ( int i = 0; i < pPlan->m_PODOps.Count(); i++ )
+			{
+				const SavePlanOp_t &op = pPlan->m_PODOps[i];
+				if ( ShouldReadField( &pCurMap->dataDesc[op.iField] ) )
+				{
+					memcpy( pBaseData + op.offset, pBlob, op.bytes );
+				}
+				pBlob += op.bytes;
+			}
+		}
+	}
+	else
+	{
+		const SavedPlanSchema_t *pSchema = FindSavedPlanSchema( m_pGameInfo, pCurMap->dataClassName, header.nSchemaHash );
+		if ( pSchema )
+		{
+			int searchCookie = 0;
+			for ( int i = 0; i < pSchema->fields.Count(); i++ )
+			{
+				const SavedPlanField_t &saved = pSchema->fields[i];
+				typedescription_t *pField = FindField( saved.name, pCurMap->dataDesc, pCurMap->dataNumFields, &searchCookie );
+				if ( pField && ShouldReadField( pField ) && pField->fieldType == saved.type && IsSavePlanPODField( pField ) &&
+					 saved.offset + saved.bytes <= header.nPODBytes )
+				{
+					memcpy( pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ], pBlob + saved.offset, MIN( saved.bytes, pField->fieldSizeInBytes ) );
+				}
+			}
+		}
+		else
+		{
+			Warning( "Restore: no saved layout for %s, its plain data fields are left empty\n", pCurMap->dataClassName );
+		}
+	}
+	BufferSkipBytes( header.nPODBytes );
+
+	int searchCookie = 0;
+	SaveRestoreRecordHeader_t fieldHeader;
+	for ( int i = 0; i < header.nNamedFields; i++ )
+	{
+		ReadHeader( &fieldHeader );
+
+		typedescription_t *pField = FindField( m_pData->StringFromSymbol( fieldHeader.symbol ), pCurMap->dataDesc, pCurMap->dataNumFields, &searchCookie );
+		if ( pField && ShouldReadField( pField ) )
+		{
+			ReadField( fieldHeader, pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ], pLeafMap, pField );
+		}
+		else
+		{
+			BufferSkipBytes( fieldHeader.size );			// Advance to next field
+		}
+	}
+
+	return 1;
+}
+
 //-------------------------------------
 
 char *CRestore::BufferPointer( void )
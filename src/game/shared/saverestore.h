@@ -28,6 +28,7 @@ struct edict_t;
 struct datamap_t;
 class CBaseEntity;
 struct interval_t;
+class CSavePlan;
 
 //-----------------------------------------------------------------------------
 //
@@ -150,6 +151,7 @@ private:
 	void			WriteHeader( const char *pname, int size );
 
 	int				DoWriteAll( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
+	int				WriteCompiledFields( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap, CSavePlan *pPlan );
 	bool 			WriteField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
 	
 	bool 			WriteBasicField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
@@ -274,6 +276,7 @@ private:
 	void			BufferSkipBytes( int bytes );
 	
 	int				DoReadAll( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
+	int				ReadCompiledFields( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
 	
 	typedescription_t *FindField( const char *pszFieldName, typedescription_t *pFields, int fieldCount, int *pIterator );
 	void			ReadField( const SaveRestoreRecordHeader_t &header, void *pDest, datamap_t *pRootMap, typedescription_t *pField );
@@ -349,6 +352,12 @@ public:
 //-----------------------------------------------------------------------------
 IEntitySaveUtils *GetEntitySaveUtils();
 
+//-----------------------------------------------------------------------------
+// Records the layouts used by compiled save plans, so saves stay readable
+// after a datamap changes
+//-----------------------------------------------------------------------------
+ISaveRestoreBlockHandler *GetSavePlanSaveRestoreBlockHandler();
+
 
 //=============================================================================
 
@@ -125,12 +125,12 @@ inline int CheckDeclareClass_Access( T *, const char *pShouldBe )
 		CBaseEntity *m_pEnt;
 	};
 
-	//TODO: Currently, these don't get the benefit of tracking changes to individual vars.
-	// Would be nice if they did.
+	// The chained object must live inside the entity's own memory (a member, like
+	// CNetworkVarEmbedded) so the entity can turn pVar into a send prop offset.
 	#define DECLARE_NETWORKVAR_CHAIN() \
 		CAutoInitEntPtr __m_pChainEntity; \
 		void NetworkStateChanged() { CHECK_USENETWORKVARS __m_pChainEntity.m_pEnt->NetworkStateChanged(); } \
-		void NetworkStateChanged( void *pVar ) { CHECK_USENETWORKVARS __m_pChainEntity.m_pEnt->NetworkStateChanged(); }
+		void NetworkStateChanged( void *pVar ) { CHECK_USENETWORKVARS __m_pChainEntity.m_pEnt->NetworkStateChanged( pVar ); }
 
 	#define IMPLEMENT_NETWORKVAR_CHAIN( varName ) \
 		(varName)->__m_pChainEntity.m_pEnt = this;
@@ -359,6 +359,62 @@ public:
 
 typedef KeyValues::AutoDelete KeyValuesAD;
 
+//-----------------------------------------------------------------------------
+// Purpose: Optional block allocator for KeyValues nodes.
+//			While a CKeyValuesArena::CScope is alive on a thread, every KeyValues
+//			node created on that thread is carved out of the arena. Destroying the
+//			arena frees all of its nodes that are still alive in one go, so a whole
+//			parsed tree can be dropped without walking it. deleteThis() on arena
+//			nodes still works. Only use the arena from one thread at a time, and
+//			don't hand its trees to code that can outlive it.
+//
+//	CKeyValuesArena arena;
+//	KeyValues *pKV;
+//	{
+//		CKeyValuesArena::CScope scope( arena );
+//		pKV = new KeyValues( "data" );
+//		pKV->LoadFromFile( filesystem, "scripts/foo.txt", "GAME" );
+//	}
+//	...
+//-----------------------------------------------------------------------------
+class CKeyValuesArena
+{
+public:
+	CKeyValuesArena( int nNodesPerBlock = 512 );
+	~CKeyValuesArena();
+
+	class CScope
+	{
+	public:
+		CScope( CKeyValuesArena &arena );
+		~CScope();
+
+	private:
+		CKeyValuesArena *m_pOuterArena;
+	};
+
+private:
+	friend class KeyValues;
+
+	// Called from KeyValues::operator new/delete
+	static void *AllocFromActiveArena( size_t nSize );
+	static bool FreeToOwningArena( void *pMem );
+
+	void *Alloc();
+	bool Owns( const void *pMem, int *pBlock, int *pSlot ) const;
+
+	struct Block_t
+	{
+		char *m_pNodes;
+		unsigned char *m_pLive;
+		int m_nUsed;
+	};
+
+	CUtlVector< Block_t > m_Blocks;
+	int m_nNodesPerBlock;
+	int m_nNodeSize;
+};
+
 enum KeyValuesUnpackDestinationTypes_t
 {
 	UNPACK_TYPE_FLOAT,										// dest is a float
@@ -181,6 +181,10 @@ class CNonThreadsafeTree : public CUtlRBTree<CUtlSymbolTableLargeBaseTreeEntry_t
 public:
 	typedef CUtlRBTree<CUtlSymbolTableLargeBaseTreeEntry_t *, intp, CTreeEntryLess< CNonThreadsafeTree, CASEINSENSITIVE > > CNonThreadsafeTreeType;
 
+	// String storage needs no locking
+	typedef CThreadNullMutex PoolMutex_t;
+	enum { POOL_SHARD_COUNT = 1 };
+
 	CNonThreadsafeTree() : 
 		CNonThreadsafeTreeType( 0, 16 ) 
 	{
@@ -256,6 +260,11 @@ class CThreadsafeTree : public CUtlTSHash< CUtlSymbolTableLargeBaseTreeEntry_t *
 public:
 	typedef CUtlTSHash< CUtlSymbolTableLargeBaseTreeEntry_t *, 2048, CUtlSymbolTableLargeBaseTreeEntry_t *, CCThreadsafeTreeHashMethod< 2048, CUtlSymbolTableLargeBaseTreeEntry_t *, CASEINSENSITIVE > > CThreadsafeTreeType;
 
+	// String storage is split into shards by hash, each with its own lock, so
+	// threads adding different strings rarely wait on each other
+	typedef CThreadFastMutex PoolMutex_t;
+	enum { POOL_SHARD_COUNT = 16 };
+
 	CThreadsafeTree() : 
 		CThreadsafeTreeType( 32 ) 
 	{
@@ -264,15 +273,15 @@ public:
 	{
 		CThreadsafeTreeType::Commit();
 	}
-	inline int Insert( CUtlSymbolTableLargeBaseTreeEntry_t *entry )
+	inline UtlTSHashHandle_t Insert( CUtlSymbolTableLargeBaseTreeEntry_t *entry )
 	{
 		return CThreadsafeTreeType::Insert( entry, entry );
 	}
-	inline int Find( CUtlSymbolTableLargeBaseTreeEntry_t *entry )
+	inline UtlTSHashHandle_t Find( CUtlSymbolTableLargeBaseTreeEntry_t *entry )
 	{
 		return CThreadsafeTreeType::Find( entry );
 	}
-	inline int InvalidIndex() const
+	inline UtlTSHashHandle_t InvalidIndex() const
 	{
 		return CThreadsafeTreeType::InvalidHandle();
 	}
@@ -291,6 +300,11 @@ public:
 };
 
 // Base Class for threaded and non-threaded types
+//
+// The threaded tables can be read and added to from any thread. Finds never
+// take a lock once Commit() has been called, and adds only lock the hash
+// bucket and string pool shard the new string falls in. RemoveAll() and
+// Commit() must happen while nothing else is using the table.
 template < class TreeType, bool CASEINSENSITIVE, size_t POOL_SIZE = MIN_STRING_POOL_SIZE >
 class CUtlSymbolTableLargeBase
 {
@@ -304,6 +318,17 @@ public:
 
 	// Finds the symbol for pString
 	CUtlSymbolLarge Find( const char* pString ) const;
+
+	// Look up the string associated with a particular symbol
+	const char* String( CUtlSymbolLarge id ) const
+	{
+		return id.String();
+	}
+
+	inline bool HasElement( const char* pStr ) const
+	{
+		return Find( pStr ) != UTL_INVAL_SYMBOL_LARGE;
+	}
 	
 	// Remove all symbols in the table.
 	void  RemoveAll();
@@ -333,11 +358,15 @@ public:
 	{
 		uint64 unBytesUsed = 0u;
 
-		for ( int i=0; i < m_StringPools.Count(); i++ )
+		for ( int iShard = 0; iShard < TreeType::POOL_SHARD_COUNT; iShard++ )
 		{
-			StringPool_t *pPool = m_StringPools[i];
+			const CUtlVector< StringPool_t * > &pools = m_PoolShards[iShard].m_StringPools;
+			for ( int i=0; i < pools.Count(); i++ )
+			{
+				StringPool_t *pPool = pools[i];
 
-			unBytesUsed += (uint64)pPool->m_TotalLen;
+				unBytesUsed += (uint64)pPool->m_TotalLen;
+			}
 		}
 		return unBytesUsed;
 	}
@@ -352,21 +381,26 @@ protected:
 		char m_Data[1];
 	};
 
+	struct PoolShard_t
+	{
+		typename TreeType::PoolMutex_t	m_Mutex;
+		CUtlVector< StringPool_t * >	m_StringPools;
+	};
+
 	TreeType m_Lookup;
 
 	// stores the string data
-	CUtlVector< StringPool_t * > m_StringPools;
+	PoolShard_t m_PoolShards[ TreeType::POOL_SHARD_COUNT ];
 
 private:
-	int FindPoolWithSpace( int len ) const;
+	int FindPoolWithSpace( const PoolShard_t &shard, int len ) const;
 };
 
 //-----------------------------------------------------------------------------
 // constructor, destructor
 //-----------------------------------------------------------------------------
 template < class TreeType, bool CASEINSENSITIVE, size_t POOL_SIZE >
-inline CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE >::CUtlSymbolTableLargeBase() : 
-	m_StringPools( 8 )
+inline CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE >::CUtlSymbolTableLargeBase()
 {
 }
 
@@ -402,11 +436,11 @@ inline CUtlSymbolLarge CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_
 }
 
 template < class TreeType, bool CASEINSENSITIVE, size_t POOL_SIZE >
-inline int CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE>::FindPoolWithSpace( int len )	const
+inline int CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE>::FindPoolWithSpace( const PoolShard_t &shard, int len )	const
 {
-	for ( int i=0; i < m_StringPools.Count(); i++ )
+	for ( int i=0; i < shard.m_StringPools.Count(); i++ )
 	{
-		StringPool_t *pPool = m_StringPools[i];
+		StringPool_t *pPool = shard.m_StringPools[i];
 
 		if ( (pPool->m_TotalLen - pPool->m_SpaceUsed) >= len )
 		{
@@ -439,8 +473,23 @@ inline CUtlSymbolLarge CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_
 	//COMPILE_TIME_ASSERT(sizeof(LargeSymbolTableHashDecoration_t) == sizeof(intp));
 	lenDecorated = ALIGN_VALUE(lenDecorated, sizeof( intp ) );
 
+	// Compute a hash
+	LargeSymbolTableHashDecoration_t hash = CUtlSymbolLarge_Hash( CASEINSENSITIVE, pString, lenString );
+
+	// Equal strings hash alike and so share a shard; once we hold its lock,
+	// check again in case another thread added this string meanwhile.
+	PoolShard_t &shard = m_PoolShards[ ( hash >> 16 ) & ( TreeType::POOL_SHARD_COUNT - 1 ) ];
+	shard.m_Mutex.Lock();
+
+	id = Find( pString );
+	if ( id != UTL_INVAL_SYMBOL_LARGE )
+	{
+		shard.m_Mutex.Unlock();
+		return id;
+	}
+
 	// Find a pool with space for this string, or allocate a new one.
-	int iPool = FindPoolWithSpace( lenDecorated );
+	int iPool = FindPoolWithSpace( shard, lenDecorated );
 	if ( iPool == -1 )
 	{
 		// Add a new pool.
@@ -449,14 +498,11 @@ inline CUtlSymbolLarge CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_
 
 		pPool->m_TotalLen = newPoolSize - sizeof( StringPool_t );
 		pPool->m_SpaceUsed = 0;
-		iPool = m_StringPools.AddToTail( pPool );
+		iPool = shard.m_StringPools.AddToTail( pPool );
 	}
 
-	// Compute a hash
-	LargeSymbolTableHashDecoration_t hash = CUtlSymbolLarge_Hash( CASEINSENSITIVE, pString, lenString );
-
 	// Copy the string in.
-	StringPool_t *pPool = m_StringPools[iPool];
+	StringPool_t *pPool = shard.m_StringPools[iPool];
 	// Assert( pPool->m_SpaceUsed < 0xFFFF );	// Pool could be bigger than 2k
 	// This should never happen, because if we had a string > 64k, it
 	// would have been given its entire own pool.
@@ -471,8 +517,11 @@ inline CUtlSymbolLarge CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_
 
 	// insert the string into the database
 	MEM_ALLOC_CREDIT();
-	int idx = m_Lookup.Insert( entry );
-	return m_Lookup.Element( idx )->ToSymbol();
+	intp idx = m_Lookup.Insert( entry );
+	id = m_Lookup.Element( idx )->ToSymbol();
+
+	shard.m_Mutex.Unlock();
+	return id;
 }
 
 //-----------------------------------------------------------------------------
@@ -483,13 +532,17 @@ inline void CUtlSymbolTableLargeBase<TreeType, CASEINSENSITIVE, POOL_SIZE>::Remo
 {
 	m_Lookup.Purge();
 
-	for ( int i=0; i < m_StringPools.Count(); i++ )
+	for ( int iShard = 0; iShard < TreeType::POOL_SHARD_COUNT; iShard++ )
 	{
-		StringPool_t * pString = m_StringPools[i];
-		free( pString );
-	}
+		CUtlVector< StringPool_t * > &pools = m_PoolShards[iShard].m_StringPools;
+		for ( int i=0; i < pools.Count(); i++ )
+		{
+			StringPool_t * pString = pools[i];
+			free( pString );
+		}
 
-	m_StringPools.RemoveAll();
+		pools.RemoveAll();
+	}
 }
 
 // Case-sensitive
@@ -29,12 +29,14 @@
 #include "utlvector.h"
 #include "utlqueue.h"
 #include "UtlSortVector.h"
+#include "utlstring.h"
+#include "checksum_crc.h"
 #include "convar.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
 
-static const char * s_LastFileLoadingFrom = "unknown"; // just needed for error messages
+static THREAD_LOCAL const char * s_LastFileLoadingFrom = "unknown"; // just needed for error messages
 
 // Statics for the growable string table
 int (*KeyValues::s_pfGetSymbolForString)( const char *name, bool bCreate ) = &KeyValues::GetSymbolForStringClassic;
@@ -42,7 +44,6 @@ const char *(*KeyValues::s_pfGetStringForSymbol)( int symbol ) = &KeyValues::Get
 CKeyValuesGrowableStringTable *KeyValues::s_pGrowableStringTable = NULL;
 
 #define KEYVALUES_TOKEN_SIZE	4096
-static char s_pTokenBuf[KEYVALUES_TOKEN_SIZE];
 
 
 #define INTERNALWRITE( pData, len ) InternalWrite( filesystem, f, pBuf, pData, len )
@@ -122,7 +123,29 @@ private:
 	const char *m_pFilename;
 	int		m_errorIndex;
 	int		m_maxErrorIndex;
-} g_KeyValuesErrorStack;
+};
+
+
+//-----------------------------------------------------------------------------
+// Token buffer and error context of a text parse. Every LoadFromBuffer call
+// installs its own for the calling thread, so loads on different threads (and
+// nested #include/#base loads) never share them and don't need a global lock.
+//-----------------------------------------------------------------------------
+struct KeyValuesParseState_t
+{
+	char					m_szToken[KEYVALUES_TOKEN_SIZE];
+	CKeyValuesErrorStack	m_ErrorStack;
+};
+
+static THREAD_LOCAL KeyValuesParseState_t *s_pParseState = NULL;
+
+// Used by ReadToken calls outside of LoadFromBuffer
+static KeyValuesParseState_t s_DefaultParseState;
+
+static inline KeyValuesParseState_t &GetParseState()
+{
+	return s_pParseState ? *s_pParseState : s_DefaultParseState;
+}
 
 
 // a simple helper that creates stack entries as it goes in & out of scope
@@ -136,7 +159,7 @@ public:
 
 	~CKeyErrorContext()
 	{
-		g_KeyValuesErrorStack.Pop();
+		GetParseState().m_ErrorStack.Pop();
 	}
 	CKeyErrorContext( int symName )
 	{
@@ -144,7 +167,7 @@ public:
 	}
 	void Reset( int symName )
 	{
-		g_KeyValuesErrorStack.Reset( m_stackLevel, symName );
+		GetParseState().m_ErrorStack.Reset( m_stackLevel, symName );
 	}
 	int GetStackLevel() const
 	{
@@ -153,7 +176,7 @@ public:
 private:
 	void Init( int symName )
 	{
-		m_stackLevel = g_KeyValuesErrorStack.Push( symName );
+		m_stackLevel = GetParseState().m_ErrorStack.Push( symName );
 	}
 
 	int m_stackLevel;
@@ -559,22 +582,24 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 	if ( !c )
 		return NULL;
 
+	char *pTokenBuf = GetParseState().m_szToken;
+
 	// read quoted strings specially
 	if ( *c == '\"' )
 	{
 		wasQuoted = true;
 		buf.GetDelimitedString( m_bHasEscapeSequences ? GetCStringCharConversion() : GetNoEscCharConversion(), 
-			s_pTokenBuf, KEYVALUES_TOKEN_SIZE );
-		return s_pTokenBuf;
+			pTokenBuf, KEYVALUES_TOKEN_SIZE );
+		return pTokenBuf;
 	}
 
 	if ( *c == '{' || *c == '}' )
 	{
 		// it's a control char, just add this one char and stop reading
-		s_pTokenBuf[0] = *c;
-		s_pTokenBuf[1] = 0;
+		pTokenBuf[0] = *c;
+		pTokenBuf[1] = 0;
 		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, 1 );
-		return s_pTokenBuf;
+		return pTokenBuf;
 	}
 
 	// read in the token until we hit a whitespace or a control character
@@ -605,18 +630,18 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 
 		if (nCount < (KEYVALUES_TOKEN_SIZE-1) )
 		{
-			s_pTokenBuf[nCount++] = *c;	// add char to buffer
+			pTokenBuf[nCount++] = *c;	// add char to buffer
 		}
 		else if ( !bReportedError )
 		{
 			bReportedError = true;
-			g_KeyValuesErrorStack.ReportError(" ReadToken overflow" );
+			GetParseState().m_ErrorStack.ReportError(" ReadToken overflow" );
 		}
 
 		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, 1 );
 	}
-	s_pTokenBuf[ nCount ] = 0;
-	return s_pTokenBuf;
+	pTokenBuf[ nCount ] = 0;
+	return pTokenBuf;
 }
 #pragma warning (default:4706)
 
@@ -640,6 +665,181 @@ void KeyValues::UsesConditionals(bool state)
 }
 
 
+//-----------------------------------------------------------------------------
+// Compiled binary cache for text KeyValues files, enabled with -kvcache.
+// An entry holds the resolved tree (#include and #base already merged in),
+// written with WriteAsBinary, plus the path and timestamp of every file that
+// went into it. Loads whose files are all unchanged skip tokenizing entirely.
+// Files that evaluated [$CONDITIONALS] aren't cached, since the result depends
+// on the running platform, and neither are materials, which sv_pure has to see.
+//-----------------------------------------------------------------------------
+#define KEYVALUES_CACHE_ID			MAKEID( 'K', 'V', 'B', 'C' )
+#define KEYVALUES_CACHE_VERSION		1
+#define KEYVALUES_CACHE_DIR			"kvcache"
+#define KEYVALUES_CACHE_PATHID		"DEFAULT_WRITE_PATH"
+
+struct KeyValuesFileDependency_t
+{
+	CUtlString	m_Path;
+	CUtlString	m_PathID;
+	long		m_nFileTime;
+};
+
+// Files read while loading one file, including everything it pulled in
+struct KeyValuesLoadRecord_t
+{
+	KeyValuesLoadRecord_t() : m_bEvaluatedConditionals( false ) {}
+
+	void AddDependency( const char *pPath, const char *pPathID, long nFileTime )
+	{
+		int i = m_Dependencies.AddToTail();
+		m_Dependencies[i].m_Path = pPath;
+		m_Dependencies[i].m_PathID = pPathID ? pPathID : "";
+		m_Dependencies[i].m_nFileTime = nFileTime;
+	}
+
+	void MergeInto( KeyValuesLoadRecord_t *pOuter ) const
+	{
+		if ( !pOuter )
+			return;
+		pOuter->m_Dependencies.AddMultipleToTail( m_Dependencies.Count(), m_Dependencies.Base() );
+		pOuter->m_bEvaluatedConditionals |= m_bEvaluatedConditionals;
+	}
+
+	CUtlVector< KeyValuesFileDependency_t > m_Dependencies;
+	bool m_bEvaluatedConditionals;
+};
+
+static THREAD_LOCAL KeyValuesLoadRecord_t *s_pLoadRecord = NULL;
+
+static bool UseKeyValuesCache( const char *pResourceName )
+{
+	static int s_nUseCache = -1;
+	if ( s_nUseCache < 0 )
+	{
+		s_nUseCache = CommandLine()->FindParm( "-kvcache" ) ? 1 : 0;
+	}
+	if ( !s_nUseCache || !pResourceName )
+		return false;
+
+	return !Q_stristr( pResourceName, ".vmt" ) && Q_strnicmp( pResourceName, "materials", 9 );
+}
+
+static void GetKeyValuesCacheFileName( const char *pResourceName, const char *pPathID, int nFlags, char *pOut, int nOutSize )
+{
+	char szKey[1024];
+	Q_snprintf( szKey, sizeof( szKey ), "%s:%s:%d", pPathID ? pPathID : "", pResourceName, nFlags );
+	Q_strlower( szKey );
+	Q_FixSlashes( szKey, '/' );
+	CRC32_t crc = CRC32_ProcessSingleBuffer( szKey, Q_strlen( szKey ) );
+	Q_snprintf( pOut, nOutSize, KEYVALUES_CACHE_DIR "/%08x.kvb", (unsigned int)crc );
+}
+
+static int GetKeyValuesCacheFlags( KeyValues *pKV )
+{
+	return ( pKV->m_bHasEscapeSequences ? 1 : 0 ) | ( pKV->m_bEvaluateConditionals ? 2 : 0 );
+}
+
+static void SetParseFlagsRecursive( KeyValues *pKV, bool bEscapeSequences, bool bConditionals )
+{
+	for ( KeyValues *pDat = pKV; pDat; pDat = pDat->GetNextKey() )
+	{
+		pDat->UsesEscapeSequences( bEscapeSequences );
+		pDat->UsesConditionals( bConditionals );
+		if ( pDat->GetFirstSubKey() )
+		{
+			SetParseFlagsRecursive( pDat->GetFirstSubKey(), bEscapeSequences, bConditionals );
+		}
+	}
+}
+
+static bool LoadKeyValuesFromCache( KeyValues *pKV, IBaseFileSystem *filesystem, const char *pResourceName, const char *pPathID )
+{
+	int nFlags = GetKeyValuesCacheFlags( pKV );
+	char szCacheFile[MAX_PATH];
+	GetKeyValuesCacheFileName( pResourceName, pPathID, nFlags, szCacheFile, sizeof( szCacheFile ) );
+
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( szCacheFile, KEYVALUES_CACHE_PATHID, buf ) )
+		return false;
+
+	if ( buf.GetInt() != KEYVALUES_CACHE_ID || buf.GetInt() != KEYVALUES_CACHE_VERSION || buf.GetInt() != nFlags )
+		return false;
+
+	char szString[MAX_PATH];
+	buf.GetString( szString, sizeof( szString ) );
+	if ( Q_stricmp( szString, pResourceName ) )
+		return false;
+	buf.GetString( szString, sizeof( szString ) );
+	if ( Q_stricmp( szString, pPathID ? pPathID : "" ) )
+		return false;
+
+	KeyValuesLoadRecord_t record;
+	int nDependencies = buf.GetInt();
+	for ( int i = 0; i < nDependencies && buf.IsValid(); ++i )
+	{
+		char szPathID[MAX_PATH];
+		buf.GetString( szString, sizeof( szString ) );
+		buf.GetString( szPathID, sizeof( szPathID ) );
+		int nFileTime = buf.GetInt();
+		if ( (int)filesystem->GetFileTime( szString, szPathID[0] ? szPathID : NULL ) != nFileTime )
+			return false;
+		record.AddDependency( szString, szPathID, nFileTime );
+	}
+	if ( !buf.IsValid() )
+		return false;
+
+	bool bEscapeSequences = pKV->m_bHasEscapeSequences != 0;
+	bool bConditionals = pKV->m_bEvaluateConditionals != 0;
+	if ( !pKV->ReadAsBinary( buf ) )
+	{
+		// Corrupt entry; throw away whatever was read and parse the text instead
+		KeyValues *pPeer = pKV->GetNextKey();
+		pKV->SetNextKey( NULL );
+		while ( pPeer )
+		{
+			KeyValues *pNext = pPeer->GetNextKey();
+			pPeer->SetNextKey( NULL );
+			pPeer->deleteThis();
+			pPeer = pNext;
+		}
+		pKV->Clear();
+		pKV->UsesEscapeSequences( bEscapeSequences );
+		pKV->UsesConditionals( bConditionals );
+		return false;
+	}
+	SetParseFlagsRecursive( pKV, bEscapeSequences, bConditionals );
+
+	// Whoever #included us depends on our files too
+	record.MergeInto( s_pLoadRecord );
+	return true;
+}
+
+static void SaveKeyValuesToCache( KeyValues *pKV, IBaseFileSystem *filesystem, const char *pResourceName, const char *pPathID, const KeyValuesLoadRecord_t &record )
+{
+	CUtlBuffer buf;
+	buf.PutInt( KEYVALUES_CACHE_ID );
+	buf.PutInt( KEYVALUES_CACHE_VERSION );
+	buf.PutInt( GetKeyValuesCacheFlags( pKV ) );
+	buf.PutString( pResourceName );
+	buf.PutString( pPathID ? pPathID : "" );
+	buf.PutInt( record.m_Dependencies.Count() );
+	for ( int i = 0; i < record.m_Dependencies.Count(); ++i )
+	{
+		buf.PutString( record.m_Dependencies[i].m_Path.Get() );
+		buf.PutString( record.m_Dependencies[i].m_PathID.Get() );
+		buf.PutInt( (int)record.m_Dependencies[i].m_nFileTime );
+	}
+	if ( !pKV->WriteAsBinary( buf ) )
+		return;
+
+	char szCacheFile[MAX_PATH];
+	GetKeyValuesCacheFileName( pResourceName, pPathID, GetKeyValuesCacheFlags( pKV ), szCacheFile, sizeof( szCacheFile ) );
+	((IFileSystem *)filesystem)->CreateDirHierarchy( KEYVALUES_CACHE_DIR, KEYVALUES_CACHE_PATHID );
+	filesystem->WriteFile( szCacheFile, KEYVALUES_CACHE_PATHID, buf );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Load keyValues from disk
 //-----------------------------------------------------------------------------
@@ -691,9 +891,27 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 		return true;
 	}
 
+	const bool bUseCompiledCache = UseKeyValuesCache( resourceName );
+	if ( bUseCompiledCache && LoadKeyValuesFromCache( this, filesystem, resourceName, pathID ) )
+	{
+		COM_TimestampedLog( "KeyValues::LoadFromFile(%s%s%s): End / CompiledCacheHit", pathID ? pathID : "", pathID && resourceName ? "/" : "", resourceName ? resourceName : "" );
+		return true;
+	}
+
+	// Track every file this load reads, including #include and #base files
+	KeyValuesLoadRecord_t loadRecord;
+	KeyValuesLoadRecord_t *pOuterLoadRecord = s_pLoadRecord;
+	if ( bUseCompiledCache || pOuterLoadRecord )
+	{
+		loadRecord.AddDependency( resourceName, pathID, filesystem->GetFileTime( resourceName, pathID ) );
+		s_pLoadRecord = &loadRecord;
+	}
+
 	FileHandle_t f = filesystem->Open(resourceName, "rb", pathID);
 	if ( !f )
 	{
+		s_pLoadRecord = pOuterLoadRecord;
+		loadRecord.MergeInto( pOuterLoadRecord );
 		COM_TimestampedLog("KeyValues::LoadFromFile(%s%s%s): End / FileNotFound", pathID ? pathID : "", pathID && resourceName ? "/" : "", resourceName ? resourceName : "");
 		return false;
 	}
@@ -718,6 +936,13 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
 		bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
 	}
+
+	s_pLoadRecord = pOuterLoadRecord;
+	if ( bUseCompiledCache && bRetOK && !loadRecord.m_bEvaluatedConditionals )
+	{
+		SaveKeyValuesToCache( this, filesystem, resourceName, pathID, loadRecord );
+	}
+	loadRecord.MergeInto( pOuterLoadRecord );
 	
 	// The cache relies on the KeyValuesSystem string table, which will only be valid if we're
 	// using classic mode. 
@@ -2220,6 +2445,11 @@ bool EvaluateConditional( const char *str )
 	if ( !str )
 		return false;
 
+	if ( s_pLoadRecord )
+	{
+		s_pLoadRecord->m_bEvaluatedConditionals = true;
+	}
+
 	if ( *str == '[' )
 		str++;
 
@@ -2251,21 +2481,24 @@ bool EvaluateConditional( const char *str )
 	return false;
 }
 
-// prevent two threads from entering this at the same time and trying to share the global error reporting and parse buffers
-static CThreadFastMutex g_KVMutex;
 //-----------------------------------------------------------------------------
 // Read from a buffer...
 //-----------------------------------------------------------------------------
 bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBaseFileSystem* pFileSystem, const char *pPathID )
 {
-	AUTO_LOCK( g_KVMutex );
+	// Parse with our own token buffer and error stack, restoring the outer
+	// parse's state afterwards (#include and #base load files recursively)
+	KeyValuesParseState_t parseState;
+	KeyValuesParseState_t *pOuterParseState = s_pParseState;
+	s_pParseState = &parseState;
+
 	KeyValues *pPreviousKey = NULL;
 	KeyValues *pCurrentKey = this;
 	CUtlVector< KeyValues * > includedKeys;
 	CUtlVector< KeyValues * > baseKeys;
 	bool wasQuoted;
 	bool wasConditional;
-	g_KeyValuesErrorStack.SetFilename( resourceName );	
+	parseState.m_ErrorStack.SetFilename( resourceName );	
 	do 
 	{
 		bool bAccepted = true;
@@ -2282,7 +2515,7 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 
 			if ( !s || *s == 0 )
 			{
-				g_KeyValuesErrorStack.ReportError("#include is NULL " );
+				parseState.m_ErrorStack.ReportError("#include is NULL " );
 			}
 			else
 			{
@@ -2298,7 +2531,7 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 
 			if ( !s || *s == 0 )
 			{
-				g_KeyValuesErrorStack.ReportError("#base is NULL " );
+				parseState.m_ErrorStack.ReportError("#base is NULL " );
 			}
 			else
 			{
@@ -2344,7 +2577,7 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 		}
 		else
 		{
-			g_KeyValuesErrorStack.ReportError("LoadFromBuffer: missing {" );
+			parseState.m_ErrorStack.ReportError("LoadFromBuffer: missing {" );
 		}
 
 		if ( !bAccepted )
@@ -2384,7 +2617,8 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBase
 		}
 	}
 
-	g_KeyValuesErrorStack.SetFilename( "" );	
+	parseState.m_ErrorStack.SetFilename( "" );	
+	s_pParseState = pOuterParseState;
 
 	return true;
 }
@@ -2429,7 +2663,7 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 	bool wasConditional;
 	if ( errorReport.GetStackLevel() > 100 )
 	{
-		g_KeyValuesErrorStack.ReportError( "RecursiveLoadFromBuffer:  recursion overflow" );
+		GetParseState().m_ErrorStack.ReportError( "RecursiveLoadFromBuffer:  recursion overflow" );
 		return;
 	}
 
@@ -2451,13 +2685,13 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 
 		if ( !name )	// EOF stop reading
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got EOF instead of keyname" );
+			GetParseState().m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got EOF instead of keyname" );
 			break;
 		}
 
 		if ( !*name ) // empty token, maybe "" or EOF
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got empty keyname" );
+			GetParseState().m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got empty keyname" );
 			break;
 		}
 
@@ -2483,13 +2717,13 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 
 		if ( !value )
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got NULL key" );
+			GetParseState().m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got NULL key" );
 			break;
 		}
 		
 		if ( *value == '}' && !wasQuoted )
 		{
-			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got } in key" );
+			GetParseState().m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got } in key" );
 			break;
 		}
 
@@ -2504,7 +2738,7 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 		{
 			if ( wasConditional )
 			{
-				g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got conditional between key and value" );
+				GetParseState().m_ErrorStack.ReportError("RecursiveLoadFromBuffer:  got conditional between key and value" );
 				break;
 			}
 			
@@ -2838,6 +3072,176 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 	return buffer.IsValid();
 }
 
+//-----------------------------------------------------------------------------
+// CKeyValuesArena. Arenas register themselves so KeyValues::operator delete can
+// tell their nodes apart from KeyValuesSystem() ones; while no arena exists that
+// check is a single read.
+//-----------------------------------------------------------------------------
+static THREAD_LOCAL CKeyValuesArena *s_pActiveArena = NULL;
+static CThreadFastMutex s_ArenaMutex;
+static CUtlVector< CKeyValuesArena * > s_Arenas;
+static CInterlockedInt s_nArenaCount;
+
+CKeyValuesArena::CKeyValuesArena( int nNodesPerBlock )
+{
+	m_nNodesPerBlock = MAX( nNodesPerBlock, 16 );
+	m_nNodeSize = ( sizeof( KeyValues ) + 15 ) & ~15;
+
+	AUTO_LOCK( s_ArenaMutex );
+	s_Arenas.AddToTail( this );
+	++s_nArenaCount;
+}
+
+CKeyValuesArena::~CKeyValuesArena()
+{
+	// Unhook every link out of our nodes first so destroying one node never
+	// reaches another through its sub or peer chain. Heap nodes hanging off
+	// ours are collected and deleted on their own; any of our nodes further
+	// down their chains is freed back to us through operator delete then,
+	// since everything they pointed at has already been unhooked.
+	CUtlVector< KeyValues * > heapNodes;
+	for ( int i = 0; i < m_Blocks.Count(); ++i )
+	{
+		Block_t &block = m_Blocks[i];
+		for ( int j = 0; j < block.m_nUsed; ++j )
+		{
+			if ( !block.m_pLive[j] )
+				continue;
+
+			KeyValues *pNode = (KeyValues *)( block.m_pNodes + j * m_nNodeSize );
+			if ( pNode->m_pSub )
+			{
+				if ( !Owns( pNode->m_pSub, NULL, NULL ) )
+				{
+					heapNodes.AddToTail( pNode->m_pSub );
+				}
+				pNode->m_pSub = NULL;
+			}
+			if ( pNode->m_pPeer )
+			{
+				if ( !Owns( pNode->m_pPeer, NULL, NULL ) )
+				{
+					heapNodes.AddToTail( pNode->m_pPeer );
+				}
+				pNode->m_pPeer = NULL;
+			}
+		}
+	}
+
+	// Still registered, so our nodes reached from here are recognised as ours
+	for ( int i = 0; i < heapNodes.Count(); ++i )
+	{
+		heapNodes[i]->deleteThis();
+	}
+
+	for ( int i = 0; i < m_Blocks.Count(); ++i )
+	{
+		Block_t &block = m_Blocks[i];
+		for ( int j = 0; j < block.m_nUsed; ++j )
+		{
+			if ( !block.m_pLive[j] )
+				continue;
+
+			KeyValues *pNode = (KeyValues *)( block.m_pNodes + j * m_nNodeSize );
+			pNode->~KeyValues();
+			block.m_pLive[j] = 0;
+		}
+	}
+
+	AUTO_LOCK( s_ArenaMutex );
+	s_Arenas.FindAndFastRemove( this );
+	--s_nArenaCount;
+
+	for ( int i = 0; i < m_Blocks.Count(); ++i )
+	{
+		delete [] m_Blocks[i].m_pNodes;
+		delete [] m_Blocks[i].m_pLive;
+	}
+	m_Blocks.Purge();
+}
+
+CKeyValuesArena::CScope::CScope( CKeyValuesArena &arena )
+{
+	m_pOuterArena = s_pActiveArena;
+	s_pActiveArena = &arena;
+}
+
+CKeyValuesArena::CScope::~CScope()
+{
+	s_pActiveArena = m_pOuterArena;
+}
+
+void *CKeyValuesArena::Alloc()
+{
+	if ( !m_Blocks.Count() || ( m_Blocks.Tail().m_nUsed == m_nNodesPerBlock ) )
+	{
+		Block_t block;
+		block.m_pNodes = new char[ m_nNodesPerBlock * m_nNodeSize ];
+		block.m_pLive = new unsigned char[ m_nNodesPerBlock ];
+		block.m_nUsed = 0;
+		memset( block.m_pLive, 0, m_nNodesPerBlock );
+
+		// Frees from other threads walk the block list
+		AUTO_LOCK( s_ArenaMutex );
+		m_Blocks.AddToTail( block );
+	}
+
+	Block_t &block = m_Blocks.Tail();
+	int nSlot = block.m_nUsed++;
+	block.m_pLive[nSlot] = 1;
+	return block.m_pNodes + nSlot * m_nNodeSize;
+}
+
+bool CKeyValuesArena::Owns( const void *pMem, int *pBlock, int *pSlot ) const
+{
+	const char *p = (const char *)pMem;
+	for ( int i = m_Blocks.Count(); --i >= 0; )
+	{
+		const Block_t &block = m_Blocks[i];
+		if ( p < block.m_pNodes || p >= block.m_pNodes + m_nNodesPerBlock * m_nNodeSize )
+			continue;
+
+		if ( pBlock )
+		{
+			*pBlock = i;
+		}
+		if ( pSlot )
+		{
+			*pSlot = ( p - block.m_pNodes ) / m_nNodeSize;
+		}
+		return true;
+	}
+	return false;
+}
+
+void *CKeyValuesArena::AllocFromActiveArena( size_t nSize )
+{
+	CKeyValuesArena *pArena = s_pActiveArena;
+	if ( !pArena || ( (int)nSize > pArena->m_nNodeSize ) )
+		return NULL;
+	return pArena->Alloc();
+}
+
+bool CKeyValuesArena::FreeToOwningArena( void *pMem )
+{
+	if ( s_nArenaCount == 0 )
+		return false;
+
+	AUTO_LOCK( s_ArenaMutex );
+	for ( int i = 0; i < s_Arenas.Count(); ++i )
+	{
+		int nBlock, nSlot;
+		if ( s_Arenas[i]->Owns( pMem, &nBlock, &nSlot ) )
+		{
+			// Arena memory is only reclaimed when the whole arena goes away
+			s_Arenas[i]->m_Blocks[nBlock].m_pLive[nSlot] = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+
 #include "tier0/memdbgoff.h"
 
 //-----------------------------------------------------------------------------
@@ -2845,14 +3249,22 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 //-----------------------------------------------------------------------------
 void *KeyValues::operator new( size_t iAllocSize )
 {
+	void *p = CKeyValuesArena::AllocFromActiveArena( iAllocSize );
+	if ( p )
+		return p;
+
 	MEM_ALLOC_CREDIT();
 	return KeyValuesSystem()->AllocKeyValuesMemory( (int)iAllocSize );
 }
 
 void *KeyValues::operator new( size_t iAllocSize, int nBlockUse, const char *pFileName, int nLine )
 {
+	void *p = CKeyValuesArena::AllocFromActiveArena( iAllocSize );
+	if ( p )
+		return p;
+
 	MemAlloc_PushAllocDbgInfo( pFileName, nLine );
-	void *p = KeyValuesSystem()->AllocKeyValuesMemory( (int)iAllocSize );
+	p = KeyValuesSystem()->AllocKeyValuesMemory( (int)iAllocSize );
 	MemAlloc_PopAllocDbgInfo();
 	return p;
 }
@@ -2862,11 +3274,17 @@ void *KeyValues::operator new( size_t iAllocSize, int nBlockUse, const char *pFi
 //-----------------------------------------------------------------------------
 void KeyValues::operator delete( void *pMem )
 {
+	if ( CKeyValuesArena::FreeToOwningArena( pMem ) )
+		return;
+
 	KeyValuesSystem()->FreeKeyValuesMemory(pMem);
 }
 
 void KeyValues::operator delete( void *pMem, int nBlockUse, const char *pFileName, int nLine )
 {
+	if ( CKeyValuesArena::FreeToOwningArena( pMem ) )
+		return;
+
 	KeyValuesSystem()->FreeKeyValuesMemory(pMem);
 }
 
@@ -124,8 +124,56 @@ bool CUtlSymbol::operator==( const char* pStr ) const
 
 //-----------------------------------------------------------------------------
 // symbol table stuff
+//
+// Every string in the pools is preceded by its hash, and the tree is ordered
+// by ( hash, string ), so a lookup walks the tree comparing integers and only
+// compares strings at the node that matches. The class layout, the 16-bit
+// symbol ids and the ids' meaning are unchanged: prebuilt libraries compile
+// CUtlSymbolTableMT and the tree inline against this header. Tables that
+// need more than 64K strings should use CUtlSymbolTableLarge.
 //-----------------------------------------------------------------------------
 
+typedef uint32 SymbolStringHash_t;
+
+static inline SymbolStringHash_t HashSymbolString( const char *pString, bool bInsensitive )
+{
+	// FNV-1a. Caseless tables fold ASCII like V_stricmp does, and hash every
+	// non-ASCII byte alike, since those compare through the CRT's locale.
+	SymbolStringHash_t nHash = 2166136261u;
+	for ( const unsigned char *p = (const unsigned char *)pString; *p; ++p )
+	{
+		unsigned char c = *p;
+		if ( bInsensitive )
+		{
+			if ( c >= 0x80 )
+			{
+				c = 0x80;
+			}
+			else if ( c >= 'A' && c <= 'Z' )
+			{
+				c |= 0x20;
+			}
+		}
+		nHash = ( nHash ^ c ) * 16777619u;
+	}
+	return nHash;
+}
+
+static inline SymbolStringHash_t StoredSymbolStringHash( const char *pPoolString )
+{
+	SymbolStringHash_t nHash;
+	memcpy( &nHash, pPoolString - sizeof( SymbolStringHash_t ), sizeof( nHash ) );
+	return nHash;
+}
+
+static inline int CompareSymbolStrings( SymbolStringHash_t nHash1, const char *pString1, SymbolStringHash_t nHash2, const char *pString2, bool bInsensitive )
+{
+	if ( nHash1 != nHash2 )
+		return ( nHash1 < nHash2 ) ? -1 : 1;
+
+	return bInsensitive ? V_stricmp( pString1, pString2 ) : V_strcmp( pString1, pString2 );
+}
+
 inline const char* CUtlSymbolTable::StringFromIndex( const CStringPoolIndex &index ) const
 {
 	Assert( index.m_iPool < m_StringPools.Count() );
@@ -153,10 +201,11 @@ bool CUtlSymbolTable::CLess::operator()( const CStringPoolIndex &i1, const CStri
 		return true;
 	if ( !str1 && !str2 )
 		return false;
-	if ( !pTable->m_bInsensitive )
-		return V_strcmp( str1, str2 ) < 0;
-	else
-		return V_stricmp( str1, str2 ) < 0;
+
+	// Find() walks the tree itself, but keep the search-string form working
+	SymbolStringHash_t nHash1 = (i1 == INVALID_STRING_INDEX) ? HashSymbolString( str1, pTable->m_bInsensitive ) : StoredSymbolStringHash( str1 );
+	SymbolStringHash_t nHash2 = (i2 == INVALID_STRING_INDEX) ? HashSymbolString( str2, pTable->m_bInsensitive ) : StoredSymbolStringHash( str2 );
+	return CompareSymbolStrings( nHash1, str1, nHash2, str2, pTable->m_bInsensitive ) < 0;
 }
 
 
@@ -180,18 +229,23 @@ CUtlSymbol CUtlSymbolTable::Find( const char* pString ) const
 	if (!pString)
 		return CUtlSymbol();
 	
-	// Store a special context used to help with insertion
-	m_pUserSearchString = pString;
-	
-	// Passing this special invalid symbol makes the comparison function
-	// use the string passed in the context
-	UtlSymId_t idx = m_Lookup.Find( INVALID_STRING_INDEX );
+	// Walk the tree directly with the search string's hash rather than routing
+	// it through m_pUserSearchString, which also keeps concurrent readers of a
+	// CUtlSymbolTableMT from trampling each other's search string.
+	SymbolStringHash_t nHash = HashSymbolString( pString, m_bInsensitive );
 
-#ifdef _DEBUG
-	m_pUserSearchString = NULL;
-#endif
+	UtlSymId_t idx = m_Lookup.Root();
+	while ( idx != m_Lookup.InvalidIndex() )
+	{
+		const char *pNodeString = StringFromIndex( m_Lookup[idx] );
+		int nCompare = CompareSymbolStrings( nHash, pString, StoredSymbolStringHash( pNodeString ), pNodeString, m_bInsensitive );
+		if ( nCompare == 0 )
+			return CUtlSymbol( idx );
 
-	return CUtlSymbol( idx );
+		idx = ( nCompare < 0 ) ? m_Lookup.LeftChild( idx ) : m_Lookup.RightChild( idx );
+	}
+
+	return CUtlSymbol();
 }
 
 
@@ -226,24 +280,29 @@ CUtlSymbol CUtlSymbolTable::AddString( const char* pString )
 		return id;
 
 	int len = V_strlen(pString) + 1;
+	int lenDecorated = len + sizeof( SymbolStringHash_t );
 
 	// Find a pool with space for this string, or allocate a new one.
-	int iPool = FindPoolWithSpace( len );
+	int iPool = FindPoolWithSpace( lenDecorated );
 	if ( iPool == -1 )
 	{
 		// Add a new pool.
-		int newPoolSize = max( len, MIN_STRING_POOL_SIZE );
+		int newPoolSize = max( lenDecorated, MIN_STRING_POOL_SIZE );
 		StringPool_t *pPool = (StringPool_t*)malloc( sizeof( StringPool_t ) + newPoolSize - 1 );
 		pPool->m_TotalLen = newPoolSize;
 		pPool->m_SpaceUsed = 0;
 		iPool = m_StringPools.AddToTail( pPool );
 	}
 
-	// Copy the string in.
+	// Copy the hash and string in.
 	StringPool_t *pPool = m_StringPools[iPool];
 	Assert( pPool->m_SpaceUsed < 0xFFFF );	// This should never happen, because if we had a string > 64k, it
 											// would have been given its entire own pool.
 	
+	SymbolStringHash_t nHash = HashSymbolString( pString, m_bInsensitive );
+	memcpy( &pPool->m_Data[pPool->m_SpaceUsed], &nHash, sizeof( nHash ) );
+	pPool->m_SpaceUsed += sizeof( nHash );
+
 	unsigned short iStringOffset = pPool->m_SpaceUsed;
 
 	memcpy( &pPool->m_Data[pPool->m_SpaceUsed], pString, len );